@@ -2,22 +2,29 @@
 #pragma once
 
 #include "i_forwarders.h"
+#include "i_loop.h"
+#include "config_parser.h"
+#include "metrics.h"
 
 #include <sys/socket.h>
+#include <chrono>
 #include <deque>
+#include <string>
+#include <unordered_map>
 
 namespace dote {
 
-class ILoop;
 class IForwarderConfig;
 class ForwarderConnection;
+class DnsCache;
+class PacketPool;
 
 namespace openssl {
 class ISslFactory;
 }  // namespace openssl
 
-/// \brief  A collection of connections to forwarders, one for each
-///         of the clients
+/// \brief  A pool of connections to forwarders which are re-used
+///         for requests from the clients
 class ClientForwarders : public IForwarders
 {
   public:
@@ -26,11 +33,14 @@ class ClientForwarders : public IForwarders
     /// \param loop            The main loop to run queries under
     /// \param config          The forwarders to send to
     /// \param ssl             A factory for creating SSL
-    /// \param maxConnections  The maximum number of open queries
+    /// \param maxConnections  The maximum number of open connections
+    /// \param metrics         The registry to record the requests and
+    ///                        responses in
     ClientForwarders(std::shared_ptr<ILoop> loop,
                      std::shared_ptr<IForwarderConfig> config,
                      std::shared_ptr<openssl::ISslFactory> ssl,
-                     std::size_t maxConnections);
+                     std::size_t maxConnections,
+                     std::shared_ptr<Metrics> metrics);
 
     ClientForwarders(const ClientForwarders&) = delete;
     ClientForwarders& operator=(const ClientForwarders&) = delete;
@@ -51,6 +61,91 @@ class ClientForwarders : public IForwarders
                        int interface,
                        std::vector<char> request) override;
 
+    /// \brief  Handle a batch of requests that arrived on the same socket
+    ///
+    /// \param socket    The socket to send the responses on
+    /// \param requests  The requests to forward on
+    void handleRequests(std::shared_ptr<Socket> socket,
+                        std::vector<Request> requests) override;
+
+    /// \brief  Set the number of idle connections to keep open to each
+    ///         forwarder rather than shutting them down
+    ///
+    /// \param poolSize  The number of idle connections per forwarder
+    void setPoolSize(std::size_t poolSize);
+
+    /// \brief  Set the number of requests that may be waiting on a
+    ///         response on a single connection at once
+    ///
+    /// \param depth  The maximum outstanding requests per connection
+    void setPipelineDepth(std::size_t depth);
+
+    /// \brief  Set the cache to answer requests from and to store the
+    ///         responses in
+    ///
+    /// \param cache  The cache to use or nullptr to disable caching
+    void setCache(std::shared_ptr<DnsCache> cache);
+
+    /// \brief  Set the pool that packet buffers are returned to when they
+    ///         are finished with and taken from for new packets
+    ///
+    /// \param pool  The pool of packet buffers
+    void setPacketPool(std::shared_ptr<PacketPool> pool);
+
+    /// \brief  Set the least time to wait for a response before sending
+    ///         the request to a second forwarder as well, the time waited
+    ///         is longer if most responses take longer than this
+    ///
+    /// \param delay  The least time to wait, zero to disable hedging
+    void setHedgeDelay(std::chrono::milliseconds delay);
+
+    /// \brief  Set the limits on the requests waiting for a connection,
+    ///         those that can't be sent are answered with a server failure
+    ///
+    /// \param size      The number of requests that may wait
+    /// \param deadline  The longest time a request may wait, zero for
+    ///                  no limit
+    void setQueueLimits(std::size_t size, std::chrono::milliseconds deadline);
+
+    /// \brief  Set the number of times a request is sent again, to another
+    ///         forwarder where there is one, when the connection it was
+    ///         sent on fails before it is answered
+    ///
+    /// \param retries  The number of retries per request, zero to answer
+    ///                 nothing if the connection fails
+    void setRetries(unsigned int retries);
+
+    /// \brief  Set the number of connections to keep open to each forwarder
+    ///         ahead of the requests that will use them, they are opened
+    ///         by warm() and replaced as they close
+    ///
+    /// \param count  The number of connections per forwarder, zero to only
+    ///               open connections when there are requests to send
+    void setWarmConnections(std::size_t count);
+
+    /// \brief  Open connections to each forwarder until there are as many
+    ///         as set by setWarmConnections so the first requests don't
+    ///         have to wait for a handshake
+    void warm();
+
+    /// \brief  Get the number of requests that have been sent to a second
+    ///         forwarder because the first was slow to respond
+    ///
+    /// \return  The number of hedged requests
+    std::size_t hedgesSent() const;
+
+    /// \brief  Get the number of hedged requests where the second forwarder
+    ///         responded first
+    ///
+    /// \return  The number of hedged requests answered by the second forwarder
+    std::size_t hedgesWon() const;
+
+    /// \brief  Get the number of requests that have been sent again after
+    ///         the connection they were sent on failed
+    ///
+    /// \return  The number of retried requests
+    std::size_t retriesSent() const;
+
   private:
     /// \brief  The details of an incoming query that will be
     ///         sent when there's space left
@@ -66,37 +161,245 @@ class ClientForwarders : public IForwarders
         int interface;
         /// The request to send
         std::vector<char> request;
+        /// The key of the question asked, empty if the response can't
+        /// be shared with other requests or cached
+        std::string key;
+        /// The time that the request arrived
+        std::chrono::steady_clock::time_point arrived;
+        /// The number of times the request has been sent again
+        unsigned int retries;
+        /// The forwarder the request was sent to when it failed, AF_UNSPEC
+        /// if it hasn't failed
+        sockaddr_storage failed;
+    };
+
+    /// \brief  A request for the same question as an active query which
+    ///         will be given the same response
+    struct Waiter
+    {
+        /// The ID that the client used in its request
+        unsigned short id;
+        /// The client to send the response to, with its request kept for
+        /// the case that the question was asked in
+        QueuedQuery query;
+    };
+
+    /// \brief  The details of a query that has been sent to a forwarder
+    ///         and is waiting on the response
+    struct ActiveQuery
+    {
+        /// The connection that the request was sent on
+        const ForwarderConnection* connection;
+        /// The ID that the client used in its request
+        unsigned short id;
+        /// The client to send the response to, the request is sent
+        QueuedQuery query;
+        /// The identical requests that arrived while this was in progress
+        std::vector<Waiter> waiters;
+        /// The time the request was sent, or zero if it was sent before
+        /// the connection was open so the time includes the handshake
+        std::chrono::steady_clock::time_point sent;
+        /// The request as it was sent, kept while it may be hedged or
+        /// retried
+        std::vector<char> request;
+        /// The ID in m_active of the other copy of a hedged request or -1
+        int partner;
+        /// True if this is the copy sent to the second forwarder, in which
+        /// case the clients are held by the partner
+        bool hedge;
+        /// True if the response is no longer wanted, the ID stays reserved
+        /// until it arrives so it can't be mistaken for another request
+        bool cancelled;
+        /// The timer to send the request to a second forwarder
+        ILoop::Registration hedgeTimer;
     };
 
-    /// \brief  Send a request
+    /// \brief  A response that is waiting to be sent to a client
+    struct Reply
+    {
+        /// The client to send the response to
+        sockaddr_storage client;
+        /// The length of the client address
+        socklen_t clientLength;
+        /// The TCP framed response to send the UDP packet of
+        std::vector<char> response;
+        /// The control data to set the source address with
+        alignas(cmsghdr) char control[64];
+        /// The length of the control data, zero for none
+        std::size_t controlLength;
+        /// The time that the request arrived
+        std::chrono::steady_clock::time_point arrived;
+    };
+
+    /// The responses waiting to be sent for each socket
+    using SocketAndReplies = std::pair<std::shared_ptr<Socket>, std::vector<Reply>>;
+
+    /// \brief  Get a connection that is able to send a request, either
+    ///         one from the pool with room for another request or a
+    ///         newly created one
     ///
-    /// \param socket   The socket to send the response on
-    /// \param client   The client to respond to
-    /// \param server   The server to respond from (AF_UNSPEC if unknown)
-    /// \param interface  The interface to respond from or -1 if unknown
-    /// \param request  The request to forward on
-    void sendRequest(std::shared_ptr<Socket> socket,
-                     const sockaddr_storage& client,
-                     const sockaddr_storage& server,
-                     int interface,
-                     std::vector<char> request);
+    /// \return  The connection to use or nullptr if none are available
+    std::shared_ptr<ForwarderConnection> acquireConnection();
 
-    /// \brief  Handle an incoming packet for a given client
+    /// \brief  Get a connection to send a second copy of a request on
+    ///
+    /// \param exclude  The forwarder the request was first sent to
+    ///
+    /// \return  The connection to use or nullptr if none are available
+    std::shared_ptr<ForwarderConnection> acquireAlternative(
+        const ConfigParser::Forwarder& exclude);
+
+    /// \brief  Get a connection to send a request that failed on, to a
+    ///         forwarder other than the one it failed on where possible
+    ///
+    /// \param failed  The address of the forwarder the request failed on
+    ///
+    /// \return  The connection to use or nullptr if none are available
+    std::shared_ptr<ForwarderConnection> acquireRetry(
+        const sockaddr_storage& failed);
+
+    /// \brief  Start using a newly created connection
+    ///
+    /// \param connection  The connection to add to the pool
+    ///
+    /// \return  The connection or nullptr if it failed to open
+    std::shared_ptr<ForwarderConnection> addConnection(
+        std::shared_ptr<ForwarderConnection> connection);
+
+    /// \brief  Count the idle connections to a given forwarder
+    ///
+    /// \param forwarder  The forwarder to count the idle connections of
+    ///
+    /// \return  The number of idle connections to the forwarder
+    std::size_t idleConnections(const ConfigParser::Forwarder& forwarder) const;
+
+    /// \brief  Count the connections to a given forwarder that are open or
+    ///         opening, whether they are idle or not
+    ///
+    /// \param forwarder  The forwarder to count the connections to
+    ///
+    /// \return  The number of connections to the forwarder
+    std::size_t openConnections(const ConfigParser::Forwarder& forwarder) const;
+
+    /// \brief  Top up the warm connections after one has closed
+    ///
+    /// \param id  The identifier of the timer that expired
+    void rewarm(int id);
+
+    /// \brief  Attach a request to an active query for the same question
+    ///         rather than sending it to a forwarder again
+    ///
+    /// \param query  The request and the client to respond to
+    ///
+    /// \return  True if the request will be answered by the active query
+    bool attachWaiter(QueuedQuery& query);
+
+    /// \brief  Build the keys of the active queries that were sent while
+    ///         nothing else was in progress, now that a request may share
+    ///         their response
+    void keyActive();
+
+    /// \brief  Send a request, replacing its ID with one that is unique
+    ///         among the requests in progress so the response can be
+    ///         matched to it
+    ///
+    /// \param connection  The connection to send the request on
+    /// \param query       The request and the client to respond to
+    void sendRequest(const std::shared_ptr<ForwarderConnection>& connection,
+                     QueuedQuery query);
+
+    /// \brief  Get an ID that isn't in use by a request in progress
+    ///
+    /// \return  The ID to send a request with
+    unsigned short allocateId();
+
+    /// \brief  Send a request that hasn't been answered in time to a
+    ///         second forwarder as well
+    ///
+    /// \param id  The ID in m_active of the request
+    void hedge(unsigned short id);
+
+    /// \brief  Record the time a forwarder took to respond and update the
+    ///         time to wait before hedging from the recent responses
+    ///
+    /// \param time  The time taken to respond
+    void recordResponseTime(std::chrono::microseconds time);
+
+    /// \brief  Handle an incoming packet for a given client, the response
+    ///         is queued and sent with the others at the end of the loop
+    ///         iteration
     ///
     /// \param socket  The socket to send the response on
     /// \param client  The client that the response is for
     /// \param server   The server to respond from (AF_UNSPEC if unknown)
     /// \param interface  The interface to respond from or -1 if unknown
     /// \param buffer  The recieved buffer
+    /// \param arrived  The time that the request arrived
     void handleIncoming(const std::shared_ptr<Socket>& socket,
                         const sockaddr_storage& client,
                         const sockaddr_storage& server,
                         int interface,
-                        std::vector<char> buffer);
+                        std::vector<char> buffer,
+                        std::chrono::steady_clock::time_point arrived);
 
-    /// \brief  Send a request from the front of the queue
+    /// \brief  Send all of the queued responses
+    ///
+    /// \param id  The identifier of the deferred callback
+    void flushReplies(int id);
+
+    /// \brief  Send the queued responses for a socket
+    ///
+    /// \param handle   The socket to send the responses on
+    /// \param replies  The responses to send
+    void sendReplies(int handle, const std::vector<Reply>& replies);
+
+    /// \brief  Send requests from the front of the queue while there
+    ///         are connections available
     void dequeue();
 
+    /// \brief  Add a request to the queue to wait for a connection, or
+    ///         fail it if the queue is full
+    ///
+    /// \param query  The request and the client to respond to
+    void enqueue(QueuedQuery query);
+
+    /// \brief  Update the queue length metric after the queue has changed
+    void updateQueueLength();
+
+    /// \brief  Fail the requests that have waited too long in the queue
+    ///
+    /// \param id  The identifier of the timer that expired
+    void expireQueue(int id);
+
+    /// \brief  Answer a request that can't be sent with a server failure
+    ///
+    /// \param query  The request and the client to respond to
+    void failRequest(QueuedQuery& query);
+
+    /// \brief  Handle a response from a forwarder connection
+    ///
+    /// \param connection  The connection the response arrived on
+    /// \param buffer      The response
+    void handleResponse(ForwarderConnection& connection,
+                        std::vector<char> buffer);
+
+    /// \brief  Send a response to the client of a request and any others
+    ///         waiting on the same question, and cache it
+    ///
+    /// \param query     The request that has been answered
+    /// \param response  The response from the forwarder
+    void sendResponse(ActiveQuery& query, std::vector<char> response);
+
+    /// \brief  Put a request that was lost with its connection back at the
+    ///         front of the queue, along with those waiting on it, if it
+    ///         has retries left
+    ///
+    /// \param connection  The connection that the request was lost on
+    /// \param lost        The request that was lost
+    ///
+    /// \return  True if the request will be sent again
+    bool retry(const ForwarderConnection& connection, ActiveQuery& lost);
+
     /// \brief  Handle the shutdown of a client
     ///
     /// \param connection  The connection that has shutdown
@@ -110,10 +413,82 @@ class ClientForwarders : public IForwarders
     std::shared_ptr<openssl::ISslFactory> m_ssl;
     /// The maximum number of connections at one time
     std::size_t m_maxConnections;
+    /// The number of idle connections to keep open per forwarder
+    std::size_t m_poolSize;
+    /// The maximum number of outstanding requests on a connection
+    std::size_t m_pipelineDepth;
+    /// The number of times to send a request again after a failure
+    unsigned int m_retries;
+    /// The number of connections to keep open per forwarder
+    std::size_t m_warmConnections;
+    /// The timer to replace the warm connections that have closed
+    ILoop::Registration m_warmTimer;
     /// The currently open connections to forwarders
     std::vector<std::shared_ptr<ForwarderConnection>> m_forwarders;
+    /// The requests that are waiting on a response by the ID they were
+    /// sent to the forwarder with
+    std::unordered_map<unsigned short, ActiveQuery> m_active;
+    /// The ID in m_active of the request sent for each question key
+    std::unordered_map<std::string, unsigned short> m_inflight;
+    /// The IDs in m_active of requests that were sent before their key
+    /// was built, which keep their request until it is
+    std::vector<unsigned short> m_unkeyed;
+    /// The next ID to try to use for a request to a forwarder
+    unsigned short m_nextId;
     /// A queue of requests that will be sent when there's room
     std::deque<QueuedQuery> m_queue;
+    /// The maximum length of m_queue
+    std::size_t m_queueSize;
+    /// The longest time a request may be in m_queue, zero for no limit
+    std::chrono::milliseconds m_queueDeadline;
+    /// The timer to fail the request at the front of m_queue
+    ILoop::Registration m_queueTimer;
+    /// The responses waiting to be sent at the end of the loop iteration
+    std::vector<SocketAndReplies> m_replies;
+    /// The registration to send the waiting responses
+    ILoop::Registration m_flush;
+    /// The cache of responses, may be nullptr
+    std::shared_ptr<DnsCache> m_cache;
+    /// The pool of packet buffers
+    std::shared_ptr<PacketPool> m_packetPool;
+    /// The least time to wait before hedging a request, zero if disabled
+    std::chrono::milliseconds m_hedgeDelay;
+    /// The time to wait before hedging a request, the 90th percentile of
+    /// the recent response times but no less than m_hedgeDelay
+    std::chrono::milliseconds m_hedgeAfter;
+    /// The most recent response times, used as a ring buffer
+    std::vector<std::chrono::microseconds> m_responseTimes;
+    /// The number of response times that have been recorded
+    std::size_t m_responseCount;
+    /// The registry of metrics to record the requests in
+    std::shared_ptr<Metrics> m_metrics;
+    /// The number of requests sent to a second forwarder
+    Metrics::Counter* m_hedgesSent;
+    /// The number of hedged requests answered by the second forwarder
+    Metrics::Counter* m_hedgesWon;
+    /// The number of requests sent again after their connection failed
+    Metrics::Counter* m_retriesSent;
+    /// The number of requests lost with their connection and not retried
+    Metrics::Counter* m_requestsLost;
+    /// The number of requests answered from the cache
+    Metrics::Counter* m_cacheHits;
+    /// The number of requests answered with a server failure because
+    /// they couldn't be sent
+    Metrics::Counter* m_requestsFailed;
+    /// The number of requests waiting in m_queue
+    Metrics::Gauge* m_queueLength;
+    /// The length of m_queue last added to m_queueLength
+    std::size_t m_reportedQueueLength;
+    /// The times that requests waited in m_queue
+    Metrics::Histogram* m_queueTimes;
+    /// The number of connections in m_forwarders
+    Metrics::Gauge* m_openConnections;
+    /// The number of responses sent to clients
+    Metrics::Counter* m_responsesSent;
+    /// The number of responses that couldn't be sent to clients
+    Metrics::Counter* m_sendErrors;
+    /// The times from requests arriving to their responses being sent
+    Metrics::Histogram* m_requestTimes;
 };
 
 }  // namespace dote
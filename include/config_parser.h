@@ -23,6 +23,8 @@ class ConfigParser
         std::string host;
         /// The base64 encoded SHA-256 hash of the certificate
         std::vector<unsigned char> pin;
+        /// Set to true to send the start of the handshake with the SYN
+        bool fastOpen;
     };
 
     /// \brief  The server configuration to listen on
@@ -92,6 +94,100 @@ class ConfigParser
     /// \return  The number of seconds to have a connection open for
     unsigned int timeout() const;
 
+    /// \brief  Get the number of idle connections to keep open to each
+    ///         forwarder for re-use by later requests
+    ///
+    /// \return  The number of idle connections to keep per forwarder
+    std::size_t poolSize() const;
+
+    /// \brief  Get the number of seconds an idle forwarder connection is
+    ///         kept open for before it is closed
+    ///
+    /// \return  The number of seconds to keep an idle connection for
+    unsigned int idleTimeout() const;
+
+    /// \brief  Get the number of requests that may be pipelined on a
+    ///         single forwarder connection at once
+    ///
+    /// \return  The maximum number of outstanding requests per connection
+    std::size_t pipelineDepth() const;
+
+    /// \brief  Get the maximum number of responses to cache
+    ///
+    /// \return  The number of responses to cache, zero to disable caching
+    std::size_t cacheSize() const;
+
+    /// \brief  Get the longest time that a response may be cached for
+    ///
+    /// \return  The maximum number of seconds to cache a response
+    unsigned int cacheTtl() const;
+
+    /// \brief  Get the number of worker threads to run, each with its own
+    ///         event loop, connections and server sockets
+    ///
+    /// \return  The number of worker threads
+    unsigned int workers() const;
+
+    /// \brief  Get the least time to wait on a forwarder before sending
+    ///         the request to another one as well
+    ///
+    /// \return  The number of milliseconds, zero to disable hedging
+    unsigned int hedgeDelay() const;
+
+    /// \brief  Get the number of requests that may wait for a connection
+    ///         before more are refused
+    ///
+    /// \return  The maximum length of the request queue
+    std::size_t queueSize() const;
+
+    /// \brief  Get the longest time a request may wait for a connection
+    ///         before it is failed
+    ///
+    /// \return  The number of milliseconds, zero for no limit
+    unsigned int queueDeadline() const;
+
+    /// \brief  Whether the first request on a resumed forwarder connection
+    ///         should be sent as TLS 1.3 early data
+    ///
+    /// \return  True if early data should be sent
+    bool earlyData() const;
+
+    /// \brief  Whether the record encryption of forwarder connections
+    ///         should be offloaded to the kernel where it is supported
+    ///
+    /// \return  True if kernel TLS should be used
+    bool kernelTls() const;
+
+    /// \brief  Get the number of connections to keep open to each forwarder
+    ///         even while there are no requests to send on them
+    ///
+    /// \return  The number of warm connections per forwarder
+    std::size_t warmConnections() const;
+
+    /// \brief  Get the number of failures in a row after which a forwarder
+    ///         is marked down until a probe of it succeeds
+    ///
+    /// \return  The number of failures, zero to never mark one down
+    unsigned int failureThreshold() const;
+
+    /// \brief  Get the number of times a request is sent again when the
+    ///         connection it was sent on fails before it is answered
+    ///
+    /// \return  The number of retries per request
+    unsigned int retries() const;
+
+    /// \brief  Get the address to serve the metrics on, either an IP and
+    ///         port or a Unix socket path
+    ///
+    /// \return  The address, with a family of AF_UNSPEC to not serve them
+    const sockaddr_storage& metricsAddress() const;
+
+    /// \brief  Get the name of the shared memory segment to publish the
+    ///         metrics in
+    ///
+    /// \return  The name of the segment, empty to not publish them
+    const std::string& statsName() const;
+
   private:
     /// \brief  Set the default forwarders
     void defaultForwarders();
@@ -124,6 +220,9 @@ class ConfigParser
     /// \brief  Disable certificate verification for the current forwarder
     void disableVerification();
 
+    /// \brief  Use TCP Fast Open to connect to the current forwarder
+    void enableFastOpen();
+
     /// \brief  The hostname to add to the current m_partialForwarder
     ///
     /// \param hostname  The hostname expected for the certificate
@@ -159,6 +258,77 @@ class ConfigParser
     /// \param timeout  A decimal string with the timeout
     void setTimeout(const char* timeout);
 
+    /// \brief  Set the number of idle connections to keep per forwarder
+    ///
+    /// \param poolSize  A decimal string with the pool size
+    void setPoolSize(const char* poolSize);
+
+    /// \brief  Set the number of seconds to keep an idle connection open
+    ///
+    /// \param timeout  A decimal string with the idle timeout
+    void setIdleTimeout(const char* timeout);
+
+    /// \brief  Set the number of requests to pipeline on a connection
+    ///
+    /// \param depth  A decimal string with the pipeline depth
+    void setPipelineDepth(const char* depth);
+
+    /// \brief  Set the maximum number of responses to cache
+    ///
+    /// \param size  A decimal string with the number of responses
+    void setCacheSize(const char* size);
+
+    /// \brief  Set the longest time a response may be cached for
+    ///
+    /// \param ttl  A decimal string with the number of seconds
+    void setCacheTtl(const char* ttl);
+
+    /// \brief  Set the number of worker threads to run
+    ///
+    /// \param workers  The number of worker threads
+    void setWorkers(const char* workers);
+
+    /// \brief  Set the least time to wait before hedging a request
+    ///
+    /// \param delay  A decimal string with the number of milliseconds
+    void setHedgeDelay(const char* delay);
+
+    /// \brief  Set the number of requests that may wait for a connection
+    ///
+    /// \param size  A decimal string with the number of requests
+    void setQueueSize(const char* size);
+
+    /// \brief  Set the longest time a request may wait for a connection
+    ///
+    /// \param deadline  A decimal string with the number of milliseconds
+    void setQueueDeadline(const char* deadline);
+
+    /// \brief  Set the number of connections to keep open to each forwarder
+    ///
+    /// \param count  A decimal string with the number of connections
+    void setWarmConnections(const char* count);
+
+    /// \brief  Set the number of failures in a row to mark a forwarder down after
+    ///
+    /// \param threshold  A decimal string with the number of failures
+    void setFailureThreshold(const char* threshold);
+
+    /// \brief  Set the number of times to send a request again after a failure
+    ///
+    /// \param retries  A decimal string with the number of retries
+    void setRetries(const char* retries);
+
+    /// \brief  Set the address to serve the metrics on
+    ///
+    /// \param address  An IP with an optional port, or an absolute path for
+    ///                 a Unix socket
+    void setMetricsAddress(const char* address);
+
+    /// \brief  Set the name of the shared memory segment for the metrics
+    ///
+    /// \param name  The name of the segment, a / followed by no others
+    void setStatsName(const char* name);
+
     /// Whether the parameters are valid
     bool m_valid;
     /// The currently being built forwarder
@@ -179,6 +349,38 @@ class ConfigParser
     bool m_daemonise;
     /// The number of seconds to allow a forwarder to respond
     unsigned int m_timeout;
+    /// The number of idle connections to keep open per forwarder
+    std::size_t m_poolSize;
+    /// The number of seconds to keep an idle connection open for
+    unsigned int m_idleTimeout;
+    /// The maximum number of outstanding requests per connection
+    std::size_t m_pipelineDepth;
+    /// The maximum number of responses to cache
+    std::size_t m_cacheSize;
+    /// The maximum number of seconds to cache a response for
+    unsigned int m_cacheTtl;
+    /// The number of worker threads to run
+    unsigned int m_workers;
+    /// The least number of milliseconds before a request is hedged
+    unsigned int m_hedgeDelay;
+    /// The maximum length of the request queue
+    std::size_t m_queueSize;
+    /// The longest number of milliseconds a request may be queued
+    unsigned int m_queueDeadline;
+    /// Whether to send requests as early data on resumed connections
+    bool m_earlyData;
+    /// Whether to offload record encryption to the kernel
+    bool m_kernelTls;
+    /// The number of connections to keep open to each forwarder
+    std::size_t m_warmConnections;
+    /// The failures in a row to mark a forwarder down after
+    unsigned int m_failureThreshold;
+    /// The number of times to send a request again after a failure
+    unsigned int m_retries;
+    /// The address to serve the metrics on
+    sockaddr_storage m_metricsAddress;
+    /// The name of the shared memory segment to publish the metrics in
+    std::string m_statsName;
 };
 
 }  // namespace dote
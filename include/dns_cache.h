@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace dote {
+
+class DnsPacket;
+
+/// \brief  A cache of responses from the forwarders keyed on the question
+///         that was asked, the least recently used response is evicted
+///         when the cache is full and responses expire with their TTL
+class DnsCache
+{
+  public:
+    /// \brief  Create an empty cache
+    ///
+    /// \param maxEntries  The maximum number of responses to store
+    /// \param maxTtl      The longest number of seconds to store a response
+    DnsCache(std::size_t maxEntries, unsigned int maxTtl);
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    /// \brief  Get the key that the response to a request is cached under,
+    ///         which is the question and whether DNSSEC records are wanted
+    ///
+    /// \param request  The request to get the key for
+    ///
+    /// \return  The key or an empty string if the request can't be cached
+    static std::string key(const DnsPacket& request);
+
+    /// \brief  Look up a cached response
+    ///
+    /// \param key       The key of the request
+    /// \param request   The request, whose ID and question are put in the
+    ///                  response
+    /// \param response  The TCP framed response with the TTLs reduced by
+    ///                  the time it has been in the cache
+    ///
+    /// \return  True if there was a response that hadn't expired
+    bool lookup(const std::string& key,
+                const DnsPacket& request,
+                std::vector<char>& response);
+
+    /// \brief  Store a response if it is cacheable
+    ///
+    /// \param key       The key of the request that was answered
+    /// \param response  The TCP framed response to store
+    void store(const std::string& key, const std::vector<char>& response);
+
+    /// \brief  Get the number of responses in the cache
+    ///
+    /// \return  The number of responses currently stored
+    std::size_t size() const;
+
+  private:
+    /// \brief  A response that is stored in the cache
+    struct Entry
+    {
+        /// The key the response is stored under
+        std::string key;
+        /// The TCP framed response
+        std::vector<char> response;
+        /// The time the response was stored
+        std::chrono::steady_clock::time_point stored;
+        /// The number of seconds the response may be used for
+        uint32_t ttl;
+    };
+
+    /// The maximum number of responses to store
+    std::size_t m_maxEntries;
+    /// The longest number of seconds to store a response
+    uint32_t m_maxTtl;
+    /// The responses, most recently used first
+    std::list<Entry> m_entries;
+    /// The responses by key
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+};
+
+}  // namespace dote
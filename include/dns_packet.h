@@ -1,7 +1,9 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <cstddef>
+#include <cstdint>
 
 namespace dote {
 
@@ -34,6 +36,70 @@ class DnsPacket
     /// \return  The UDP DNS packet
     char* data();
 
+    /// \brief  Get the transaction ID of the packet
+    ///
+    /// \return  The ID of the packet or zero if it is too short
+    unsigned short id() const;
+
+    /// \brief  Set the transaction ID of the packet
+    ///
+    /// \param id  The ID to set if the packet is long enough to hold one
+    void setId(unsigned short id);
+
+    /// \brief  Get the question of the packet with the name in lower
+    ///         case wire format followed by the type and class
+    ///
+    /// \param question  The string to store the question in
+    ///
+    /// \return  False if the packet doesn't have exactly one question
+    ///          or it can't be parsed
+    bool question(std::string& question) const;
+
+    /// \brief  Copy the question of a request over the question of this
+    ///         packet, which only differs in the case of the name, so
+    ///         that a client checking the case it asked with accepts it
+    ///
+    /// \param request  The request to take the question from
+    ///
+    /// \return  False if either has other than one question or they
+    ///          aren't the same length
+    bool copyQuestion(const DnsPacket& request);
+
+    /// \brief  Check whether the DNSSEC OK bit is set in the EDNS record
+    ///
+    /// \return  True if there is an EDNS record with the DO bit set
+    bool dnssecOk() const;
+
+    /// \brief  Check whether the packet is a response that was truncated
+    ///
+    /// \return  True if the truncated bit is set
+    bool truncated() const;
+
+    /// \brief  Get the response code of the packet
+    ///
+    /// \return  The response code from the header or -1 if invalid
+    int responseCode() const;
+
+    /// \brief  Turn a request into a server failure response to it,
+    ///         keeping the ID and question but no other records
+    ///
+    /// \return  False if the packet isn't valid
+    bool setServerFailure();
+
+    /// \brief  Get the lowest TTL of the records in the packet, not
+    ///         including the EDNS record
+    ///
+    /// \param ttl  The variable to store the lowest TTL in
+    ///
+    /// \return  False if there are no records or they can't be parsed
+    bool minimumTtl(uint32_t& ttl) const;
+
+    /// \brief  Reduce the TTL of all of the records in the packet, not
+    ///         including the EDNS record
+    ///
+    /// \param seconds  The number of seconds to reduce the TTLs by
+    void reduceTtls(uint32_t seconds);
+
     /// \brief  Get the length of the UDP DNS packet
     ///
     /// \return  The length of the UDP DNS packet
@@ -66,6 +132,14 @@ class DnsPacket
         unsigned short count,
         std::vector<char>::const_iterator it) const;
 
+    /// \brief  Find the fixed part of every record in the answer,
+    ///         authority and additional sections
+    ///
+    /// \param offsets  The offset of the type field of each record
+    ///
+    /// \return  False if the records can't be parsed
+    bool recordOffsets(std::vector<std::size_t>& offsets) const;
+
     /// \brief  Remove EDNS padding from options section
     ///
     /// \param it  The start of the options section
@@ -1,30 +1,21 @@
-
 #pragma once
 
-#include "verify_cache.h"
-
 #include <memory>
+#include <vector>
 
 namespace dote {
 
-class Loop;
-class Server;
+class ILoop;
 class ConfigParser;
-class ForwarderConfig;
-class ClientForwarders;
-
-namespace openssl {
-class Context;
-}  // namespace openssl
+class Worker;
+class Metrics;
+class StatsSegment;
 
 /// \brief  A main wrapper around the classes that are required to
 ///         provide the DoTe server
 class Dote
 {
   public:
-    /// The number of seconds to cache the cerificates for
-    static constexpr int CACHE_SECONDS = 30;
-
     /// \brief  Create a DoTe server from a given config
     ///
     /// \param config  The configuration to use
@@ -34,7 +25,7 @@ class Dote
     Dote& operator=(const Dote&) = delete;
 
     /// \brief  Shut down the server
-    ~Dote() = default;
+    ~Dote();
     
     /// \brief  Start listening on the server ports
     ///
@@ -48,30 +39,32 @@ class Dote
     /// \param config  The configuration of the forwarders to load
     void setForwarders(const ConfigParser& config);
 
-    /// \brief  Run the server
+    /// \brief  Run the server, the first worker runs on the calling thread
+    ///         and the others on threads of their own, returning once they
+    ///         have all finished
     void run();
 
-    /// \brief  Stop the server
+    /// \brief  Stop the server, this may be called from a signal handler
     void shutdown();
 
-    /// \brief  Get the looper instance
+    /// \brief  Get the looper instance of the first worker
     ///
     /// \return  The looper instance
-    std::shared_ptr<Loop> looper();
+    std::shared_ptr<ILoop> looper();
+
+    /// \brief  Get the registry that the workers record their metrics in
+    ///
+    /// \return  The registry with a shard for each of the workers
+    std::shared_ptr<Metrics> metrics();
 
   private:
-    /// The looper that is used for the server
-    std::shared_ptr<Loop> m_loop;
-    /// The available forwarders
-    std::shared_ptr<ForwarderConfig> m_config;
-    /// The OpenSSL context to use
-    std::shared_ptr<openssl::Context> m_context;
-    /// The current open forwarders
-    std::shared_ptr<ClientForwarders> m_forwarders;
-    /// The listening servers
-    std::shared_ptr<dote::Server> m_server;
-    /// The certificate verification cache for m_context
-    VerifyCache m_cache;
+    /// The registry of metrics with a shard for each worker
+    std::shared_ptr<Metrics> m_metrics;
+    /// The workers that handle the requests
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    /// The shared memory segment the metrics are published in, nullptr
+    /// if they aren't
+    std::unique_ptr<StatsSegment> m_stats;
 };
 
 }  // namespace dote
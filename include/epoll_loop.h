@@ -0,0 +1,43 @@
+#pragma once
+
+#include "handle_loop.h"
+
+namespace dote {
+
+/// \brief  An event loop that uses epoll, the interest list is kept in
+///         the kernel so it is only changed when a registration is made
+///         or removed rather than being rebuilt on every iteration
+class EpollLoop : public HandleLoop
+{
+  public:
+    /// \brief  Create the epoll instance
+    EpollLoop();
+
+    EpollLoop(const EpollLoop&) = delete;
+    EpollLoop& operator=(const EpollLoop&) = delete;
+
+    /// \brief  Close the epoll instance
+    ~EpollLoop() noexcept;
+
+    /// \brief  Check whether the epoll instance was created
+    ///
+    /// \return  True if the loop is able to run
+    bool valid() const;
+
+    /// \brief  Run the loop until there are no registrations left
+    void run() override;
+
+  private:
+    /// \brief  Update the epoll interest list for a handle
+    ///
+    /// \param handle        The handle that has been changed
+    /// \param registration  The callbacks for the handle
+    ///
+    /// \return  False if epoll refused the change
+    bool update(int handle, Handle& registration) override;
+
+    /// The epoll instance
+    int m_epoll;
+};
+
+}  // namespace dote
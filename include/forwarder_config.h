@@ -2,18 +2,29 @@
 #pragma once
 
 #include "i_forwarder_config.h"
+#include "metrics.h"
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace dote {
 
-/// \brief  An encapsulation around the configurations
+/// \brief  An encapsulation around the configurations which chooses the
+///         healthy forwarder with the lowest smoothed round trip time,
+///         occasionally choosing the one measured longest ago instead so
+///         that a forwarder that has recovered or sped up is noticed.
+///         A forwarder that fails repeatedly is marked down and isn't
+///         chosen again until a probe of it succeeds
 class ForwarderConfig : public IForwarderConfig
 {
   public:
     /// \brief  Create an empty configuration set
-    ForwarderConfig();
+    ///
+    /// \param metrics  The registry to record the measurements of each
+    ///                 forwarder in
+    explicit ForwarderConfig(std::shared_ptr<Metrics> metrics);
 
     ForwarderConfig(const ForwarderConfig&) = delete;
     ForwarderConfig& operator=(const ForwarderConfig&) = delete;
@@ -34,12 +45,88 @@ class ForwarderConfig : public IForwarderConfig
     /// \param config  The forwarder that the connection failed for
     void setBad(const ConfigParser::Forwarder& config) override;
 
+    /// \brief  Record the time taken to connect and handshake with a forwarder
+    ///
+    /// \param config  The forwarder that the connection was made to
+    /// \param time    The time from starting to connect to the handshake
+    ///                completing
+    void setHandshakeTime(const ConfigParser::Forwarder& config,
+                          std::chrono::microseconds time) override;
+
+    /// \brief  Record the time taken for the TCP connection to a forwarder
+    ///         to be made, which is when the start of the handshake has
+    ///         been sent
+    ///
+    /// \param config  The forwarder that the connection was made to
+    /// \param time    The time from starting to connect to being connected
+    void setConnectTime(const ConfigParser::Forwarder& config,
+                        std::chrono::microseconds time) override;
+
+    /// \brief  Record the time taken for the first byte of a response to
+    ///         arrive from a forwarder
+    ///
+    /// \param config  The forwarder that answered the request
+    /// \param time    The time from sending the request to the first byte
+    void setFirstByteTime(const ConfigParser::Forwarder& config,
+                          std::chrono::microseconds time) override;
+
+    /// \brief  Record the time taken for a forwarder to answer a request
+    ///
+    /// \param config  The forwarder that answered the request
+    /// \param time    The time from sending the request to the response
+    void setResponseTime(const ConfigParser::Forwarder& config,
+                         std::chrono::microseconds time) override;
+
+    /// \brief  Get whether a forwarder may be used, which it may not while
+    ///         it is marked down after failing repeatedly
+    ///
+    /// \param config  The forwarder to check
+    ///
+    /// \return  True unless the forwarder is marked down
+    bool healthy(const ConfigParser::Forwarder& config) const override;
+
+    /// \brief  Set the number of failures in a row after which a forwarder
+    ///         is marked down
+    ///
+    /// \param threshold  The number of failures, zero to never mark a
+    ///                   forwarder down
+    void setFailureThreshold(unsigned int threshold);
+
+    /// \brief  Get the forwarders that are marked down and are due to be
+    ///         probed, they aren't returned again until the result of
+    ///         the probe is given to setProbeResult
+    ///
+    /// \return  The forwarders to probe
+    std::vector<ConfigParser::Forwarder> dueForProbe() override;
+
+    /// \brief  Record the result of probing a forwarder that is marked
+    ///         down, it is restored if the probe succeeded and is probed
+    ///         again after a longer wait if it didn't
+    ///
+    /// \param config   The forwarder that was probed
+    /// \param success  True if the forwarder answered the probe
+    void setProbeResult(const ConfigParser::Forwarder& config, bool success) override;
+
     /// \brief  Get the configuration to use, must check against
     ///         end() before using it
     ///
     /// \return  The chosen configuration
     std::vector<ConfigParser::Forwarder>::const_iterator get() const override;
 
+    /// \brief  Get the fastest configuration other than a given one
+    ///
+    /// \param exclude  The forwarder that is not to be chosen
+    ///
+    /// \return  The chosen configuration or end() if there is no other
+    std::vector<ConfigParser::Forwarder>::const_iterator getAlternative(
+        const ConfigParser::Forwarder& exclude) const override;
+
+    /// \brief  Get the first of all of the configured forwarders, whether
+    ///         they are good or not
+    ///
+    /// \return  The first configuration, end() if there are none
+    std::vector<ConfigParser::Forwarder>::const_iterator begin() const override;
+
     /// \brief  Get the end marker for the configuration
     ///
     /// \return  The invalid configuration marker
@@ -55,11 +142,146 @@ class ForwarderConfig : public IForwarderConfig
     /// \return  The number of seconds to have a connection open for
     unsigned int timeout() const override;
 
+    /// \brief  Set the number of seconds to keep an idle connection open
+    ///
+    /// \param timeout  The number of seconds to keep an idle connection
+    void setIdleTimeout(unsigned int timeout);
+
+    /// \brief  Get the number of seconds to keep an idle connection open
+    ///
+    /// \return  The number of seconds to keep an idle connection open for
+    unsigned int idleTimeout() const override;
+
+    /// \brief  Set whether the first request on a resumed connection may
+    ///         be sent as TLS 1.3 early data
+    ///
+    /// \param earlyData  True to send early data
+    void setEarlyData(bool earlyData);
+
+    /// \brief  Get whether the first request on a resumed connection may
+    ///         be sent as TLS 1.3 early data
+    ///
+    /// \return  True if early data may be sent
+    bool earlyData() const override;
+
+    /// \brief  Record that a request was sent as early data and the
+    ///         forwarder accepted it
+    void addEarlyData() override;
+
+    /// \brief  Get the number of requests that were sent as early data
+    ///
+    /// \return  The number of requests sent without waiting for a handshake
+    std::size_t earlyDataSent() const;
+
+    /// \brief  Record that a connection had its record encryption
+    ///         offloaded to the kernel
+    void addKernelTls() override;
+
+    /// \brief  Get the number of connections that used kernel TLS
+    ///
+    /// \return  The number of connections offloaded to the kernel
+    std::size_t kernelTlsConnections() const;
+
+    /// \brief  Record that a handshake with a forwarder resumed a session
+    ///
+    /// \param config  The forwarder that the connection was made to
+    void addResumption(const ConfigParser::Forwarder& config) override;
+
   private:
+    /// \brief  The measurements of a forwarder
+    struct Stats
+    {
+        /// The smoothed time to connect and handshake in microseconds,
+        /// negative if not yet measured
+        double handshake;
+        /// The smoothed time to answer a request in microseconds,
+        /// negative if not yet measured
+        double response;
+        /// Whether the last connection to the forwarder failed
+        bool bad;
+        /// The last time that the forwarder was measured
+        std::chrono::steady_clock::time_point updated;
+        /// The number of connections in a row that have failed
+        unsigned int failures;
+        /// Whether the forwarder is marked down until a probe succeeds
+        bool down;
+        /// The time to wait between probes, doubled after each failure
+        std::chrono::milliseconds backoff;
+        /// The time to next probe the forwarder, the maximum while a
+        /// probe is in progress
+        std::chrono::steady_clock::time_point probe;
+        /// The times taken to make the TCP connection
+        Metrics::Histogram* connectTimes;
+        /// The times taken to connect and handshake
+        Metrics::Histogram* handshakeTimes;
+        /// The number of handshakes that resumed a session
+        Metrics::Counter* resumptions;
+        /// The times taken for the first byte of a response to arrive
+        Metrics::Histogram* firstByteTimes;
+        /// The times taken to answer a request
+        Metrics::Histogram* responseTimes;
+        /// The number of connections that have failed
+        Metrics::Counter* errors;
+        /// The number of workers that have the forwarder marked down
+        Metrics::Gauge* markedDown;
+    };
+
+    /// \brief  Get the metrics of a forwarder from the registry
+    ///
+    /// \param config  The forwarder to get the metrics of
+    /// \param stats   The measurements to set the metrics of
+    void registerMetrics(const ConfigParser::Forwarder& config, Stats& stats);
+
+    /// \brief  Find the measurements for a forwarder
+    ///
+    /// \param config  The forwarder to find
+    ///
+    /// \return  The measurements or nullptr if not a known forwarder
+    Stats* find(const ConfigParser::Forwarder& config);
+
+    /// \brief  Find the measurements for a forwarder
+    ///
+    /// \param config  The forwarder to find
+    ///
+    /// \return  The measurements or nullptr if not a known forwarder
+    const Stats* find(const ConfigParser::Forwarder& config) const;
+
+    /// \brief  Get the smoothed time that a forwarder takes to answer
+    ///
+    /// \param stats  The measurements of the forwarder
+    ///
+    /// \return  The expected time in microseconds, negative if unknown
+    static double expected(const Stats& stats);
+
+    /// \brief  Find the fastest healthy forwarder
+    ///
+    /// \param exclude  A forwarder not to choose, or nullptr
+    ///
+    /// \return  The index of the forwarder or the number of forwarders
+    ///          if none are healthy
+    std::size_t fastest(const ConfigParser::Forwarder* exclude) const;
+
     /// The number of seconds to have a connection open for
     unsigned int m_timeout;
+    /// The number of failures in a row to mark a forwarder down after
+    unsigned int m_failureThreshold;
+    /// The number of seconds to keep an idle connection open for
+    unsigned int m_idleTimeout;
+    /// Whether to send requests as early data on resumed connections
+    bool m_earlyData;
+    /// The registry of metrics to record the measurements in
+    std::shared_ptr<Metrics> m_metrics;
+    /// The number of requests that were accepted as early data
+    Metrics::Counter* m_earlyDataSent;
+    /// The number of connections that used kernel TLS
+    Metrics::Counter* m_kernelTlsConnections;
     /// The available forwarders that can be opened
     std::vector<ConfigParser::Forwarder> m_forwarders;
+    /// The measurements of each forwarder in m_forwarders
+    std::vector<Stats> m_stats;
+    /// The number of times that a forwarder has been chosen, used to
+    /// decide when to choose one to measure again
+    mutable unsigned int m_chosen;
 };
 
 }  // namespace dote
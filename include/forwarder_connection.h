@@ -5,6 +5,7 @@
 #include "i_loop.h"
 #include "openssl/ssl_connection.h"
 
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <deque>
@@ -15,6 +16,7 @@ namespace dote {
 
 class IForwarderConfig;
 class Socket;
+class PacketPool;
 
 namespace openssl {
 class ISslFactory;
@@ -22,8 +24,9 @@ class ISslFactory;
 
 /// \brief  A class representing a connection to a forwarder.
 ///
-/// There is an instance of this class for each connection to
-/// a forwarder for each request address.
+/// Requests are written back to back as they are sent and the
+/// responses are passed back as each complete message arrives,
+/// which may be in a different order to the requests.
 class ForwarderConnection
 {
   public:
@@ -39,9 +42,26 @@ class ForwarderConnection
     /// \param loop      The looper to manage the connection
     /// \param config    The configuration for the possible forwarders
     /// \param ssl       The OpenSSL factory to create the connection with
+    /// \param pool      The pool to take the buffers for responses from and
+    ///                  to return the buffers of sent requests to
     ForwarderConnection(std::shared_ptr<ILoop> loop,
                         std::shared_ptr<IForwarderConfig> config,
-                        std::shared_ptr<openssl::ISslFactory> ssl);
+                        std::shared_ptr<openssl::ISslFactory> ssl,
+                        std::shared_ptr<PacketPool> pool);
+
+    /// \brief  Create a connection to a given forwarder
+    ///
+    /// \param loop       The looper to manage the connection
+    /// \param config     The configuration for the possible forwarders
+    /// \param ssl        The OpenSSL factory to create the connection with
+    /// \param pool       The pool to take the buffers for responses from and
+    ///                   to return the buffers of sent requests to
+    /// \param forwarder  The forwarder to connect to
+    ForwarderConnection(std::shared_ptr<ILoop> loop,
+                        std::shared_ptr<IForwarderConfig> config,
+                        std::shared_ptr<openssl::ISslFactory> ssl,
+                        std::shared_ptr<PacketPool> pool,
+                        const ConfigParser::Forwarder& forwarder);
 
     ForwarderConnection(const ForwarderConnection&) = delete;
     ForwarderConnection& operator=(const ForwarderConnection&) = delete;
@@ -67,9 +87,40 @@ class ForwarderConnection
     /// \brief  Start the shutdown of the underlying socket
     void shutdown();
 
-    /// \brief  Send some data
+    /// \brief  Check if the handshake has completed and the connection
+    ///         is ready to carry requests
+    ///
+    /// \return  True if the connection is open
+    bool open() const;
+
+    /// \brief  Check if the connection is open and has nothing to do
+    ///
+    /// \return  True if the connection is open (or opening) and has no
+    ///          request outstanding
+    bool idle() const;
+
+    /// \brief  Get the number of requests sent on this connection that
+    ///         have not yet had a response
     ///
-    /// \param buffer  The buffer to send
+    /// \return  The number of outstanding requests
+    std::size_t outstanding() const;
+
+    /// \brief  Get the forwarder that this connection is made to
+    ///
+    /// \return  The forwarder this connection is for
+    const ConfigParser::Forwarder& forwarder() const;
+
+    /// \brief  Get the time that the first byte of the most recent
+    ///         response arrived, which is still the response being
+    ///         passed on while in the incoming callback
+    ///
+    /// \return  The time the response started to arrive
+    std::chrono::steady_clock::time_point firstByte() const;
+
+    /// \brief  Send a request, requests are pipelined on the connection
+    ///         so this may be called again before the response arrives
+    ///
+    /// \param buffer  The TCP framed request to send
     ///
     /// \return  True if queued to send, false if socket not open or closed
     bool send(std::vector<char> buffer);
@@ -88,6 +139,32 @@ class ForwarderConnection
         CLOSED
     };
 
+    /// \brief  A request that is waiting for its response
+    struct Pending
+    {
+        /// The DNS ID of the request
+        unsigned short id;
+        /// The time to give up on the connection if it hasn't answered
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    /// \brief  The progress of sending the first request as early data
+    enum EarlyData
+    {
+        /// Early data is not being sent
+        NO_EARLY_DATA,
+        /// The first request may be sent as early data once it is queued
+        EARLY_DATA_PENDING,
+        /// The first request was sent as early data and is kept until
+        /// the handshake shows whether it was accepted
+        EARLY_DATA_SENT
+    };
+
+    /// \brief  Start connecting to a forwarder
+    ///
+    /// \param forwarder  The forwarder to connect to
+    void start(const ConfigParser::Forwarder& forwarder);
+
     /// \brief  Configure the verification routines for the connection to
     ///         the given forwarder
     void configureVerifier();
@@ -95,6 +172,11 @@ class ForwarderConnection
     /// \brief  Perform the initial connection
     void connect(int handle);
 
+    /// \brief  Check whether the first request can be sent as early data
+    ///
+    /// \return  True if there is a request that fits in the early data
+    bool canSendEarlyData();
+
     /// \brief  Nicely shutdown the connection
     ///
     /// \param handle  The socket that is available to shutdown on
@@ -105,11 +187,21 @@ class ForwarderConnection
     /// \param handle  The socket the exception occurred on
     void exception(int handle);
 
+    /// \brief  The connection has not progressed in time
+    ///
+    /// \param id  The identifier of the timer that expired
+    void timedOut(int id);
+
     /// \brief  Handle incoming data
     ///
     /// \param handle  The socket that is available to read on
     void incoming(int handle);
 
+    /// \brief  Pass on the complete response in m_readBuffer
+    ///
+    /// \return  False if this was destroyed by the incoming callback
+    bool handleFrame();
+
     /// \brief  Handle outgoing data
     ///
     /// \param handle  The socket that is available to write on
@@ -118,20 +210,32 @@ class ForwarderConnection
     /// \brief  Remove from the looper and close
     void close();
 
-    /// The time to give up on this connection
-    time_t m_timeout;
+    /// \brief  Move the time to give up on this connection
+    ///
+    /// \param seconds  The number of seconds from now to give up
+    void resetTimeout(unsigned int seconds);
+
+    /// \brief  Give up on this connection when the oldest request that
+    ///         is waiting reaches its deadline, or once it has been idle
+    ///         for long enough if there are none
+    void resetDeadline();
+
     /// The looper used to manage the connection
     std::shared_ptr<ILoop> m_loop;
     /// The configuration for the available forwarders
     std::shared_ptr<IForwarderConfig> m_config;
     /// The underlying OpenSSL connection
     std::shared_ptr<openssl::ISslConnection> m_connection;
+    /// The pool of packet buffers
+    std::shared_ptr<PacketPool> m_pool;
     /// A function to handle incoming data on the socket
     IncomingCallback m_incoming;
     /// A function to call when the socket is closed
     ShutdownCallback m_shutdown;
     /// The state of the connection
     State m_state;
+    /// Whether the first request is being sent as early data
+    EarlyData m_earlyData;
     /// The established connection to the forwarder
     std::shared_ptr<Socket> m_socket;
     /// The current read registration for m_socket.
@@ -140,8 +244,25 @@ class ForwarderConnection
     ILoop::Registration m_write;
     /// The current exception registration for m_socket.
     ILoop::Registration m_exception;
-    /// The write buffer, the request will be a single message
-    std::vector<char> m_buffer;
+    /// The timer to give up on this connection
+    ILoop::Registration m_timer;
+    /// The requests waiting to be written, the front may be part way
+    /// through being written so only requests after it are merged
+    std::deque<std::vector<char>> m_buffers;
+    /// The response being read, which is passed on without copying
+    /// once it is complete
+    std::vector<char> m_readBuffer;
+    /// The requests that haven't had a response yet, oldest first
+    std::deque<Pending> m_pending;
+    /// Expires when this is destroyed so callbacks can be detected
+    /// that have deleted this instance
+    std::shared_ptr<bool> m_alive;
+    /// The time that the connection was started
+    std::chrono::steady_clock::time_point m_connectStart;
+    /// Whether the time to make the TCP connection has been recorded
+    bool m_connected;
+    /// The time that the first byte of the response being read arrived
+    std::chrono::steady_clock::time_point m_firstByte;
     /// The chosen forwarder that this is connected to
     ConfigParser::Forwarder m_forwarder;
 };
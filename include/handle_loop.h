@@ -0,0 +1,190 @@
+#pragma once
+
+#include "i_loop.h"
+#include "timer_wheel.h"
+
+#include <unordered_map>
+#include <cstdint>
+
+namespace dote {
+
+/// \brief  The registration book-keeping for an event loop which keeps its
+///         interest list in the kernel, the implementation only needs to
+///         apply the changes to a handle as they are made
+class HandleLoop : public ILoop
+{
+  public:
+    HandleLoop(const HandleLoop&) = delete;
+    HandleLoop& operator=(const HandleLoop&) = delete;
+
+    /// \brief  Has to be noexcept as override
+    virtual ~HandleLoop() noexcept = default;
+
+    /// \brief   Register for read availability on a given handle
+    ///
+    /// \param handle    The handle to register for reading
+    /// \param callback  The callback to call if it triggers
+    /// \param timeout  The time at which to call exception on the handle
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerRead(int handle, Callback callback, time_t timeout) override;
+
+    /// \brief   Register for write availability on a given handle
+    ///
+    /// \param handle    The handle to register for writing
+    /// \param callback  The callback to call if it triggers
+    /// \param timeout  The time at which to call exception on the handle
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerWrite(int handle, Callback callback, time_t timeout) override;
+
+    /// \brief  Register for exceptions on a given handle
+    ///
+    /// \param handle    The handle to register for exceptions
+    /// \param callback  The callback to call if it triggers
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerException(int handle, Callback callback) override;
+
+    /// \brief  Register a single shot timer
+    ///
+    /// \param delay     The time from now to call the callback
+    /// \param callback  The callback to call, with the timer identifier
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerTimer(std::chrono::milliseconds delay, Callback callback) override;
+
+    /// \brief  Register a single shot callback for the end of the iteration
+    ///
+    /// \param callback  The callback to call, with the identifier
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerDeferred(Callback callback) override;
+
+  protected:
+    /// \brief  The callbacks registered for a single handle
+    struct Handle
+    {
+        /// The read callback, empty if not registered
+        Callback read;
+        /// The time at which to raise an exception for the read
+        time_t readTimeout;
+        /// The write callback, empty if not registered
+        Callback write;
+        /// The time at which to raise an exception for the write
+        time_t writeTimeout;
+        /// The exception callback, empty if not registered
+        Callback except;
+        /// The events currently registered with the kernel
+        uint32_t events;
+        /// The identifier of the kernel registration, zero if there is none
+        uint64_t key;
+    };
+
+    /// \brief  Create with no registrations
+    HandleLoop();
+
+    /// \brief  Apply the callbacks for a handle to the kernel after they
+    ///         have changed, after which it is removed if none remain
+    ///
+    /// \param handle        The handle that has been changed
+    /// \param registration  The callbacks for the handle
+    ///
+    /// \return  False if the kernel refused the change
+    virtual bool update(int handle, Handle& registration) = 0;
+
+    /// \brief  Call the callbacks for a handle that the kernel reported
+    ///
+    /// \param handle    The handle to call the callbacks for
+    /// \param readable  Whether to call the read callback
+    /// \param writable  Whether to call the write callback
+    /// \param error     Whether to call the exception callback
+    void dispatch(int handle, bool readable, bool writable, bool error);
+
+    /// \brief  Raise an exception for any registration that has timed out,
+    ///         fire any expired timers and work out how long until the
+    ///         next one will
+    ///
+    /// \return  The number of milliseconds until the next timeout or -1
+    int timeout();
+
+    /// \brief  Check whether there is anything left for the loop to do
+    ///
+    /// \return  True if there are registered handles or pending timers
+    bool active() const;
+
+    /// The registrations for each handle
+    std::unordered_map<int, Handle> m_handles;
+
+  private:
+    /// \brief  Remove a read handle from the loop
+    ///
+    /// \param handle  The handle to remove read handles for
+    void removeRead(int handle) override;
+
+    /// \brief  Remove a write handle from the loop
+    ///
+    /// \param handle  The handle to remove write handles for
+    void removeWrite(int handle) override;
+
+    /// \brief  Remove a exception handle from the loop
+    ///
+    /// \param handle  The handle to remove exception handles for
+    void removeException(int handle) override;
+
+    /// \brief  Remove a timer from the loop
+    ///
+    /// \param id  The identifier of the timer to remove
+    void removeTimer(int id) override;
+
+    /// \brief  Add a callback for a handle
+    ///
+    /// \param handle    The handle to register for
+    /// \param type      The type of the registration
+    /// \param callback  The callback to call if it triggers
+    /// \param timeout   The time at which to call exception on the handle
+    ///
+    /// \return  A registration which is valid on success
+    Registration add(int handle, Type type, Callback callback, time_t timeout);
+
+    /// \brief  Remove a callback for a handle
+    ///
+    /// \param handle  The handle to remove the callback for
+    /// \param type    The type of the registration to remove
+    void remove(int handle, Type type);
+
+    /// \brief  Apply a change to the callbacks of a handle
+    ///
+    /// \param it  The handle that has been changed
+    ///
+    /// \return  False if the kernel refused the change
+    bool apply(std::unordered_map<int, Handle>::iterator it);
+
+    /// \brief  Get the callback for a type of registration
+    ///
+    /// \param handle  The registrations for the handle
+    /// \param type    The type of registration to get the callback of
+    ///
+    /// \return  The callback for the registration type
+    static Callback& callback(Handle& handle, Type type);
+
+    /// \brief  Make sure the timeouts are checked by a given time
+    ///
+    /// \param timeout  The time of a new timeout or zero for none
+    void addTimeout(time_t timeout);
+
+    /// \brief  Raise an exception for a given file descriptor
+    ///
+    /// \param handle  The handle to raise the exception for
+    ///
+    /// \return  True if an exception handler existed for the handle and was called
+    bool raiseException(int handle);
+
+    /// No registration times out before this, so the registrations only
+    /// need to be checked once it has passed, zero if none have timeouts
+    time_t m_nextTimeout;
+    /// The timers
+    TimerWheel m_timers;
+};
+
+}  // namespace dote
@@ -0,0 +1,91 @@
+
+#pragma once
+
+#include "i_loop.h"
+#include "config_parser.h"
+
+#include <memory>
+#include <vector>
+
+namespace dote {
+
+class IForwarderConfig;
+class ForwarderConnection;
+class PacketPool;
+
+namespace openssl {
+class ISslFactory;
+}  // namespace openssl
+
+/// \brief  Probes the forwarders that are marked down with a query of
+///         its own so that they are only restored once they answer,
+///         rather than a client's request finding out whether they have
+///         recovered
+class HealthChecker
+{
+  public:
+    /// \brief  Start checking for forwarders that are due to be probed
+    ///
+    /// \param loop    The main loop to run the probes under
+    /// \param config  The forwarders to probe and record the results in
+    /// \param ssl     A factory for creating SSL
+    /// \param pool    The pool of packet buffers
+    HealthChecker(std::shared_ptr<ILoop> loop,
+                  std::shared_ptr<IForwarderConfig> config,
+                  std::shared_ptr<openssl::ISslFactory> ssl,
+                  std::shared_ptr<PacketPool> pool);
+
+    HealthChecker(const HealthChecker&) = delete;
+    HealthChecker& operator=(const HealthChecker&) = delete;
+
+    /// \brief  Stop checking and abandon any probes in progress
+    ~HealthChecker() noexcept;
+
+  private:
+    /// \brief  A probe of a forwarder that is in progress
+    struct Probe
+    {
+        /// The connection to the forwarder being probed
+        std::shared_ptr<ForwarderConnection> connection;
+        /// Whether the result of the probe has been recorded
+        bool finished;
+    };
+
+    /// \brief  Start probing the forwarders that are due
+    ///
+    /// \param id  The identifier of the timer that expired
+    void check(int id);
+
+    /// \brief  Open a connection to a forwarder and send the probe on it
+    ///
+    /// \param forwarder  The forwarder to probe
+    void probe(const ConfigParser::Forwarder& forwarder);
+
+    /// \brief  Handle the response to a probe
+    ///
+    /// \param connection  The connection the response arrived on
+    /// \param buffer      The response
+    void handleResponse(ForwarderConnection& connection,
+                        std::vector<char> buffer);
+
+    /// \brief  Handle a probe connection closing, which failed if it
+    ///         wasn't answered first
+    ///
+    /// \param connection  The connection that has shutdown
+    void handleShutdown(ForwarderConnection& connection);
+
+    /// The looper to use to manage sockets
+    std::shared_ptr<ILoop> m_loop;
+    /// The forwarders to probe
+    std::shared_ptr<IForwarderConfig> m_config;
+    /// The OpenSSL factory to create connections with
+    std::shared_ptr<openssl::ISslFactory> m_ssl;
+    /// The pool of packet buffers
+    std::shared_ptr<PacketPool> m_pool;
+    /// The probes that are in progress
+    std::vector<Probe> m_probes;
+    /// The timer to check for forwarders that are due to be probed
+    ILoop::Registration m_timer;
+};
+
+}  // namespace dote
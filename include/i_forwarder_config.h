@@ -3,6 +3,7 @@
 
 #include "config_parser.h"
 
+#include <chrono>
 #include <vector>
 
 namespace dote {
@@ -23,12 +24,84 @@ class IForwarderConfig
     /// \param config  The forwarder that the connection failed for
     virtual void setBad(const ConfigParser::Forwarder& config) = 0;
 
+    /// \brief  Record the time taken to connect and handshake with a forwarder
+    ///
+    /// \param config  The forwarder that the connection was made to
+    /// \param time    The time from starting to connect to the handshake
+    ///                completing
+    virtual void setHandshakeTime(const ConfigParser::Forwarder& config,
+                                  std::chrono::microseconds time) = 0;
+
+    /// \brief  Record the time taken for the TCP connection to a forwarder
+    ///         to be made, which is when the start of the handshake has
+    ///         been sent
+    ///
+    /// \param config  The forwarder that the connection was made to
+    /// \param time    The time from starting to connect to being connected
+    virtual void setConnectTime(const ConfigParser::Forwarder& config,
+                                std::chrono::microseconds time) = 0;
+
+    /// \brief  Record the time taken for the first byte of a response to
+    ///         arrive from a forwarder
+    ///
+    /// \param config  The forwarder that answered the request
+    /// \param time    The time from sending the request to the first byte
+    virtual void setFirstByteTime(const ConfigParser::Forwarder& config,
+                                  std::chrono::microseconds time) = 0;
+
+    /// \brief  Record the time taken for a forwarder to answer a request
+    ///
+    /// \param config  The forwarder that answered the request
+    /// \param time    The time from sending the request to the response
+    virtual void setResponseTime(const ConfigParser::Forwarder& config,
+                                 std::chrono::microseconds time) = 0;
+
+    /// \brief  Get whether a forwarder may be used, which it may not while
+    ///         it is marked down after failing repeatedly
+    ///
+    /// \param config  The forwarder to check
+    ///
+    /// \return  True unless the forwarder is marked down
+    virtual bool healthy(const ConfigParser::Forwarder& config) const = 0;
+
+    /// \brief  Get the forwarders that are marked down and are due to be
+    ///         probed, they aren't returned again until the result of
+    ///         the probe is given to setProbeResult
+    ///
+    /// \return  The forwarders to probe
+    virtual std::vector<ConfigParser::Forwarder> dueForProbe() = 0;
+
+    /// \brief  Record the result of probing a forwarder that is marked
+    ///         down, it is restored if the probe succeeded and is probed
+    ///         again after a longer wait if it didn't
+    ///
+    /// \param config   The forwarder that was probed
+    /// \param success  True if the forwarder answered the probe
+    virtual void setProbeResult(const ConfigParser::Forwarder& config,
+                                bool success) = 0;
+
     /// \brief  Get the configuration to use, must check against
     ///         end() before using it
     ///
     /// \return  The chosen configuration
     virtual std::vector<ConfigParser::Forwarder>::const_iterator get() const = 0;
 
+    /// \brief  Get a configuration other than a given one to send a
+    ///         second copy of a request to, must check against end()
+    ///         before using it
+    ///
+    /// \param exclude  The forwarder that is not to be chosen
+    ///
+    /// \return  The chosen configuration
+    virtual std::vector<ConfigParser::Forwarder>::const_iterator getAlternative(
+        const ConfigParser::Forwarder& exclude) const = 0;
+
+    /// \brief  Get the first of all of the configured forwarders, whether
+    ///         they are good or not
+    ///
+    /// \return  The first configuration, end() if there are none
+    virtual std::vector<ConfigParser::Forwarder>::const_iterator begin() const = 0;
+
     /// \brief  Get the end marker for the configuration
     ///
     /// \return  The invalid configuration marker
@@ -38,6 +111,30 @@ class IForwarderConfig
     ///
     /// \return  The number of seconds to have a connection open for
     virtual unsigned int timeout() const = 0;
+
+    /// \brief  Get the number of seconds to keep an idle connection open
+    ///
+    /// \return  The number of seconds to keep an idle connection open for
+    virtual unsigned int idleTimeout() const = 0;
+
+    /// \brief  Get whether the first request on a resumed connection may
+    ///         be sent as TLS 1.3 early data
+    ///
+    /// \return  True if early data may be sent
+    virtual bool earlyData() const = 0;
+
+    /// \brief  Record that a request was sent as early data and the
+    ///         forwarder accepted it
+    virtual void addEarlyData() = 0;
+
+    /// \brief  Record that a connection had its record encryption
+    ///         offloaded to the kernel
+    virtual void addKernelTls() = 0;
+
+    /// \brief  Record that a handshake with a forwarder resumed a session
+    ///
+    /// \param config  The forwarder that the connection was made to
+    virtual void addResumption(const ConfigParser::Forwarder& config) = 0;
 };
 
 }  // namespace dote
@@ -1,11 +1,10 @@
 
 #pragma once
 
+#include <sys/socket.h>
 #include <vector>
 #include <memory>
 
-struct sockaddr_storage;
-
 namespace dote {
 
 class Socket;
@@ -14,6 +13,19 @@ class Socket;
 class IForwarders
 {
   public:
+    /// \brief  A request received from a client
+    struct Request
+    {
+        /// The client to respond to
+        sockaddr_storage client;
+        /// The server to respond from (AF_UNSPEC if unknown)
+        sockaddr_storage server;
+        /// The interface to respond from or -1 if unknown
+        int interface;
+        /// The request to forward on
+        std::vector<char> request;
+    };
+
     virtual ~IForwarders() = default;
 
     /// \brief  Handle an incoming request
@@ -28,6 +40,13 @@ class IForwarders
                                const sockaddr_storage& server,
                                int interface,
                                std::vector<char> request) = 0;
+
+    /// \brief  Handle a batch of requests that arrived on the same socket
+    ///
+    /// \param socket    The socket to send the responses on
+    /// \param requests  The requests to forward on
+    virtual void handleRequests(std::shared_ptr<Socket> socket,
+                                std::vector<Request> requests) = 0;
 };
 
 }  // namespace dote
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <ctime>
 
@@ -22,6 +23,8 @@ class ILoop
       Write,
       /// An exception registration.
       Exception,
+      /// A timer registration.
+      Timer,
     };
 
     /// \brief  This class is created with a read, write or exception
@@ -108,6 +111,29 @@ class ILoop
     /// \return  True if the handle is not already registered and now is
     virtual Registration registerException(int handle, Callback callback) = 0;
 
+    /// \brief  Register a single shot timer, the timer is cancelled when
+    ///         the registration is reset if it hasn't already expired
+    ///
+    /// \param delay     The time from now to call the callback
+    /// \param callback  The callback to call, with the timer identifier
+    ///
+    /// \return  A registration which is valid on success
+    virtual Registration registerTimer(std::chrono::milliseconds delay, Callback callback) = 0;
+
+    /// \brief  Register a single shot callback to be called once the
+    ///         handles that are ready and the timers that have expired
+    ///         have been processed, before the loop waits again.  The
+    ///         registration is removed in the same way as a timer.
+    ///
+    /// \param callback  The callback to call, with the identifier
+    ///
+    /// \return  A registration which is valid on success
+    virtual Registration registerDeferred(Callback callback) = 0;
+
+    /// \brief  Run the loop until there are no registrations left or it
+    ///         is interrupted
+    virtual void run() = 0;
+
   protected:
     /// \brief  Remove a read handle from the loop
     ///
@@ -123,6 +149,11 @@ class ILoop
     ///
     /// \param handle  The handle to remove exception handles for
     virtual void removeException(int handle) = 0;
+
+    /// \brief  Remove a timer from the loop
+    ///
+    /// \param id  The identifier of the timer to remove
+    virtual void removeTimer(int id) = 0;
 };
 
 }  // namespace dote
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "i_loop.h"
+#include "timer_wheel.h"
 
 #include <poll.h>
 
@@ -24,7 +25,7 @@ class Loop : public ILoop
     ~Loop() noexcept = default;
 
     /// \brief  Run the loop
-    void run();
+    void run() override;
 
     /// \brief   Register for read availability on a given handle
     ///
@@ -52,6 +53,21 @@ class Loop : public ILoop
     /// \return  A registration which is valid on success
     Registration registerException(int handle, Callback callback) override;
 
+    /// \brief  Register a single shot timer
+    ///
+    /// \param delay     The time from now to call the callback
+    /// \param callback  The callback to call, with the timer identifier
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerTimer(std::chrono::milliseconds delay, Callback callback) override;
+
+    /// \brief  Register a single shot callback for the end of the iteration
+    ///
+    /// \param callback  The callback to call, with the identifier
+    ///
+    /// \return  A registration which is valid on success
+    Registration registerDeferred(Callback callback) override;
+
   private:
     /// \brief  Remove a read handle from the loop
     ///
@@ -68,6 +84,11 @@ class Loop : public ILoop
     /// \param handle  The handle to remove exception handles for
     void removeException(int handle) override;
 
+    /// \brief  Remove a timer from the loop
+    ///
+    /// \param id  The identifier of the timer to remove
+    void removeTimer(int id) override;
+
     /// \brief  Call a callback in a set of functions
     ///
     /// \param functions  The functions to lookup the callback in
@@ -130,6 +151,8 @@ class Loop : public ILoop
     std::map<int, std::pair<Callback, time_t>> m_writeFunctions;
     /// The exception handles
     std::map<int, Callback> m_exceptFunctions;
+    /// The timers
+    TimerWheel m_timers;
 };
 
 }  // namespace dote
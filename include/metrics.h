@@ -0,0 +1,332 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace dote {
+
+/// \brief  A registry of counters, gauges and latency histograms.  Adding a
+///         metric takes a lock, but updating and reading one only uses
+///         relaxed atomics so that the workers can update them as they
+///         handle requests while another thread reads them.  Each worker
+///         records into a shard of its own so that no two workers write
+///         to the same cache line, and the shards are summed when the
+///         metrics are read.
+class Metrics
+{
+  public:
+    /// The size of a cache line, each metric starts on one of its own
+    static constexpr std::size_t CACHE_LINE = 64u;
+
+    /// \brief  A count that only goes up
+    class alignas(CACHE_LINE) Counter
+    {
+      public:
+        /// \brief  Create a counter at zero
+        Counter();
+
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+
+        /// \brief  Add to the counter
+        ///
+        /// \param count  The amount to add
+        void add(std::uint64_t count = 1u);
+
+        /// \brief  Get the current count
+        ///
+        /// \return  The count
+        std::uint64_t value() const;
+
+      private:
+        /// The current count
+        std::atomic<std::uint64_t> m_value;
+    };
+
+    /// \brief  A value that may go up and down
+    class alignas(CACHE_LINE) Gauge
+    {
+      public:
+        /// \brief  Create a gauge at zero
+        Gauge();
+
+        Gauge(const Gauge&) = delete;
+        Gauge& operator=(const Gauge&) = delete;
+
+        /// \brief  Add to the value, which may be negative
+        ///
+        /// \param delta  The amount to change the value by
+        void add(std::int64_t delta);
+
+        /// \brief  Get the current value
+        ///
+        /// \return  The value
+        std::int64_t value() const;
+
+      private:
+        /// The current value
+        std::atomic<std::int64_t> m_value;
+    };
+
+    /// \brief  A histogram of times in microseconds with buckets that are
+    ///         a fixed fraction of their value wide, so the resolution is
+    ///         the same for fast and slow times
+    class alignas(CACHE_LINE) Histogram
+    {
+      public:
+        /// The number of bits of each time that are kept, so each power
+        /// of two is split into 2^SUB_BITS buckets
+        static constexpr unsigned int SUB_BITS = 3u;
+
+        /// The highest power of two that is recorded, longer times are
+        /// counted in the last bucket
+        static constexpr unsigned int MAX_EXPONENT = 26u;
+
+        /// The number of buckets
+        static constexpr std::size_t BUCKETS =
+            (1u << SUB_BITS) * (MAX_EXPONENT - SUB_BITS + 2u);
+
+        /// \brief  Create an empty histogram
+        Histogram();
+
+        Histogram(const Histogram&) = delete;
+        Histogram& operator=(const Histogram&) = delete;
+
+        /// \brief  Record a time
+        ///
+        /// \param time  The time to add to the histogram
+        void record(std::chrono::microseconds time);
+
+        /// \brief  Add the times recorded in another histogram to this one
+        ///
+        /// \param other  The histogram to add
+        void add(const Histogram& other);
+
+        /// \brief  Get the number of times recorded in a bucket
+        ///
+        /// \param bucket  The bucket to get, less than BUCKETS
+        ///
+        /// \return  The number of times in the bucket
+        std::uint64_t count(std::size_t bucket) const;
+
+        /// \brief  Get the number of times recorded
+        ///
+        /// \return  The number of times in all the buckets
+        std::uint64_t total() const;
+
+        /// \brief  Get the sum of the times recorded
+        ///
+        /// \return  The sum of the times in microseconds
+        std::uint64_t sum() const;
+
+        /// \brief  Get the largest time that is counted in a bucket
+        ///
+        /// \param bucket  The bucket to get the bound of
+        ///
+        /// \return  The largest time in microseconds, the maximum value
+        ///          for the last bucket
+        static std::uint64_t upperBound(std::size_t bucket);
+
+        /// \brief  Get the bucket that a time is counted in
+        ///
+        /// \param micros  The time in microseconds
+        ///
+        /// \return  The bucket the time is in
+        static std::size_t bucket(std::uint64_t micros);
+
+      private:
+        /// The number of times in each bucket
+        std::array<std::atomic<std::uint64_t>, BUCKETS> m_counts;
+        /// The number of times recorded
+        std::atomic<std::uint64_t> m_total;
+        /// The sum of the times recorded in microseconds
+        std::atomic<std::uint64_t> m_sum;
+    };
+
+    /// \brief  The description of a metric
+    struct Info
+    {
+        /// The name of the metric
+        std::string name;
+        /// The labels that tell it apart from others with the same name
+        /// in the form key="value", comma separated, may be empty
+        std::string labels;
+        /// A description of what is measured
+        std::string help;
+    };
+
+    /// \brief  Create an empty registry
+    Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    /// \brief  Add a registry for a worker to record into, which is
+    ///         included in this one when it is visited
+    ///
+    /// \return  The new shard, which lives as long as this registry
+    std::shared_ptr<Metrics> shard();
+
+    /// \brief  Get a counter, adding it if it doesn't exist yet
+    ///
+    /// \param name    The name of the counter
+    /// \param help    A description of what is counted
+    /// \param labels  The labels of the counter, may be empty
+    ///
+    /// \return  The counter, which lives as long as the registry
+    Counter& counter(const std::string& name,
+                     const std::string& help,
+                     const std::string& labels = std::string());
+
+    /// \brief  Get a gauge, adding it if it doesn't exist yet
+    ///
+    /// \param name    The name of the gauge
+    /// \param help    A description of what is measured
+    /// \param labels  The labels of the gauge, may be empty
+    ///
+    /// \return  The gauge, which lives as long as the registry
+    Gauge& gauge(const std::string& name,
+                 const std::string& help,
+                 const std::string& labels = std::string());
+
+    /// \brief  Get a histogram, adding it if it doesn't exist yet
+    ///
+    /// \param name    The name of the histogram
+    /// \param help    A description of what is timed
+    /// \param labels  The labels of the histogram, may be empty
+    ///
+    /// \return  The histogram, which lives as long as the registry
+    Histogram& histogram(const std::string& name,
+                         const std::string& help,
+                         const std::string& labels = std::string());
+
+    /// \brief  Call a function for each metric in the order they were
+    ///         added, metrics with the same name and labels in the shards
+    ///         are summed and visited once, metrics can't be added by the
+    ///         functions
+    ///
+    /// \param counters    Called with each counter
+    /// \param gauges      Called with each gauge
+    /// \param histograms  Called with each histogram
+    void visit(
+        const std::function<void(const Info&, const Counter&)>& counters,
+        const std::function<void(const Info&, const Gauge&)>& gauges,
+        const std::function<void(const Info&, const Histogram&)>& histograms
+    ) const;
+
+  private:
+    /// \brief  Allocates the metrics on their cache lines, which operator
+    ///         new doesn't have to do for them before C++17
+    template<typename T>
+    struct CacheLineAllocator
+    {
+        using value_type = T;
+
+        CacheLineAllocator() = default;
+
+        template<typename U>
+        CacheLineAllocator(const CacheLineAllocator<U>&)
+        { }
+
+        /// \brief  Allocate space for values on a cache line boundary
+        ///
+        /// \param count  The number of values to make space for
+        ///
+        /// \return  The space allocated
+        T* allocate(std::size_t count)
+        {
+            void* memory = nullptr;
+            if (posix_memalign(&memory, CACHE_LINE, count * sizeof(T)) != 0)
+            {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(memory);
+        }
+
+        /// \brief  Free space returned by allocate
+        ///
+        /// \param memory  The space to free
+        void deallocate(T* memory, std::size_t)
+        {
+            free(memory);
+        }
+
+        template<typename U>
+        bool operator==(const CacheLineAllocator<U>&) const
+        {
+            return true;
+        }
+
+        template<typename U>
+        bool operator!=(const CacheLineAllocator<U>&) const
+        {
+            return false;
+        }
+    };
+
+    /// \brief  A metric and its description
+    template<typename Metric>
+    struct Entry
+    {
+        /// \brief  Create a metric from its description
+        ///
+        /// \param info  The description of the metric
+        explicit Entry(Info info) :
+            info(std::move(info)),
+            metric()
+        { }
+
+        /// The description of the metric
+        Info info;
+        /// The metric
+        Metric metric;
+    };
+
+    /// \brief  The metrics of a type, a deque so they don't move as more
+    ///         are added
+    template<typename Metric>
+    using Entries = std::deque<Entry<Metric>, CacheLineAllocator<Entry<Metric>>>;
+
+    /// \brief  Find a metric by its name and labels or add it
+    ///
+    /// \param entries  The metrics of the type to find
+    /// \param name     The name of the metric
+    /// \param help     A description of the metric
+    /// \param labels   The labels of the metric
+    ///
+    /// \return  The metric that was found or added
+    template<typename Metric>
+    Metric& findOrAdd(Entries<Metric>& entries,
+                      const std::string& name,
+                      const std::string& help,
+                      const std::string& labels);
+
+    /// \brief  Add the metrics of this registry and its shards to another
+    ///
+    /// \param total  The registry to add to
+    void sumInto(Metrics& total) const;
+
+    /// Protects the lists of metrics and shards, but not the metrics
+    mutable std::mutex m_mutex;
+    /// The counters
+    Entries<Counter> m_counters;
+    /// The gauges
+    Entries<Gauge> m_gauges;
+    /// The histograms
+    Entries<Histogram> m_histograms;
+    /// The registries of the workers
+    std::vector<std::shared_ptr<Metrics>> m_shards;
+};
+
+}  // namespace dote
@@ -0,0 +1,116 @@
+
+#pragma once
+
+#include "i_loop.h"
+
+#include <sys/socket.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dote {
+
+class Metrics;
+class Socket;
+
+/// \brief  Serves the metrics in the Prometheus text format to anything
+///         that connects over HTTP, handling the clients on the loop
+///         without ever blocking it so that scraping doesn't hold up the
+///         requests
+class MetricsServer
+{
+  public:
+    /// \brief  Create a server that isn't listening yet
+    ///
+    /// \param loop     The loop to handle the clients on
+    /// \param metrics  The registry to serve
+    MetricsServer(std::shared_ptr<ILoop> loop,
+                  std::shared_ptr<Metrics> metrics);
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    /// \brief  Close the clients and stop listening, removing the Unix
+    ///         socket if listening on one
+    ~MetricsServer();
+
+    /// \brief  Start listening for clients
+    ///
+    /// \param address  An IP and port, or a Unix socket path
+    ///
+    /// \return  True if listening on the address
+    bool listen(const sockaddr_storage& address);
+
+    /// \brief  Format the metrics in the Prometheus text format
+    ///
+    /// \param metrics  The registry to format
+    ///
+    /// \return  The text to serve
+    static std::string format(const Metrics& metrics);
+
+  private:
+    /// \brief  A connected client
+    struct Client
+    {
+        /// The connection to the client
+        std::shared_ptr<Socket> socket;
+        /// The request read so far, then the response left to write
+        std::string buffer;
+        /// The read or write registration for the socket
+        ILoop::Registration registration;
+        /// The timer to close the client if it takes too long
+        ILoop::Registration timer;
+    };
+
+    /// \brief  Accept the clients that are waiting to connect
+    ///
+    /// \param handle  The listening socket
+    void handleAccept(int handle);
+
+    /// \brief  Read the request from a client and start writing the
+    ///         response once it has all arrived
+    ///
+    /// \param handle  The client socket
+    void handleRead(int handle);
+
+    /// \brief  Write as much of the response to a client as possible and
+    ///         close it once it has all been written
+    ///
+    /// \param handle  The client socket
+    void handleWrite(int handle);
+
+    /// \brief  Get the response to a request
+    ///
+    /// \param request  The request line and headers
+    ///
+    /// \return  The HTTP response
+    std::string respond(const std::string& request) const;
+
+    /// \brief  Get a client by its socket
+    ///
+    /// \param handle  The client socket
+    ///
+    /// \return  The client or m_clients.end() if it's not connected
+    std::vector<Client>::iterator find(int handle);
+
+    /// \brief  Close a client
+    ///
+    /// \param handle  The client socket
+    void close(int handle);
+
+    /// The loop to handle the clients on
+    std::shared_ptr<ILoop> m_loop;
+    /// The registry to serve
+    std::shared_ptr<Metrics> m_metrics;
+    /// The address being listened on
+    sockaddr_storage m_address;
+    /// The listening socket
+    std::shared_ptr<Socket> m_socket;
+    /// The read registration for the listening socket
+    ILoop::Registration m_accept;
+    /// The clients that are connected
+    std::vector<Client> m_clients;
+};
+
+}  // namespace dote
@@ -4,6 +4,8 @@
 #include <openssl/x509_vfy.h>
 
 #include <string>
+#include <deque>
+#include <unordered_map>
 #include <functional>
 
 typedef struct ssl_ctx_st SSL_CTX;
@@ -41,6 +43,10 @@ class Context
     /// \prarm verifier  The verifier to set
     void setChainVerifier(Verifier verifier);
 
+    /// \brief  Offload the record encryption of connections to the kernel
+    ///         once their handshake completes, where the kernel allows it
+    void enableKernelTls();
+
     /// \brief  Set the SSLConnection instance for the SSL object, this
     ///         causes the verify function to be fired
     ///
@@ -54,15 +60,25 @@ class Context
     /// \return  The raw context
     SSL_CTX* get();
 
-    /// \brief  Cache the session, overwriting any existing one
+    /// \brief  Cache a session for a server, only the most recent few
+    ///         are kept for each server
+    ///
+    /// \param server   The key of the server the session is for
+    /// \param session  The session to cache, ownership is taken
+    void cacheSession(const std::string& server, SSL_SESSION* session);
+
+    /// \brief  Get a session to resume a connection to a server with,
+    ///         TLS 1.3 tickets are removed so that each is used once
+    ///
+    /// \param server  The key of the server to get a session for
     ///
-    /// \param session  The session to cache
-    void cacheSession(SSL_SESSION* session);
+    /// \return  A session that must be freed by the caller or nullptr
+    SSL_SESSION* getSession(const std::string& server);
 
-    /// \brief  Get the cached session
+    /// \brief  Remove all of the cached sessions for a server
     ///
-    /// \return  The cached session or nullptr if none
-    SSL_SESSION* getSession();
+    /// \param server  The key of the server to remove the sessions of
+    void clearSessions(const std::string& server);
 
     /// Allow the connection access to the raw context
     friend class SslConnection;
@@ -92,10 +108,20 @@ class Context
     ///          0 if any of the checks fail
     static int chainVerifyTrampoline(X509_STORE_CTX* store, void* context);
 
+    /// \brief  A C-style trampoline to pass a new session, such as a
+    ///         TLS 1.3 ticket, to the connection that received it
+    ///
+    /// \param ssl      The connection the session was received on
+    /// \param session  The new session
+    ///
+    /// \return  1 if the session was kept, 0 otherwise
+    static int newSessionTrampoline(SSL* ssl, SSL_SESSION* session);
+
     /// The wrapped context
     SSL_CTX* m_context;
-    /// The client session that we could re-use
-    SSL_SESSION* m_session;
+    /// The client sessions that we could re-use for each server,
+    /// the most recent at the back
+    std::unordered_map<std::string, std::deque<SSL_SESSION*>> m_sessions;
     /// The chain verifier to use for the connection if not the default
     Verifier m_chainVerifier;
 };
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <sys/socket.h>
+
+#include <cstddef>
 #include <vector>
 #include <string>
 #include <functional>
@@ -41,6 +44,13 @@ class ISslConnection
     /// \param handle  The underlying socket to set on this connection
     virtual void setSocket(int handle) = 0;
 
+    /// \brief  Set the server that is being connected to, this must be
+    ///         called before connect to resume a previous session
+    ///
+    /// \param remote  The address of the server
+    /// \param host    The name of the server to send as SNI, may be empty
+    virtual void setServer(const sockaddr_storage& remote, const std::string& host) = 0;
+
     /// \brief  Disable certificate verification, should be used
     ///         for testing only, it kind of defeats the point
     virtual void disableVerification() = 0;
@@ -67,6 +77,38 @@ class ISslConnection
     /// \return  The status of the function
     virtual Result connect() = 0;
 
+    /// \brief  Get the most data that may be written before the handshake
+    ///         completes, only possible when resuming a TLS 1.3 session
+    ///
+    /// \return  The number of bytes, zero if early data can't be sent
+    virtual std::size_t maxEarlyData() = 0;
+
+    /// \brief  Write a buffer as early data, this starts the handshake
+    ///         but connect must still be called to complete it
+    ///
+    /// \param buffer  The buffer to write
+    ///
+    /// \return  The status of the function
+    virtual Result writeEarlyData(const std::vector<char>& buffer) = 0;
+
+    /// \brief  Whether the server accepted the early data written, only
+    ///         valid once connect has completed
+    ///
+    /// \return  True if the early data doesn't need writing again
+    virtual bool earlyDataAccepted() = 0;
+
+    /// \brief  Whether the kernel has taken over the record encryption for
+    ///         either direction of the connection after connect completed
+    ///
+    /// \return  True if kernel TLS is in use
+    virtual bool kernelTls() = 0;
+
+    /// \brief  Whether the handshake resumed a cached session rather than
+    ///         doing a full handshake, only valid once connect has completed
+    ///
+    /// \return  True if the session was resumed
+    virtual bool sessionResumed() = 0;
+
     /// \brief  Shutdown the underlying connection
     ///
     /// \return  The status of the function
@@ -79,12 +121,14 @@ class ISslConnection
     /// \return  The status of the function
     virtual Result write(const std::vector<char>& buffer) = 0;
 
-    /// \brief  Read from the socket
+    /// \brief  Read from the socket straight into a buffer
     ///
-    /// \param buffer  The buffer to read into, resized to fit the content
+    /// \param buffer      The space to read into
+    /// \param length      The most bytes to read, must not be zero
+    /// \param readLength  Set to the number of bytes read
     ///
     /// \return  The status of the function
-    virtual Result read(std::vector<char>& buffer) = 0;
+    virtual Result read(char* buffer, std::size_t length, std::size_t& readLength) = 0;
 };
 
 }  // namespace openssl
@@ -6,6 +6,7 @@
 #include <openssl/ssl.h>
 
 #include <memory>
+#include <string>
 #include <functional>
 
 namespace dote {
@@ -38,6 +39,13 @@ class SslConnection : public ISslConnection
     /// \param handle  The underlying socket to set on this connection
     void setSocket(int handle) override;
 
+    /// \brief  Set the server that is being connected to, this must be
+    ///         called before connect to resume a previous session
+    ///
+    /// \param remote  The address of the server
+    /// \param host    The name of the server to send as SNI, may be empty
+    void setServer(const sockaddr_storage& remote, const std::string& host) override;
+
     /// \brief  Get the SHA-256 hash of the public key of the attached
     ///         peer certificate after connect has completed
     ///
@@ -54,6 +62,38 @@ class SslConnection : public ISslConnection
     /// \return  The status of the function
     Result connect() override;
 
+    /// \brief  Get the most data that may be written before the handshake
+    ///         completes, only possible when resuming a TLS 1.3 session
+    ///
+    /// \return  The number of bytes, zero if early data can't be sent
+    std::size_t maxEarlyData() override;
+
+    /// \brief  Write a buffer as early data, this starts the handshake
+    ///         but connect must still be called to complete it
+    ///
+    /// \param buffer  The buffer to write
+    ///
+    /// \return  The status of the function
+    Result writeEarlyData(const std::vector<char>& buffer) override;
+
+    /// \brief  Whether the server accepted the early data written, only
+    ///         valid once connect has completed
+    ///
+    /// \return  True if the early data doesn't need writing again
+    bool earlyDataAccepted() override;
+
+    /// \brief  Whether the kernel has taken over the record encryption for
+    ///         either direction of the connection after connect completed
+    ///
+    /// \return  True if kernel TLS is in use
+    bool kernelTls() override;
+
+    /// \brief  Whether the handshake resumed a cached session rather than
+    ///         doing a full handshake, only valid once connect has completed
+    ///
+    /// \return  True if the session was resumed
+    bool sessionResumed() override;
+
     /// \brief  Shutdown the underlying connection
     ///
     /// \return  The status of the function
@@ -66,12 +106,14 @@ class SslConnection : public ISslConnection
     /// \return  The status of the function
     Result write(const std::vector<char>& buffer) override;
 
-    /// \brief  Read from the socket
+    /// \brief  Read from the socket straight into a buffer
     ///
-    /// \param buffer  The buffer to read into, resized to fit the content
+    /// \param buffer      The space to read into
+    /// \param length      The most bytes to read, must not be zero
+    /// \param readLength  Set to the number of bytes read
     ///
     /// \return  The status of the function
-    Result read(std::vector<char>& buffer) override;
+    Result read(char* buffer, std::size_t length, std::size_t& readLength) override;
 
     /// \brief  Set the verifier for the connections, by default
     ///         connections are verified by PKI, this allows SPKI
@@ -86,10 +128,15 @@ class SslConnection : public ISslConnection
     /// \return  2 if pin and hostname pass, 1 if hostname only, 0 if not valid
     int verify(X509_STORE_CTX* store);
 
-  private:
-    /// The maximum size of the read
-    static constexpr std::size_t MAX_FRAME = 16 * 1024;
+    /// \brief  Cache a new session received from the server so that
+    ///         later connections to it can be resumed
+    ///
+    /// \param session  The session that was received
+    ///
+    /// \return  True if the session was kept, false if not
+    bool newSession(SSL_SESSION* session);
 
+  private:
     /// \brief  Perform a function on the underlying SSL handling the
     ///         non-blocking errors
     ///
@@ -104,6 +151,8 @@ class SslConnection : public ISslConnection
     SSL* m_ssl;
     /// The verifier to use for the connection if not the default
     Verifier m_verifier;
+    /// The key of the server to cache sessions against, empty if unknown
+    std::string m_server;
 };
 
 }  // namespace openssl
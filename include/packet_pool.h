@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace dote {
+
+/// \brief  A store of packet buffers that have been finished with so that
+///         their memory can be used for the next packet rather than being
+///         allocated for every one.  A pool must only be used from a single
+///         thread.
+class PacketPool
+{
+  public:
+    /// The capacity of a new buffer, enough for a UDP packet with the TCP
+    /// length in front of it
+    static constexpr std::size_t BUFFER_SIZE = 4096u;
+
+    /// The default number of buffers to keep for re-use
+    static constexpr std::size_t DEFAULT_MAX_BUFFERS = 256u;
+
+    /// \brief  Create an empty pool
+    ///
+    /// \param maxBuffers  The most buffers to keep for re-use
+    explicit PacketPool(std::size_t maxBuffers = DEFAULT_MAX_BUFFERS);
+
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    /// \brief  Get an empty buffer to fill with a packet
+    ///
+    /// \return  An empty buffer with at least BUFFER_SIZE capacity
+    std::vector<char> acquire();
+
+    /// \brief  Return a buffer that is no longer needed to the pool
+    ///
+    /// \param buffer  The buffer to re-use
+    void release(std::vector<char> buffer);
+
+    /// \brief  Get the number of buffers waiting to be re-used
+    ///
+    /// \return  The number of buffers in the pool
+    std::size_t size() const;
+
+  private:
+    /// The most buffers to keep for re-use
+    std::size_t m_maxBuffers;
+    /// The buffers that can be re-used
+    std::vector<std::vector<char>> m_buffers;
+};
+
+}  // namespace dote
@@ -3,6 +3,7 @@
 
 #include "config_parser.h"
 #include "i_loop.h"
+#include "metrics.h"
 
 #include <vector>
 #include <memory>
@@ -11,6 +12,7 @@ namespace dote {
 
 class Socket;
 class IForwarders;
+class PacketPool;
 
 /// \brief  The UDP server to recieve connections on
 class Server
@@ -20,8 +22,10 @@ class Server
     ///
     /// \param loop        The looper to use to read
     /// \param forwarders  The forwarder storage
+    /// \param metrics     The registry to count the requests received in
     Server(std::shared_ptr<ILoop> loop,
-           std::shared_ptr<IForwarders> forwarders);
+           std::shared_ptr<IForwarders> forwarders,
+           std::shared_ptr<Metrics> metrics);
 
     Server(const Server&) = delete;
     Server& operator=(const Server&) = delete;
@@ -29,6 +33,19 @@ class Server
     /// \brief  Remove the server sockets from the loop
     ~Server();
 
+    /// \brief  Set whether the ports of servers added after this may be
+    ///         shared with other sockets, so that several workers can
+    ///         listen on the same address
+    ///
+    /// \param reusePort  True to share the ports
+    void setReusePort(bool reusePort);
+
+    /// \brief  Set the pool to take the buffers to receive requests into
+    ///         from, these are passed on with the requests
+    ///
+    /// \param pool  The pool of packet buffers
+    void setPacketPool(std::shared_ptr<PacketPool> pool);
+
     /// \brief  Add a server interface
     ///
     /// \param config  The configuration to add
@@ -37,7 +54,8 @@ class Server
     bool addServer(const ConfigParser::Server& config);
 
   private:
-    /// \brief  Handle an incoming packet on the server
+    /// \brief  Handle the incoming packets on the server, all of the
+    ///         packets waiting up to a limit are read at once
     ///
     /// \param handle  The handle that the read event is on
     void handleDnsRequest(int handle);
@@ -49,6 +67,23 @@ class Server
     using SocketAndRegistration = std::pair<std::shared_ptr<Socket>, ILoop::Registration>;
     /// The sockets that we are recieving from and their read registrations.
     std::vector<SocketAndRegistration> m_serverSockets;
+    /// Whether to allow the server ports to be shared
+    bool m_reusePort;
+    /// The pool to take the buffers to receive requests into from
+    std::shared_ptr<PacketPool> m_pool;
+    /// The buffers to receive a batch of requests into, each leaves space
+    /// for the TCP length in front of the request
+    std::vector<std::vector<char>> m_packets;
+    /// The space to receive the control data of a batch of requests into
+    std::vector<char> m_control;
+    /// The registry of metrics to count the requests in
+    std::shared_ptr<Metrics> m_metrics;
+    /// The number of requests received
+    Metrics::Counter* m_requests;
+    /// The number of requests dropped as they were too big
+    Metrics::Counter* m_tooBig;
+    /// The times taken to receive and pass on each batch of requests
+    Metrics::Histogram* m_batchTimes;
 };
 
 }  // namespace dote
@@ -42,6 +42,19 @@ class Socket
     static std::shared_ptr<Socket> connect(const sockaddr_storage& address,
                                            Type type);
 
+    /// \brief  Construct a new non-blocking socket and connect it to the IP
+    ///         optionally using TCP Fast Open so that the first data written
+    ///         is sent along with the SYN when the server has given a cookie
+    ///
+    /// \param address   The address to connect to
+    /// \param type      The type of socket to create
+    /// \param fastOpen  True to connect using TCP Fast Open if available
+    ///
+    /// \return  The newly created and connected socket or nullptr
+    static std::shared_ptr<Socket> connect(const sockaddr_storage& address,
+                                           Type type,
+                                           bool fastOpen);
+
     /// \brief  Context a new non-blocking socket and bind it to the IP
     ///
     /// \param address  The bind to connect to
@@ -51,6 +64,28 @@ class Socket
     static std::shared_ptr<Socket> bind(const sockaddr_storage& address,
                                         Type type);
 
+    /// \brief  Create a new non-blocking socket and bind it to the IP
+    ///         allowing other sockets to bind to the same port so that
+    ///         the kernel shares the incoming packets between them
+    ///
+    /// \param address    The bind to connect to
+    /// \param type       The type of socket to create
+    /// \param reusePort  True to allow the port to be shared
+    ///
+    /// \return  The newly created and bound socket or nullptr
+    static std::shared_ptr<Socket> bind(const sockaddr_storage& address,
+                                        Type type,
+                                        bool reusePort);
+
+    /// \brief  Create a new non-blocking TCP or Unix stream socket bound
+    ///         to an address and listening for connections, any stale
+    ///         Unix socket at the path is replaced
+    ///
+    /// \param address  The address to listen on
+    ///
+    /// \return  The newly created listening socket or nullptr
+    static std::shared_ptr<Socket> listen(const sockaddr_storage& address);
+
     Socket(const Socket&) = delete;
     Socket& operator=(const Socket&) = delete;
 
@@ -76,6 +111,12 @@ class Socket
     /// \return  True if the socket was bound, false if not
     bool bind(const sockaddr* address, size_t addressLength);
 
+    /// \brief  Accept a connection waiting on a listening socket
+    ///
+    /// \return  The non-blocking connected socket or nullptr if there
+    ///          are no connections waiting
+    std::shared_ptr<Socket> accept();
+
     /// \brief  Get the underlying raw handle
     ///
     /// \return  The raw handle or -1 if invalid
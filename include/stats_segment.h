@@ -0,0 +1,203 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dote {
+
+class Metrics;
+
+/// \brief  The start of the shared memory statistics segment, which is
+///         followed by the entries
+struct StatsHeader
+{
+    /// The value of magic for a statistics segment
+    static constexpr std::uint32_t MAGIC = 0x45544f44u;
+
+    /// The version of the layout, changed whenever the layout is
+    static constexpr std::uint32_t VERSION = 1u;
+
+    /// Always MAGIC
+    std::uint32_t magic;
+    /// The version of the layout that the segment was written with
+    std::uint32_t version;
+    /// Odd while the segment is being written, and changed by every write
+    /// so that a reader can tell whether what it read was torn
+    std::atomic<std::uint64_t> sequence;
+    /// The bytes in use from the start of the header
+    std::uint64_t size;
+    /// The milliseconds since the epoch that the segment was written at
+    std::uint64_t updated;
+    /// The number of entries following the header
+    std::uint32_t entries;
+    /// Unused, keeps the entries aligned
+    std::uint32_t reserved;
+};
+
+/// \brief  A metric in the shared memory statistics segment, which is
+///         followed by its values
+struct StatsEntry
+{
+    /// The types of metric
+    enum Type : std::uint32_t
+    {
+        /// A single count
+        COUNTER,
+        /// A single signed value
+        GAUGE,
+        /// The sum of the times, followed by the count in each bucket
+        HISTOGRAM
+    };
+
+    /// The space for the name, which is always terminated
+    static constexpr std::size_t NAME_SIZE = 64u;
+
+    /// The space for the labels, which is always terminated
+    static constexpr std::size_t LABELS_SIZE = 128u;
+
+    /// The type of the metric
+    Type type;
+    /// The number of values that follow
+    std::uint32_t values;
+    /// The name of the metric
+    char name[NAME_SIZE];
+    /// The labels of the metric, may be empty
+    char labels[LABELS_SIZE];
+};
+
+/// \brief  Publishes the metrics into a shared memory segment from a
+///         thread of its own, so that they may be polled by another
+///         process without the workers' loops being involved
+class StatsSegment
+{
+  public:
+    /// \brief  Create a segment that isn't published yet
+    ///
+    /// \param metrics  The registry to publish
+    explicit StatsSegment(std::shared_ptr<Metrics> metrics);
+
+    StatsSegment(const StatsSegment&) = delete;
+    StatsSegment& operator=(const StatsSegment&) = delete;
+
+    /// \brief  Stop publishing and remove the segment
+    ~StatsSegment();
+
+    /// \brief  Create the shared memory segment
+    ///
+    /// \param name  The name of the segment, starting with a /
+    ///
+    /// \return  True if the segment was created
+    bool open(const std::string& name);
+
+    /// \brief  Write the current value of the metrics into the segment
+    void publish();
+
+    /// \brief  Start publishing the metrics every interval
+    ///
+    /// \param interval  The time between each publish
+    void start(std::chrono::milliseconds interval);
+
+    /// \brief  Stop publishing the metrics, publishing them a last time
+    void stop();
+
+  private:
+    /// \brief  Make sure the segment is mapped with at least a given size
+    ///
+    /// \param size  The number of bytes needed
+    ///
+    /// \return  True if the segment is large enough
+    bool reserve(std::size_t size);
+
+    /// \brief  Publish every interval until stopped
+    ///
+    /// \param interval  The time between each publish
+    void run(std::chrono::milliseconds interval);
+
+    /// The registry to publish
+    std::shared_ptr<Metrics> m_metrics;
+    /// The name of the segment, empty if it isn't open
+    std::string m_name;
+    /// The handle of the segment, -1 if it isn't open
+    int m_handle;
+    /// The mapping of the segment
+    char* m_data;
+    /// The size of m_data
+    std::size_t m_size;
+    /// The contents to copy into the segment, kept to avoid allocating
+    std::vector<char> m_buffer;
+    /// The thread to publish on
+    std::thread m_thread;
+    /// Protects m_stopping
+    std::mutex m_mutex;
+    /// Signalled when m_stopping is set
+    std::condition_variable m_condition;
+    /// Set to stop m_thread
+    bool m_stopping;
+};
+
+/// \brief  Reads the metrics from a shared memory statistics segment
+class StatsReader
+{
+  public:
+    /// \brief  A metric that was read
+    struct Metric
+    {
+        /// The type of the metric
+        StatsEntry::Type type;
+        /// The name of the metric
+        std::string name;
+        /// The labels of the metric
+        std::string labels;
+        /// The values of the metric, see StatsEntry::Type
+        std::vector<std::uint64_t> values;
+    };
+
+    /// \brief  Create a reader that isn't open yet
+    StatsReader();
+
+    StatsReader(const StatsReader&) = delete;
+    StatsReader& operator=(const StatsReader&) = delete;
+
+    /// \brief  Unmap the segment
+    ~StatsReader();
+
+    /// \brief  Open a segment to read
+    ///
+    /// \param name  The name of the segment
+    ///
+    /// \return  True if the segment was opened and is a version that can
+    ///          be read
+    bool open(const std::string& name);
+
+    /// \brief  Read a consistent copy of the metrics
+    ///
+    /// \param metrics  Filled with the metrics
+    /// \param updated  Set to the milliseconds since the epoch that the
+    ///                 metrics were published at
+    ///
+    /// \return  True if the metrics were read
+    bool read(std::vector<Metric>& metrics, std::uint64_t& updated);
+
+  private:
+    /// \brief  Map the whole of the segment
+    ///
+    /// \return  True if the segment is mapped
+    bool map();
+
+    /// The handle of the segment, -1 if it isn't open
+    int m_handle;
+    /// The mapping of the segment
+    char* m_data;
+    /// The size of m_data
+    std::size_t m_size;
+};
+
+}  // namespace dote
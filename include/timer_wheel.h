@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+
+namespace dote {
+
+/// \brief  A hierarchical timer wheel with millisecond resolution based on
+///         the monotonic clock.  Adding and removing a timer are constant
+///         time and timers are only moved between the levels of the wheel
+///         as their expiry gets closer.
+class TimerWheel
+{
+  public:
+    /// The type to call when a timer expires, called with the identifier
+    /// of the timer that expired
+    using Callback = std::function<void(int)>;
+
+    /// \brief  Create an empty wheel starting from now
+    TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /// \brief  Add a single shot timer
+    ///
+    /// \param delay     The time from now to call the callback
+    /// \param callback  The callback to call once the delay has passed
+    ///
+    /// \return  The identifier of the timer, which is reserved until it is
+    ///          removed, even once it has expired
+    int add(std::chrono::milliseconds delay, Callback callback);
+
+    /// \brief  Add a callback to be called the next time the wheel is
+    ///         expired, after any timers that have expired
+    ///
+    /// \param callback  The callback to call
+    ///
+    /// \return  The identifier of the callback, which is reserved until it
+    ///          is removed in the same way as a timer
+    int defer(Callback callback);
+
+    /// \brief  Cancel a timer if it hasn't expired and release its identifier
+    ///
+    /// \param id  The identifier of the timer to remove
+    void remove(int id);
+
+    /// \brief  Check whether there are timers that have not yet expired
+    ///
+    /// \return  True if any timer has still to expire
+    bool pending() const;
+
+    /// \brief  Call the callbacks of all the timers that have expired
+    ///         followed by the deferred callbacks
+    void expire();
+
+    /// \brief  Get the time until the wheel next needs to be expired
+    ///
+    /// \return  The number of milliseconds to wait, zero if there are
+    ///          deferred callbacks or -1 if no timers are pending
+    int timeout() const;
+
+  private:
+    /// The number of bits of the expiry each level of the wheel covers
+    static constexpr unsigned int LEVEL_BITS = 6u;
+    /// The number of slots in each level of the wheel
+    static constexpr unsigned int SLOTS = 1u << LEVEL_BITS;
+    /// The number of levels in the wheel
+    static constexpr unsigned int LEVELS = 4u;
+
+    /// The type of a slot in the wheel, holding timer identifiers
+    using Slot = std::list<int>;
+
+    /// \brief  A timer that has been added to the wheel
+    struct Timer
+    {
+        /// The callback to call on expiry, empty once it has been called
+        Callback callback;
+        /// The tick at which the timer expires
+        uint64_t expiry;
+        /// The slot that the timer is in, nullptr once it has expired or
+        /// if it is deferred
+        Slot* slot;
+        /// The position of the timer in its slot
+        Slot::iterator position;
+    };
+
+    /// \brief  Get the current tick from the monotonic clock
+    ///
+    /// \return  The number of milliseconds since the wheel was created
+    uint64_t now() const;
+
+    /// \brief  Reserve an identifier for a new timer
+    ///
+    /// \param callback  The callback for the timer
+    ///
+    /// \return  The identifier of the timer
+    int allocate(Callback callback);
+
+    /// \brief  Call the deferred callbacks, including any deferred by them
+    void runDeferred();
+
+    /// \brief  Put a timer into the slot for its expiry
+    ///
+    /// \param id     The identifier of the timer
+    /// \param timer  The timer to put into the wheel
+    void place(int id, Timer& timer);
+
+    /// \brief  Move the timers in the current slot of a level down the wheel
+    ///
+    /// \param level  The level to move the timers out of
+    void cascade(unsigned int level);
+
+    /// \brief  Call the callbacks for the timers in the current slot
+    void fire();
+
+    /// The time that the wheel was created
+    std::chrono::steady_clock::time_point m_start;
+    /// The last tick that has been processed
+    uint64_t m_current;
+    /// The identifier to try to give the next timer
+    int m_nextId;
+    /// The number of timers which have not expired
+    std::size_t m_pending;
+    /// The timers by identifier
+    std::unordered_map<int, Timer> m_timers;
+    /// The slots of the wheel for each level
+    Slot m_slots[LEVELS][SLOTS];
+    /// The identifiers of the deferred callbacks waiting to be called
+    std::deque<int> m_deferred;
+};
+
+}  // namespace dote
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "i_loop.h"
+#include "verify_cache.h"
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dote {
+
+class Server;
+class ConfigParser;
+class ForwarderConfig;
+class ClientForwarders;
+class HealthChecker;
+class PacketPool;
+class Metrics;
+class MetricsServer;
+
+namespace openssl {
+class Context;
+}  // namespace openssl
+
+/// \brief  A single event loop with its own connections to the forwarders
+///         and server sockets, each worker runs on its own thread
+class Worker
+{
+  public:
+    /// The number of seconds to cache the cerificates for
+    static constexpr int CACHE_SECONDS = 30;
+
+    /// \brief  Create a worker from a given config
+    ///
+    /// \param config   The configuration to use
+    /// \param metrics  The registry to record the requests in, a shard of
+    ///                 its own so the workers don't contend on it
+    Worker(const ConfigParser& config, std::shared_ptr<Metrics> metrics);
+
+    Worker(const Worker&) = delete;
+    Worker& operator=(const Worker&) = delete;
+
+    /// \brief  Shut down the worker
+    ~Worker();
+
+    /// \brief  Start listening on the server ports
+    ///
+    /// \param config     The configuration with the bind ports
+    /// \param reusePort  True if other workers will bind to the same ports
+    ///
+    /// \return  True if all the ports were bound
+    bool listen(const ConfigParser& config, bool reusePort);
+
+    /// \brief  Serve the metrics of all the workers from this worker's
+    ///         loop until it is shut down
+    ///
+    /// \param address  The address to serve the metrics on
+    /// \param metrics  The registry that the workers' shards are in
+    ///
+    /// \return  True if listening on the address
+    bool serveMetrics(const sockaddr_storage& address,
+                      std::shared_ptr<Metrics> metrics);
+
+    /// \brief  Replace the forwarders to send requests to, this may be
+    ///         called from any thread and takes effect on the worker's
+    ///         own thread
+    ///
+    /// \param config  The configuration of the forwarders to load
+    void setForwarders(const ConfigParser& config);
+
+    /// \brief  Run the event loop until the worker is shut down and
+    ///         the requests in progress have completed
+    void run();
+
+    /// \brief  Stop listening for requests, this is safe to call from
+    ///         any thread or a signal handler
+    void shutdown();
+
+    /// \brief  Get the looper instance
+    ///
+    /// \return  The looper instance
+    std::shared_ptr<ILoop> looper();
+
+  private:
+    /// \brief  Apply a forwarder configuration on the worker's thread
+    ///
+    /// \param config  The configuration of the forwarders to load
+    void applyForwarders(const ConfigParser& config);
+
+    /// \brief  Handle a wake up from another thread
+    ///
+    /// \param handle  The read end of the wake pipe
+    void wake(int handle);
+
+    /// The looper that is used for the worker
+    std::shared_ptr<ILoop> m_loop;
+    /// The registry of metrics for this worker
+    std::shared_ptr<Metrics> m_metrics;
+    /// The packet buffers shared by the server and forwarders
+    std::shared_ptr<PacketPool> m_packetPool;
+    /// The available forwarders
+    std::shared_ptr<ForwarderConfig> m_config;
+    /// The OpenSSL context to use
+    std::shared_ptr<openssl::Context> m_context;
+    /// The current open forwarders
+    std::shared_ptr<ClientForwarders> m_forwarders;
+    /// The prober of the forwarders that are marked down, nullptr if
+    /// forwarders are never marked down
+    std::shared_ptr<HealthChecker> m_health;
+    /// The listening servers
+    std::shared_ptr<Server> m_server;
+    /// The server of the metrics, nullptr unless this worker serves them
+    std::shared_ptr<MetricsServer> m_metricsServer;
+    /// The certificate verification cache for m_context
+    VerifyCache m_cache;
+    /// The read and write ends of the pipe used to wake the loop
+    int m_wakePipe[2];
+    /// The read registration for the wake pipe
+    ILoop::Registration m_wake;
+    /// Set when the worker should stop listening
+    std::atomic<bool> m_stopping;
+    /// Protects m_tasks
+    std::mutex m_mutex;
+    /// The calls from other threads waiting to be run on this one
+    std::vector<std::function<void()>> m_tasks;
+};
+
+}  // namespace dote
@@ -6,20 +6,35 @@
 #include "log.h"
 #include "socket.h"
 #include "dns_packet.h"
+#include "dns_cache.h"
+#include "packet_pool.h"
 
 #ifdef __APPLE__
 #define __APPLE_USE_RFC_3542
 #endif
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <functional>
 #include <cstring>
+#include <iterator>
+#include <limits>
 #include <netinet/in.h>
 
 namespace dote {
 
 namespace {
 
+/// The number of recent response times to choose the hedge delay from
+constexpr std::size_t RESPONSE_SAMPLES = 64u;
+
+/// The number of responses between updates of the hedge delay
+constexpr std::size_t HEDGE_UPDATE_INTERVAL = 16u;
+
+/// The time to wait before replacing warm connections that have closed,
+/// so a forwarder that is down isn't connected to continuously
+constexpr std::chrono::milliseconds WARM_INTERVAL(1000);
+
 /// \brief  Add the source address to the outgoing message
 ///
 /// \param message  The outgoing message to add the address to
@@ -90,15 +105,189 @@ using namespace std::placeholders;
 ClientForwarders::ClientForwarders(std::shared_ptr<ILoop> loop,
                                    std::shared_ptr<IForwarderConfig> config,
                                    std::shared_ptr<openssl::ISslFactory> ssl,
-                                   std::size_t maxConnections) :
+                                   std::size_t maxConnections,
+                                   std::shared_ptr<Metrics> metrics) :
     m_loop(std::move(loop)),
     m_config(std::move(config)),
     m_ssl(std::move(ssl)),
-    m_maxConnections(maxConnections)
+    m_maxConnections(maxConnections),
+    m_poolSize(0u),
+    m_pipelineDepth(1u),
+    m_retries(0u),
+    m_warmConnections(0u),
+    m_nextId(0u),
+    m_queueSize(std::numeric_limits<std::size_t>::max()),
+    m_queueDeadline(0),
+    m_packetPool(std::make_shared<PacketPool>()),
+    m_hedgeDelay(0),
+    m_hedgeAfter(0),
+    m_responseTimes(),
+    m_responseCount(0u),
+    m_metrics(std::move(metrics)),
+    m_hedgesSent(&m_metrics->counter(
+        "dote_hedges_total",
+        "Requests also sent to a second forwarder as the first was slow"
+    )),
+    m_hedgesWon(&m_metrics->counter(
+        "dote_hedges_won_total",
+        "Hedged requests that the second forwarder answered first"
+    )),
+    m_retriesSent(&m_metrics->counter(
+        "dote_retries_total",
+        "Requests sent again after their connection failed"
+    )),
+    m_requestsLost(&m_metrics->counter(
+        "dote_requests_lost_total",
+        "Requests lost with their connection that weren't sent again"
+    )),
+    m_cacheHits(&m_metrics->counter(
+        "dote_cache_hits_total", "Requests answered from the cache"
+    )),
+    m_requestsFailed(&m_metrics->counter(
+        "dote_requests_failed_total",
+        "Requests answered with a server failure as they couldn't be sent"
+    )),
+    m_queueLength(&m_metrics->gauge(
+        "dote_queue_length", "Requests waiting for a connection"
+    )),
+    m_reportedQueueLength(0u),
+    m_queueTimes(&m_metrics->histogram(
+        "dote_queue_wait_microseconds",
+        "Time that requests waited for a connection"
+    )),
+    m_openConnections(&m_metrics->gauge(
+        "dote_forwarder_connections", "Connections open to forwarders"
+    )),
+    m_responsesSent(&m_metrics->counter(
+        "dote_responses_total", "Responses sent to clients"
+    )),
+    m_sendErrors(&m_metrics->counter(
+        "dote_response_errors_total", "Responses that couldn't be sent"
+    )),
+    m_requestTimes(&m_metrics->histogram(
+        "dote_request_microseconds",
+        "Time from a request arriving to its response being sent"
+    ))
 { }
 
 ClientForwarders::~ClientForwarders() noexcept
-{ }
+{
+    // Don't get called back while the connections are destroyed
+    for (auto& connection : m_forwarders)
+    {
+        connection->setShutdownCallback(nullptr);
+    }
+}
+
+void ClientForwarders::setPoolSize(std::size_t poolSize)
+{
+    m_poolSize = poolSize;
+}
+
+void ClientForwarders::setPipelineDepth(std::size_t depth)
+{
+    m_pipelineDepth = depth;
+}
+
+void ClientForwarders::setCache(std::shared_ptr<DnsCache> cache)
+{
+    m_cache = std::move(cache);
+}
+
+void ClientForwarders::setHedgeDelay(std::chrono::milliseconds delay)
+{
+    m_hedgeDelay = delay;
+    m_hedgeAfter = std::max(m_hedgeAfter, delay);
+}
+
+void ClientForwarders::setPacketPool(std::shared_ptr<PacketPool> pool)
+{
+    m_packetPool = std::move(pool);
+}
+
+void ClientForwarders::setQueueLimits(std::size_t size,
+                                      std::chrono::milliseconds deadline)
+{
+    m_queueSize = size;
+    m_queueDeadline = deadline;
+}
+
+void ClientForwarders::setRetries(unsigned int retries)
+{
+    m_retries = retries;
+}
+
+void ClientForwarders::setWarmConnections(std::size_t count)
+{
+    m_warmConnections = count;
+    if (m_warmConnections == 0u)
+    {
+        m_warmTimer.reset();
+    }
+}
+
+void ClientForwarders::warm()
+{
+    m_warmTimer.reset();
+    if (m_warmConnections == 0u)
+    {
+        return;
+    }
+
+    // Take a copy as a failed connection re-orders the forwarders
+    std::vector<ConfigParser::Forwarder> forwarders(
+        m_config->begin(), m_config->end()
+    );
+    for (const auto& forwarder : forwarders)
+    {
+        // Leave forwarders that are down to be probed
+        if (!m_config->healthy(forwarder))
+        {
+            continue;
+        }
+        std::size_t open = openConnections(forwarder);
+        while (open < m_warmConnections &&
+                m_forwarders.size() < m_maxConnections)
+        {
+            if (!addConnection(std::make_shared<ForwarderConnection>(
+                    m_loop, m_config, m_ssl, m_packetPool, forwarder
+                )))
+            {
+                // Try again later rather than give up on the forwarder
+                Log::info << "Unable to open a warm connection to forwarder";
+                if (!m_warmTimer)
+                {
+                    m_warmTimer = m_loop->registerTimer(
+                        WARM_INTERVAL,
+                        std::bind(&ClientForwarders::rewarm, this, _1)
+                    );
+                }
+                break;
+            }
+            ++open;
+        }
+    }
+}
+
+void ClientForwarders::rewarm(int)
+{
+    warm();
+}
+
+std::size_t ClientForwarders::hedgesSent() const
+{
+    return m_hedgesSent->value();
+}
+
+std::size_t ClientForwarders::hedgesWon() const
+{
+    return m_hedgesWon->value();
+}
+
+std::size_t ClientForwarders::retriesSent() const
+{
+    return m_retriesSent->value();
+}
 
 void ClientForwarders::handleRequest(std::shared_ptr<Socket> socket,
                                      const sockaddr_storage& client,
@@ -106,102 +295,769 @@ void ClientForwarders::handleRequest(std::shared_ptr<Socket> socket,
                                      int interface,
                                      std::vector<char> request)
 {
-    if (m_forwarders.size() < m_maxConnections)
+    DnsPacket packet(std::move(request));
+    // The key is only needed to look in the cache or to share the response
+    // of a request in progress, so don't parse the request for it otherwise
+    std::string key;
+    if (m_cache || !m_active.empty())
     {
-        sendRequest(
-            std::move(socket), client, server, interface, std::move(request)
-        );
+        key = DnsCache::key(packet);
+        keyActive();
     }
     else
     {
-        Log::debug << "Queuing request, queue length is " << m_queue.size();
-        m_queue.emplace_back(QueuedQuery {
-            std::move(socket), client, server, interface, std::move(request)
-        });
+        m_unkeyed.clear();
+    }
+    if (m_cache && !key.empty())
+    {
+        std::vector<char> response(m_packetPool->acquire());
+        if (m_cache->lookup(key, packet, response))
+        {
+            m_packetPool->release(packet.move());
+            m_cacheHits->add();
+            handleIncoming(
+                socket, client, server, interface, std::move(response),
+                std::chrono::steady_clock::now()
+            );
+            return;
+        }
+        m_packetPool->release(std::move(response));
+    }
+
+    QueuedQuery query {
+        std::move(socket), client, server, interface, packet.move(),
+        std::move(key), std::chrono::steady_clock::now(), 0u,
+        sockaddr_storage()
+    };
+    if (attachWaiter(query))
+    {
+        return;
+    }
+    auto connection = acquireConnection();
+    if (connection)
+    {
+        sendRequest(connection, std::move(query));
+    }
+    else
+    {
+        enqueue(std::move(query));
     }
 }
 
-void ClientForwarders::sendRequest(std::shared_ptr<Socket> socket,
-                                   const sockaddr_storage& client,
-                                   const sockaddr_storage& server,
-                                   int interface,
-                                   std::vector<char> request)
+void ClientForwarders::handleRequests(std::shared_ptr<Socket> socket,
+                                      std::vector<Request> requests)
 {
-    auto connection = std::make_shared<ForwarderConnection>(
-        m_loop, m_config, m_ssl
-    );
-    // Send the request
-    if (connection->send(std::move(request)))
-    {
-        // On data, handle
-        sockaddr_storage clientCopy = client;
-        sockaddr_storage serverCopy = server;
-        connection->setIncomingCallback(
-            [this, socket, clientCopy, serverCopy, interface](
-                    ForwarderConnection& connection,
-                    std::vector<char> buffer)
+    for (auto& request : requests)
+    {
+        handleRequest(
+            socket,
+            request.client,
+            request.server,
+            request.interface,
+            std::move(request.request)
+        );
+    }
+}
+
+std::shared_ptr<ForwarderConnection> ClientForwarders::acquireConnection()
+{
+    // Every ID is in use, so wait for some responses
+    if (m_active.size() > std::numeric_limits<unsigned short>::max())
+    {
+        return nullptr;
+    }
+
+    // Prefer a connection to the current forwarder, but any connection
+    // with room is better than waiting for a new one
+    std::shared_ptr<ForwarderConnection> idle;
+    std::vector<ConfigParser::Forwarder>::const_iterator preferred;
+    for (const auto& connection : m_forwarders)
+    {
+        if (connection->closed() ||
+                connection->outstanding() >= m_pipelineDepth)
+        {
+            continue;
+        }
+        if (!idle)
+        {
+            idle = connection;
+            preferred = m_config->get();
+            if (preferred == m_config->end())
             {
-                handleIncoming(
-                    socket, clientCopy, serverCopy, interface, std::move(buffer)
-                );
-                // Shutdown after result
-                connection.shutdown();
+                break;
             }
+        }
+        if (memcmp(&preferred->remote,
+                   &connection->forwarder().remote,
+                   sizeof(preferred->remote)) == 0)
+        {
+            return connection;
+        }
+    }
+
+    if (!idle && m_forwarders.size() < m_maxConnections)
+    {
+        idle = addConnection(std::make_shared<ForwarderConnection>(
+            m_loop, m_config, m_ssl, m_packetPool
+        ));
+    }
+    return idle;
+}
+
+std::shared_ptr<ForwarderConnection> ClientForwarders::acquireAlternative(
+        const ConfigParser::Forwarder& exclude)
+{
+    if (m_active.size() > std::numeric_limits<unsigned short>::max())
+    {
+        return nullptr;
+    }
+
+    auto alternative = m_config->getAlternative(exclude);
+    if (alternative == m_config->end())
+    {
+        return nullptr;
+    }
+    for (const auto& connection : m_forwarders)
+    {
+        if (!connection->closed() &&
+                connection->outstanding() < m_pipelineDepth &&
+                memcmp(&alternative->remote,
+                       &connection->forwarder().remote,
+                       sizeof(alternative->remote)) == 0)
+        {
+            return connection;
+        }
+    }
+
+    if (m_forwarders.size() < m_maxConnections)
+    {
+        return addConnection(std::make_shared<ForwarderConnection>(
+            m_loop, m_config, m_ssl, m_packetPool, *alternative
+        ));
+    }
+    return nullptr;
+}
+
+std::shared_ptr<ForwarderConnection> ClientForwarders::acquireRetry(
+        const sockaddr_storage& failed)
+{
+    for (auto it = m_config->begin(); it != m_config->end(); ++it)
+    {
+        if (memcmp(&it->remote, &failed, sizeof(failed)) == 0)
+        {
+            auto connection = acquireAlternative(*it);
+            if (connection)
+            {
+                return connection;
+            }
+            break;
+        }
+    }
+    // There's no other forwarder, so try again with any of them
+    return acquireConnection();
+}
+
+std::shared_ptr<ForwarderConnection> ClientForwarders::addConnection(
+        std::shared_ptr<ForwarderConnection> connection)
+{
+    if (connection->closed())
+    {
+        return nullptr;
+    }
+    connection->setIncomingCallback(
+        std::bind(&ClientForwarders::handleResponse, this, _1, _2)
+    );
+    // On shutdown, remove the client
+    connection->setShutdownCallback(
+        std::bind(&ClientForwarders::handleShutdown, this, _1)
+    );
+    m_forwarders.emplace_back(connection);
+    m_openConnections->add(1);
+    return connection;
+}
+
+std::size_t ClientForwarders::idleConnections(
+        const ConfigParser::Forwarder& forwarder) const
+{
+    std::size_t count = 0u;
+    for (const auto& connection : m_forwarders)
+    {
+        if (connection->idle() &&
+                memcmp(&connection->forwarder().remote,
+                       &forwarder.remote,
+                       sizeof(forwarder.remote)) == 0)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::size_t ClientForwarders::openConnections(
+        const ConfigParser::Forwarder& forwarder) const
+{
+    std::size_t count = 0u;
+    for (const auto& connection : m_forwarders)
+    {
+        if (!connection->closed() &&
+                memcmp(&connection->forwarder().remote,
+                       &forwarder.remote,
+                       sizeof(forwarder.remote)) == 0)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool ClientForwarders::attachWaiter(QueuedQuery& query)
+{
+    if (query.key.empty())
+    {
+        return false;
+    }
+    auto inflight = m_inflight.find(query.key);
+    if (inflight == m_inflight.end())
+    {
+        return false;
+    }
+    auto active = m_active.find(inflight->second);
+    if (active == m_active.end())
+    {
+        m_inflight.erase(inflight);
+        return false;
+    }
+    // The request is kept as the response needs its question, the client
+    // may check that the name is in the case that it asked with
+    DnsPacket packet(std::move(query.request));
+    unsigned short id = packet.id();
+    query.request = packet.move();
+    active->second.waiters.emplace_back(Waiter { id, std::move(query) });
+    Log::debug << "Request attached to one in progress, " <<
+        active->second.waiters.size() << " waiting";
+    return true;
+}
+
+void ClientForwarders::keyActive()
+{
+    for (auto id : m_unkeyed)
+    {
+        auto active = m_active.find(id);
+        if (active == m_active.end() || active->second.cancelled ||
+                active->second.request.empty() ||
+                !active->second.query.key.empty())
+        {
+            continue;
+        }
+        DnsPacket packet(std::move(active->second.request));
+        std::string key = DnsCache::key(packet);
+        active->second.request = packet.move();
+        if (!key.empty() && m_inflight.emplace(key, id).second)
+        {
+            active->second.query.key = std::move(key);
+        }
+    }
+    m_unkeyed.clear();
+}
+
+void ClientForwarders::sendRequest(
+        const std::shared_ptr<ForwarderConnection>& connection,
+        QueuedQuery query)
+{
+    DnsPacket packet(std::move(query.request));
+    unsigned short clientId = packet.id();
+    if (packet.packet().size() < sizeof(unsigned short) * 2u)
+    {
+        Log::warn << "Discarding request too short to have an ID";
+        return;
+    }
+
+    unsigned short id = allocateId();
+    packet.setId(id);
+
+    // Keep a copy to send to another forwarder if this one is slow
+    // or fails
+    std::vector<char> request;
+    ILoop::Registration hedgeTimer;
+    if (m_hedgeDelay.count() > 0 &&
+            m_config->getAlternative(connection->forwarder()) != m_config->end())
+    {
+        hedgeTimer = m_loop->registerTimer(
+            m_hedgeAfter, std::bind(&ClientForwarders::hedge, this, id)
         );
-        // On shutdown, remove the client
-        connection->setShutdownCallback(
-            std::bind(&ClientForwarders::handleShutdown, this, _1)
-        );
+    }
+    // A request sent before its key was built keeps a copy to build it
+    // from if another request arrives while it's in progress
+    bool unkeyed = !m_cache && query.key.empty();
+    if (hedgeTimer || query.retries < m_retries || unkeyed)
+    {
+        request = m_packetPool->acquire();
+        request.assign(packet.packet().begin(), packet.packet().end());
+    }
+
+    if (connection->send(packet.move()))
+    {
+        if (!query.key.empty())
+        {
+            m_inflight[query.key] = id;
+        }
+        else if (unkeyed)
+        {
+            m_unkeyed.push_back(id);
+        }
+        m_active.emplace(id, ActiveQuery {
+            connection.get(), clientId, std::move(query), {},
+            connection->open() ?
+                std::chrono::steady_clock::now() :
+                std::chrono::steady_clock::time_point(),
+            std::move(request), -1, false, false, std::move(hedgeTimer)
+        });
+    }
+    else
+    {
+        Log::warn << "Unable to send request to forwarder";
+    }
+}
+
+unsigned short ClientForwarders::allocateId()
+{
+    // Find an ID that isn't in use, there is always one
+    while (m_active.count(m_nextId))
+    {
+        ++m_nextId;
+    }
+    return m_nextId++;
+}
+
+void ClientForwarders::hedge(unsigned short id)
+{
+    auto active = m_active.find(id);
+    if (active == m_active.end())
+    {
+        return;
+    }
+    ActiveQuery& original = active->second;
+    original.hedgeTimer.reset();
+    if (original.cancelled || original.partner != -1 ||
+            original.request.empty())
+    {
+        return;
+    }
+
+    auto connection = acquireAlternative(original.connection->forwarder());
+    if (!connection)
+    {
+        Log::debug << "No connection available to hedge a request on";
+        return;
+    }
 
-        // Save off the pointer
-        m_forwarders.emplace_back(std::move(connection));
+    // Send a copy so that the original can still be retried if its
+    // connection fails
+    unsigned short hedgeId = allocateId();
+    std::vector<char> buffer(m_packetPool->acquire());
+    buffer.assign(original.request.begin(), original.request.end());
+    DnsPacket packet(std::move(buffer));
+    packet.setId(hedgeId);
+    if (!connection->send(packet.move()))
+    {
+        Log::warn << "Unable to send hedged request to forwarder";
+        return;
+    }
+
+    m_hedgesSent->add();
+    Log::debug << "Hedged a slow request, " << m_hedgesSent->value() << " hedged";
+    original.partner = hedgeId;
+    // The clients stay with the original, which is given them if this wins
+    m_active.emplace(hedgeId, ActiveQuery {
+        connection.get(), original.id,
+        QueuedQuery {
+            nullptr, sockaddr_storage(), sockaddr_storage(), -1, {}, {},
+            std::chrono::steady_clock::time_point(), 0u, sockaddr_storage()
+        },
+        {},
+        connection->open() ?
+            std::chrono::steady_clock::now() :
+            std::chrono::steady_clock::time_point(),
+        {}, id, true, false, ILoop::Registration()
+    });
+}
+
+void ClientForwarders::recordResponseTime(std::chrono::microseconds time)
+{
+    if (m_hedgeDelay.count() == 0)
+    {
+        return;
+    }
+
+    if (m_responseTimes.size() < RESPONSE_SAMPLES)
+    {
+        m_responseTimes.push_back(time);
     }
     else
     {
-        dequeue();
+        m_responseTimes[m_responseCount % RESPONSE_SAMPLES] = time;
+    }
+    ++m_responseCount;
+
+    // Hedge the slowest tenth of requests, as long as that isn't sooner
+    // than the configured delay
+    if (m_responseCount % HEDGE_UPDATE_INTERVAL == 0u)
+    {
+        std::vector<std::chrono::microseconds> times(m_responseTimes);
+        auto percentile = times.begin() + (times.size() * 9u) / 10u;
+        std::nth_element(times.begin(), percentile, times.end());
+        m_hedgeAfter = std::max(
+            m_hedgeDelay,
+            std::chrono::duration_cast<std::chrono::milliseconds>(*percentile)
+        );
     }
 }
 
 void ClientForwarders::dequeue()
 {
-    if (!m_queue.empty())
+    auto now = std::chrono::steady_clock::now();
+    while (!m_queue.empty())
     {
-        auto& front = m_queue.front();
-        std::shared_ptr<Socket> socket = std::move(front.socket);
-        sockaddr_storage client = front.client;
-        sockaddr_storage server = front.server;
-        int interface = front.interface;
-        std::vector<char> request = std::move(front.request);
+        // The client will have given up on a request this old
+        if (m_queueDeadline.count() > 0 &&
+                now - m_queue.front().arrived >= m_queueDeadline)
+        {
+            failRequest(m_queue.front());
+            m_queue.pop_front();
+            continue;
+        }
+        // The same question may have been sent while this was queued
+        if (attachWaiter(m_queue.front()))
+        {
+            m_queue.pop_front();
+            continue;
+        }
+        auto connection = m_queue.front().failed.ss_family != AF_UNSPEC ?
+            acquireRetry(m_queue.front().failed) : acquireConnection();
+        if (!connection)
+        {
+            break;
+        }
+        QueuedQuery query = std::move(m_queue.front());
         m_queue.pop_front();
-        sendRequest(
-            std::move(socket),
-            client,
-            server,
-            interface,
-            std::move(request)
+        m_queueTimes->record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                now - query.arrived
+            )
         );
+        sendRequest(connection, std::move(query));
         Log::debug << "Sent request from queue, length now " << m_queue.size();
     }
+    if (m_queue.empty())
+    {
+        m_queueTimer.reset();
+    }
+    updateQueueLength();
+}
+
+void ClientForwarders::enqueue(QueuedQuery query)
+{
+    if (m_queue.size() >= m_queueSize)
+    {
+        // Answer straight away rather than let the queue grow without
+        // limit while the forwarders can't keep up
+        Log::debug << "Request queue is full, failing request";
+        failRequest(query);
+        return;
+    }
+    Log::debug << "Queuing request, queue length is " << m_queue.size();
+    m_queue.emplace_back(std::move(query));
+    updateQueueLength();
+    if (m_queueDeadline.count() > 0 && !m_queueTimer)
+    {
+        m_queueTimer = m_loop->registerTimer(
+            m_queueDeadline,
+            std::bind(&ClientForwarders::expireQueue, this, _1)
+        );
+    }
+}
+
+void ClientForwarders::updateQueueLength()
+{
+    m_queueLength->add(
+        static_cast<std::int64_t>(m_queue.size()) -
+        static_cast<std::int64_t>(m_reportedQueueLength)
+    );
+    m_reportedQueueLength = m_queue.size();
+}
+
+void ClientForwarders::expireQueue(int)
+{
+    m_queueTimer.reset();
+    auto now = std::chrono::steady_clock::now();
+    // The queue is in the order the requests arrived, so the oldest are
+    // at the front
+    while (!m_queue.empty() && now - m_queue.front().arrived >= m_queueDeadline)
+    {
+        failRequest(m_queue.front());
+        m_queue.pop_front();
+    }
+    updateQueueLength();
+    if (!m_queue.empty())
+    {
+        m_queueTimer = m_loop->registerTimer(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                m_queue.front().arrived + m_queueDeadline - now
+            ) + std::chrono::milliseconds(1),
+            std::bind(&ClientForwarders::expireQueue, this, _1)
+        );
+    }
+}
+
+void ClientForwarders::failRequest(QueuedQuery& query)
+{
+    DnsPacket packet(std::move(query.request));
+    m_requestsFailed->add();
+    if (packet.setServerFailure())
+    {
+        handleIncoming(
+            query.socket, query.client, query.server, query.interface,
+            packet.move(), query.arrived
+        );
+    }
+}
+
+void ClientForwarders::handleResponse(ForwarderConnection& connection,
+                                      std::vector<char> buffer)
+{
+    DnsPacket packet(std::move(buffer));
+    auto active = m_active.find(packet.id());
+    if (active != m_active.end() && active->second.connection == &connection)
+    {
+        ActiveQuery query = std::move(active->second);
+        m_active.erase(active);
+        if (query.sent != std::chrono::steady_clock::time_point())
+        {
+            auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - query.sent
+            );
+            m_config->setResponseTime(connection.forwarder(), time);
+            m_config->setFirstByteTime(
+                connection.forwarder(),
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    connection.firstByte() - query.sent
+                )
+            );
+            recordResponseTime(time);
+        }
+        if (query.cancelled)
+        {
+            // The other copy of a hedged request has already been answered
+            Log::debug << "Discarding response to a hedged request";
+            m_packetPool->release(packet.move());
+        }
+        else
+        {
+            if (query.partner != -1)
+            {
+                // The first answer wins, and the other copy is discarded
+                // when it arrives
+                auto other = m_active.find(query.partner);
+                if (other != m_active.end())
+                {
+                    if (query.hedge)
+                    {
+                        m_hedgesWon->add();
+                        query.id = other->second.id;
+                        query.query = std::move(other->second.query);
+                        query.waiters = std::move(other->second.waiters);
+                    }
+                    other->second.cancelled = true;
+                    other->second.partner = -1;
+                    other->second.hedgeTimer.reset();
+                }
+            }
+            sendResponse(query, packet.move());
+        }
+        m_packetPool->release(std::move(query.request));
+    }
+    else
+    {
+        Log::notice << "Discarding response that doesn't match a request";
+        m_packetPool->release(packet.move());
+    }
+
+    // The connection has room, so give it the next request
+    dequeue();
+
+    // Only keep a limited number of idle connections around, but no
+    // fewer than are kept warm
+    if (connection.idle() &&
+            idleConnections(connection.forwarder()) >
+                std::max(m_poolSize, m_warmConnections))
+    {
+        connection.shutdown();
+    }
+}
+
+void ClientForwarders::sendResponse(ActiveQuery& query,
+                                    std::vector<char> response)
+{
+    DnsPacket packet(std::move(response));
+    if (!query.query.key.empty())
+    {
+        m_inflight.erase(query.query.key);
+    }
+    packet.setId(query.id);
+    if (m_cache && !query.query.key.empty())
+    {
+        m_cache->store(query.query.key, packet.packet());
+    }
+    // Every client waiting on the same question gets its own ID and
+    // question back
+    for (auto& waiter : query.waiters)
+    {
+        std::vector<char> buffer(m_packetPool->acquire());
+        buffer.assign(packet.packet().begin(), packet.packet().end());
+        DnsPacket copy(std::move(buffer));
+        copy.setId(waiter.id);
+        DnsPacket request(std::move(waiter.query.request));
+        (void) copy.copyQuestion(request);
+        m_packetPool->release(request.move());
+        handleIncoming(
+            waiter.query.socket,
+            waiter.query.client,
+            waiter.query.server,
+            waiter.query.interface,
+            copy.move(),
+            waiter.query.arrived
+        );
+    }
+    handleIncoming(
+        query.query.socket,
+        query.query.client,
+        query.query.server,
+        query.query.interface,
+        packet.move(),
+        query.query.arrived
+    );
+}
+
+bool ClientForwarders::retry(const ForwarderConnection& connection,
+                             ActiveQuery& lost)
+{
+    if (lost.query.retries >= m_retries || lost.request.empty())
+    {
+        return false;
+    }
+
+    // Send it again with the ID that the client used, so it can be given
+    // a new one if it goes to a different forwarder
+    DnsPacket packet(std::move(lost.request));
+    packet.setId(lost.id);
+    std::vector<QueuedQuery> retries;
+    retries.emplace_back(std::move(lost.query));
+    retries.back().request = packet.move();
+
+    // Those waiting on the same question queue up behind it with their
+    // own requests and attach to it again once it has been sent
+    for (auto& waiter : lost.waiters)
+    {
+        retries.emplace_back(std::move(waiter.query));
+    }
+    for (auto& query : retries)
+    {
+        ++query.retries;
+        query.failed = connection.forwarder().remote;
+    }
+
+    // These have already waited their turn, so go to the front even if
+    // the queue is full, but are still failed if they have waited too long
+    m_queue.insert(
+        m_queue.begin(),
+        std::make_move_iterator(retries.begin()),
+        std::make_move_iterator(retries.end())
+    );
+    if (m_queueDeadline.count() > 0 && !m_queueTimer)
+    {
+        m_queueTimer = m_loop->registerTimer(
+            m_queueDeadline,
+            std::bind(&ClientForwarders::expireQueue, this, _1)
+        );
+    }
+    m_retriesSent->add();
+    updateQueueLength();
+    Log::debug << "Retrying request lost with its connection, " <<
+        m_retriesSent->value() << " retried";
+    return true;
 }
 
 void ClientForwarders::handleShutdown(ForwarderConnection& connection)
 {
+    // Any requests in progress on the connection are lost
+    for (auto it = m_active.begin(); it != m_active.end();)
+    {
+        if (it->second.connection == &connection)
+        {
+            ActiveQuery& lost = it->second;
+            auto other = lost.partner != -1 ?
+                m_active.find(lost.partner) : m_active.end();
+            if (other != m_active.end())
+            {
+                // The other copy of a hedged request carries on alone
+                other->second.partner = -1;
+                if (!lost.hedge)
+                {
+                    other->second.hedge = false;
+                    other->second.id = lost.id;
+                    other->second.query = std::move(lost.query);
+                    other->second.waiters = std::move(lost.waiters);
+                    if (!other->second.query.key.empty())
+                    {
+                        m_inflight[other->second.query.key] = other->first;
+                    }
+                }
+            }
+            else if (!lost.cancelled)
+            {
+                if (!lost.query.key.empty())
+                {
+                    m_inflight.erase(lost.query.key);
+                }
+                if (!retry(connection, lost))
+                {
+                    m_requestsLost->add();
+                    Log::info << "Request lost with forwarder connection";
+                }
+            }
+            it = m_active.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
     for (auto it = m_forwarders.begin(); it != m_forwarders.end(); ++it)
     {
         if (it->get() == &connection)
         {
             m_forwarders.erase(it);
+            m_openConnections->add(-1);
             break;
         }
     }
     dequeue();
+
+    // Replace the connection if it was one of those kept warm
+    if (m_warmConnections > 0u && !m_warmTimer)
+    {
+        m_warmTimer = m_loop->registerTimer(
+            WARM_INTERVAL, std::bind(&ClientForwarders::rewarm, this, _1)
+        );
+    }
 }
 
 void ClientForwarders::handleIncoming(const std::shared_ptr<Socket>& socket,
                                       const sockaddr_storage& client,
                                       const sockaddr_storage& server,
                                       int interface,
-                                      std::vector<char> buffer)
+                                      std::vector<char> buffer,
+                                      std::chrono::steady_clock::time_point arrived)
 {
     DnsPacket packet(std::move(buffer));
     if (!packet.valid())
@@ -212,36 +1068,134 @@ void ClientForwarders::handleIncoming(const std::shared_ptr<Socket>& socket,
 
     (void) packet.removeEdnsPadding();
 
-    struct iovec iov[1] {
-        { packet.data(), packet.length() }
-    };
-    socklen_t clientLength = 0;
+    Reply reply;
+    reply.client = client;
+    reply.clientLength = 0;
     if (client.ss_family == AF_INET)
     {
-        clientLength = sizeof(sockaddr_in);
+        reply.clientLength = sizeof(sockaddr_in);
     }
     else if (client.ss_family == AF_INET6)
     {
-        clientLength = sizeof(sockaddr_in6);
+        reply.clientLength = sizeof(sockaddr_in6);
     }
-
-    struct msghdr message {
-        const_cast<sockaddr_storage*>(&client),
-        clientLength, iov, 1, nullptr, 0, 0
-    };
+    reply.response = packet.move();
+    reply.controlLength = 0u;
+    reply.arrived = arrived;
 
     // Only set the source address if interface is given
-    char controlBuf[256];
     if (interface != -1)
     {
-        message.msg_control = controlBuf;
+        struct msghdr message {
+            nullptr, 0, nullptr, 0, reply.control, sizeof(reply.control), 0
+        };
         addSourceAddress(message, server, interface);
+        reply.controlLength = message.msg_controllen;
+    }
+
+    auto replies = m_replies.begin();
+    while (replies != m_replies.end() && replies->first != socket)
+    {
+        ++replies;
+    }
+    if (replies == m_replies.end())
+    {
+        m_replies.emplace_back(socket, std::vector<Reply>());
+        replies = m_replies.end() - 1;
+    }
+    replies->second.emplace_back(std::move(reply));
+
+    if (!m_flush)
+    {
+        m_flush = m_loop->registerDeferred(
+            std::bind(&ClientForwarders::flushReplies, this, _1)
+        );
+        if (!m_flush)
+        {
+            // Unable to wait for the end of the iteration
+            flushReplies(-1);
+        }
+    }
+}
+
+void ClientForwarders::flushReplies(int)
+{
+    m_flush.reset();
+    for (auto& socketReplies : m_replies)
+    {
+        sendReplies(socketReplies.first->get(), socketReplies.second);
+        auto now = std::chrono::steady_clock::now();
+        for (auto& reply : socketReplies.second)
+        {
+            m_requestTimes->record(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - reply.arrived
+                )
+            );
+            m_packetPool->release(std::move(reply.response));
+        }
+    }
+    m_replies.clear();
+}
+
+void ClientForwarders::sendReplies(int handle, const std::vector<Reply>& replies)
+{
+    std::vector<iovec> iov(replies.size());
+    std::vector<msghdr> messages(replies.size());
+    for (std::size_t i = 0u; i < replies.size(); ++i)
+    {
+        const Reply& reply = replies[i];
+        // Skip the TCP length to send the UDP packet
+        iov[i] = {
+            const_cast<char*>(reply.response.data()) + sizeof(unsigned short),
+            reply.response.size() - sizeof(unsigned short)
+        };
+        messages[i] = {
+            const_cast<sockaddr_storage*>(&reply.client), reply.clientLength,
+            &iov[i], 1,
+            reply.controlLength ? const_cast<char*>(reply.control) : nullptr,
+            reply.controlLength, 0
+        };
     }
 
-    if (sendmsg(socket->get(), &message, 0) == -1)
+#ifdef __linux__
+    std::vector<mmsghdr> batch(messages.size());
+    for (std::size_t i = 0u; i < messages.size(); ++i)
     {
-        Log::warn << "Unable to send response to DNS request";
+        batch[i].msg_hdr = messages[i];
+        batch[i].msg_len = 0u;
     }
+    std::size_t sent = 0u;
+    while (sent < batch.size())
+    {
+        int count = sendmmsg(handle, &batch[sent], batch.size() - sent, 0);
+        if (count <= 0)
+        {
+            // Skip the message that failed and carry on with the rest
+            Log::warn << "Unable to send response to DNS request";
+            m_sendErrors->add();
+            count = 1;
+        }
+        else
+        {
+            m_responsesSent->add(count);
+        }
+        sent += count;
+    }
+#else
+    for (auto& message : messages)
+    {
+        if (sendmsg(handle, &message, 0) == -1)
+        {
+            Log::warn << "Unable to send response to DNS request";
+            m_sendErrors->add();
+        }
+        else
+        {
+            m_responsesSent->add();
+        }
+    }
+#endif
 }
 
 }  // namespace dote
@@ -8,6 +8,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <netinet/in.h>
+#include <sys/un.h>
 
 namespace dote {
 
@@ -19,15 +20,100 @@ constexpr char DEFAULT_CIPHERS[] = "DEFAULT";
 /// The default maximum open connections at a time
 constexpr std::size_t DEFAULT_MAX_CONNECTIONS = 5u;
 
+/// The default number of idle connections to keep per forwarder
+constexpr std::size_t DEFAULT_POOL_SIZE = 2u;
+
+/// The default number of seconds to keep an idle connection open
+constexpr unsigned int DEFAULT_IDLE_TIMEOUT = 10u;
+
+/// The default longest time to cache a response for
+constexpr unsigned int DEFAULT_CACHE_TTL = 3600u;
+
+/// The default number of requests that may wait for a connection
+constexpr std::size_t DEFAULT_QUEUE_SIZE = 1000u;
+
+/// The default number of milliseconds a request may wait for a connection
+constexpr unsigned int DEFAULT_QUEUE_DEADLINE = 2000u;
+
+/// The default number of failures in a row to mark a forwarder down after
+constexpr unsigned int DEFAULT_FAILURE_THRESHOLD = 3u;
+
+/// The default number of times to send a request again after a failure
+constexpr unsigned int DEFAULT_RETRIES = 1u;
+
+/// The default port to serve the metrics on
+constexpr unsigned short DEFAULT_METRICS_PORT = 9153u;
+
+/// The values for options that only have a long form, these start
+/// after the range of characters so they don't clash with short ones
+enum LongOption : int
+{
+    POOL_SIZE = 256,
+    IDLE_TIMEOUT,
+    PIPELINE,
+    CACHE_SIZE,
+    CACHE_TTL,
+    WORKERS,
+    HEDGE_DELAY,
+    QUEUE_SIZE,
+    QUEUE_DEADLINE,
+    EARLY_DATA,
+    FAST_OPEN,
+    KERNEL_TLS,
+    WARM_CONNECTIONS,
+    FAILURE_THRESHOLD,
+    RETRIES,
+    METRICS,
+    STATS
+};
+
+/// \brief  Parse a decimal number that must lie within a given range
+///
+/// \param value    The string to parse
+/// \param minimum  The smallest valid value
+/// \param maximum  The largest valid value
+/// \param output   The variable to store the parsed value in
+///
+/// \return  True if the whole string was a number within the range
+bool parseNumber(const char* value, long minimum, long maximum, long& output)
+{
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (*value == '\0' || *end || number < minimum || number > maximum)
+    {
+        return false;
+    }
+    output = number;
+    return true;
+}
+
 }  // anon namespace
 
 ConfigParser::ConfigParser() :
     m_valid(true),
+    m_partialForwarder(),
     m_maxConnections(DEFAULT_MAX_CONNECTIONS),
     m_daemonise(false),
-    m_timeout(5u)
+    m_timeout(5u),
+    m_poolSize(DEFAULT_POOL_SIZE),
+    m_idleTimeout(DEFAULT_IDLE_TIMEOUT),
+    m_pipelineDepth(1u),
+    m_cacheSize(0u),
+    m_cacheTtl(DEFAULT_CACHE_TTL),
+    m_workers(1u),
+    m_hedgeDelay(0u),
+    m_queueSize(DEFAULT_QUEUE_SIZE),
+    m_queueDeadline(DEFAULT_QUEUE_DEADLINE),
+    m_earlyData(false),
+    m_kernelTls(false),
+    m_warmConnections(0u),
+    m_failureThreshold(DEFAULT_FAILURE_THRESHOLD),
+    m_retries(DEFAULT_RETRIES),
+    m_metricsAddress(),
+    m_statsName()
 {
     m_ipLookup.ss_family = AF_UNSPEC;
+    m_metricsAddress.ss_family = AF_UNSPEC;
 }
 
 void ConfigParser::setDefaults()
@@ -167,11 +253,16 @@ void ConfigParser::disableVerification()
     m_partialForwarder.disablePki = true;
 }
 
+void ConfigParser::enableFastOpen()
+{
+    m_partialForwarder.fastOpen = true;
+}
+
 void ConfigParser::addHostname(const char* hostname)
 {
     if (m_partialForwarder.host.empty())
     {
-        m_partialForwarder.host = optarg;
+        m_partialForwarder.host = hostname;
     }
     else
     {
@@ -190,9 +281,8 @@ void ConfigParser::addPin(const char* pin)
 
 void ConfigParser::setMaxConnections(const char* maxConnections)
 {
-    char *end;
-    long longConnections = strtol(maxConnections, &end, 10);
-    if (*end || longConnections < 1 || longConnections > 6000)
+    long longConnections;
+    if (!parseNumber(maxConnections, 1, 6000, longConnections))
     {
         // Invalid number of connections
         m_valid = false;
@@ -203,6 +293,34 @@ void ConfigParser::setMaxConnections(const char* maxConnections)
     }
 }
 
+void ConfigParser::setPoolSize(const char* poolSize)
+{
+    long longPoolSize;
+    if (!parseNumber(poolSize, 0, 6000, longPoolSize))
+    {
+        // Invalid pool size
+        m_valid = false;
+    }
+    else
+    {
+        m_poolSize = longPoolSize;
+    }
+}
+
+void ConfigParser::setIdleTimeout(const char* timeout)
+{
+    long longTimeout;
+    if (!parseNumber(timeout, 1, 0xffff, longTimeout))
+    {
+        // Invalid idle timeout
+        m_valid = false;
+    }
+    else
+    {
+        m_idleTimeout = longTimeout;
+    }
+}
+
 const sockaddr_storage& ConfigParser::ipLookup() const
 {
     return m_ipLookup;
@@ -213,11 +331,39 @@ unsigned int ConfigParser::timeout() const
     return m_timeout;
 }
 
+void ConfigParser::setPipelineDepth(const char* depth)
+{
+    long longDepth;
+    if (!parseNumber(depth, 1, 0xffff, longDepth))
+    {
+        // Invalid pipeline depth
+        m_valid = false;
+    }
+    else
+    {
+        m_pipelineDepth = longDepth;
+    }
+}
+
+std::size_t ConfigParser::pipelineDepth() const
+{
+    return m_pipelineDepth;
+}
+
+std::size_t ConfigParser::poolSize() const
+{
+    return m_poolSize;
+}
+
+unsigned int ConfigParser::idleTimeout() const
+{
+    return m_idleTimeout;
+}
+
 void ConfigParser::setTimeout(const char *timeout)
 {
-    char *end;
-    long longTimeout = strtol(timeout, &end, 10);
-    if (*end || longTimeout < 1 || longTimeout > 0xffff)
+    long longTimeout;
+    if (!parseNumber(timeout, 1, 0xffff, longTimeout))
     {
         // Invalid timeout
         m_valid = false;
@@ -228,6 +374,221 @@ void ConfigParser::setTimeout(const char *timeout)
     }
 }
 
+void ConfigParser::setCacheSize(const char* size)
+{
+    long longSize;
+    if (!parseNumber(size, 0, 1000000, longSize))
+    {
+        // Invalid cache size
+        m_valid = false;
+    }
+    else
+    {
+        m_cacheSize = longSize;
+    }
+}
+
+std::size_t ConfigParser::cacheSize() const
+{
+    return m_cacheSize;
+}
+
+void ConfigParser::setCacheTtl(const char* ttl)
+{
+    long longTtl;
+    if (!parseNumber(ttl, 1, 604800, longTtl))
+    {
+        // Invalid cache TTL
+        m_valid = false;
+    }
+    else
+    {
+        m_cacheTtl = longTtl;
+    }
+}
+
+unsigned int ConfigParser::cacheTtl() const
+{
+    return m_cacheTtl;
+}
+
+void ConfigParser::setWorkers(const char* workers)
+{
+    long longWorkers;
+    if (!parseNumber(workers, 1, 256, longWorkers))
+    {
+        // Invalid number of workers
+        m_valid = false;
+    }
+    else
+    {
+        m_workers = longWorkers;
+    }
+}
+
+unsigned int ConfigParser::workers() const
+{
+    return m_workers;
+}
+
+void ConfigParser::setHedgeDelay(const char* delay)
+{
+    long longDelay;
+    if (!parseNumber(delay, 0, 60000, longDelay))
+    {
+        // Invalid hedge delay
+        m_valid = false;
+    }
+    else
+    {
+        m_hedgeDelay = longDelay;
+    }
+}
+
+unsigned int ConfigParser::hedgeDelay() const
+{
+    return m_hedgeDelay;
+}
+
+void ConfigParser::setQueueSize(const char* size)
+{
+    long longSize;
+    if (!parseNumber(size, 1, 1000000, longSize))
+    {
+        // Invalid queue size
+        m_valid = false;
+    }
+    else
+    {
+        m_queueSize = longSize;
+    }
+}
+
+std::size_t ConfigParser::queueSize() const
+{
+    return m_queueSize;
+}
+
+void ConfigParser::setQueueDeadline(const char* deadline)
+{
+    long longDeadline;
+    if (!parseNumber(deadline, 0, 60000, longDeadline))
+    {
+        // Invalid queue deadline
+        m_valid = false;
+    }
+    else
+    {
+        m_queueDeadline = longDeadline;
+    }
+}
+
+unsigned int ConfigParser::queueDeadline() const
+{
+    return m_queueDeadline;
+}
+
+void ConfigParser::setWarmConnections(const char* count)
+{
+    long longCount;
+    if (!parseNumber(count, 0, 6000, longCount))
+    {
+        // Invalid number of warm connections
+        m_valid = false;
+    }
+    else
+    {
+        m_warmConnections = longCount;
+    }
+}
+
+std::size_t ConfigParser::warmConnections() const
+{
+    return m_warmConnections;
+}
+
+void ConfigParser::setFailureThreshold(const char* threshold)
+{
+    long longThreshold;
+    if (!parseNumber(threshold, 0, 100, longThreshold))
+    {
+        // Invalid failure threshold
+        m_valid = false;
+    }
+    else
+    {
+        m_failureThreshold = longThreshold;
+    }
+}
+
+unsigned int ConfigParser::failureThreshold() const
+{
+    return m_failureThreshold;
+}
+
+void ConfigParser::setRetries(const char* retries)
+{
+    long longRetries;
+    if (!parseNumber(retries, 0, 10, longRetries))
+    {
+        // Invalid number of retries
+        m_valid = false;
+    }
+    else
+    {
+        m_retries = longRetries;
+    }
+}
+
+unsigned int ConfigParser::retries() const
+{
+    return m_retries;
+}
+
+void ConfigParser::setMetricsAddress(const char* address)
+{
+    if (*address == '/')
+    {
+        auto& local = reinterpret_cast<sockaddr_un&>(m_metricsAddress);
+        if (strlen(address) >= sizeof(local.sun_path))
+        {
+            // Path too long for a Unix socket
+            m_valid = false;
+            return;
+        }
+        local.sun_family = AF_UNIX;
+        strcpy(local.sun_path, address);
+    }
+    else if (!parseServer(address, DEFAULT_METRICS_PORT, m_metricsAddress))
+    {
+        m_valid = false;
+    }
+}
+
+const sockaddr_storage& ConfigParser::metricsAddress() const
+{
+    return m_metricsAddress;
+}
+
+void ConfigParser::setStatsName(const char* name)
+{
+    // A portable shared memory name is a single / followed by the name
+    if (name[0] != '/' || name[1] == '\0' || strchr(&name[1], '/') ||
+            strlen(name) > 255u)
+    {
+        m_valid = false;
+    }
+    else
+    {
+        m_statsName = name;
+    }
+}
+
+const std::string& ConfigParser::statsName() const
+{
+    return m_statsName;
+}
+
 void ConfigParser::parseConfig(int argc, char* const argv[])
 {
     int c;
@@ -243,6 +604,23 @@ void ConfigParser::parseConfig(int argc, char* const argv[])
         {"pid_file", required_argument, nullptr, 'P'},
         {"ip_lookup", required_argument, nullptr, 'l'},
         {"timeout", required_argument, nullptr, 't'},
+        {"pool_size", required_argument, nullptr, POOL_SIZE},
+        {"idle_timeout", required_argument, nullptr, IDLE_TIMEOUT},
+        {"pipeline", required_argument, nullptr, PIPELINE},
+        {"cache_size", required_argument, nullptr, CACHE_SIZE},
+        {"cache_ttl", required_argument, nullptr, CACHE_TTL},
+        {"workers", required_argument, nullptr, WORKERS},
+        {"hedge_delay", required_argument, nullptr, HEDGE_DELAY},
+        {"queue_size", required_argument, nullptr, QUEUE_SIZE},
+        {"queue_deadline", required_argument, nullptr, QUEUE_DEADLINE},
+        {"early_data", no_argument, nullptr, EARLY_DATA},
+        {"fast_open", no_argument, nullptr, FAST_OPEN},
+        {"ktls", no_argument, nullptr, KERNEL_TLS},
+        {"warm_connections", required_argument, nullptr, WARM_CONNECTIONS},
+        {"failure_threshold", required_argument, nullptr, FAILURE_THRESHOLD},
+        {"retries", required_argument, nullptr, RETRIES},
+        {"metrics", required_argument, nullptr, METRICS},
+        {"stats", required_argument, nullptr, STATS},
         {nullptr, 0, nullptr, 0}
     };
 
@@ -302,6 +680,74 @@ void ConfigParser::parseConfig(int argc, char* const argv[])
                 // The number of seconds to allow a forwarder to reply to a lookup
                 setTimeout(optarg);
                 break;
+            case POOL_SIZE:
+                // The number of idle connections to keep per forwarder
+                setPoolSize(optarg);
+                break;
+            case IDLE_TIMEOUT:
+                // The number of seconds to keep an idle connection open
+                setIdleTimeout(optarg);
+                break;
+            case PIPELINE:
+                // The number of requests to send at once on a connection
+                setPipelineDepth(optarg);
+                break;
+            case CACHE_SIZE:
+                // The number of responses to keep in the cache
+                setCacheSize(optarg);
+                break;
+            case CACHE_TTL:
+                // The maximum number of seconds to cache a response for
+                setCacheTtl(optarg);
+                break;
+            case WORKERS:
+                // The number of threads to handle requests on
+                setWorkers(optarg);
+                break;
+            case HEDGE_DELAY:
+                // The least time before a request is sent to a second forwarder
+                setHedgeDelay(optarg);
+                break;
+            case QUEUE_SIZE:
+                // The number of requests that may wait for a connection
+                setQueueSize(optarg);
+                break;
+            case QUEUE_DEADLINE:
+                // The longest time a request may wait for a connection
+                setQueueDeadline(optarg);
+                break;
+            case EARLY_DATA:
+                // Send the first request on a resumed connection as early data
+                m_earlyData = true;
+                break;
+            case FAST_OPEN:
+                // Connect to the current forwarder with TCP Fast Open
+                enableFastOpen();
+                break;
+            case KERNEL_TLS:
+                // Offload the record encryption to the kernel
+                m_kernelTls = true;
+                break;
+            case WARM_CONNECTIONS:
+                // The number of connections to keep open to each forwarder
+                setWarmConnections(optarg);
+                break;
+            case FAILURE_THRESHOLD:
+                // The failures in a row to mark a forwarder down after
+                setFailureThreshold(optarg);
+                break;
+            case RETRIES:
+                // The number of times to send a request again after a failure
+                setRetries(optarg);
+                break;
+            case METRICS:
+                // The address to serve the metrics on
+                setMetricsAddress(optarg);
+                break;
+            case STATS:
+                // The shared memory segment to publish the metrics in
+                setStatsName(optarg);
+                break;
             default:
                 // Unknown option
                 m_valid = false;
@@ -347,6 +793,16 @@ bool ConfigParser::daemonise() const
     return m_daemonise;
 }
 
+bool ConfigParser::earlyData() const
+{
+    return m_earlyData;
+}
+
+bool ConfigParser::kernelTls() const
+{
+    return m_kernelTls;
+}
+
 const std::string& ConfigParser::pidFile() const
 {
     return m_pidFile;
@@ -355,22 +811,22 @@ const std::string& ConfigParser::pidFile() const
 void ConfigParser::defaultForwarders()
 {
     std::string hostname("cloudflare-dns.com");
-    Forwarder a{{}, false, hostname, {}};
+    Forwarder a{{}, false, hostname, {}, false};
     if (parseServer("[2606:4700:4700::1111]", 853, a.remote))
     {
         m_forwarders.emplace_back(std::move(a));
     }
-    Forwarder b{{}, false, hostname, {}};
+    Forwarder b{{}, false, hostname, {}, false};
     if (parseServer("[2606:4700:4700::1001]", 853, b.remote))
     {
         m_forwarders.emplace_back(std::move(b));
     }
-    Forwarder c{{}, false, hostname, {}};
+    Forwarder c{{}, false, hostname, {}, false};
     if (parseServer("1.1.1.1", 853, c.remote))
     {
         m_forwarders.emplace_back(std::move(c));
     }
-    Forwarder d{{}, false, hostname, {}};
+    Forwarder d{{}, false, hostname, {}, false};
     if (parseServer("1.0.0.1", 853, d.remote))
     {
         m_forwarders.emplace_back(std::move(d));
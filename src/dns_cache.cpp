@@ -0,0 +1,115 @@
+#include "dns_cache.h"
+#include "dns_packet.h"
+
+#include <algorithm>
+
+namespace dote {
+
+namespace {
+
+/// The response code for a successful response
+constexpr int NO_ERROR = 0;
+
+/// The response code for a name that doesn't exist
+constexpr int NAME_ERROR = 3;
+
+}  // anon namespace
+
+DnsCache::DnsCache(std::size_t maxEntries, unsigned int maxTtl) :
+    m_maxEntries(maxEntries),
+    m_maxTtl(maxTtl),
+    m_entries(),
+    m_index()
+{ }
+
+std::string DnsCache::key(const DnsPacket& request)
+{
+    std::string key;
+    if (!request.question(key))
+    {
+        return {};
+    }
+    key.push_back(request.dnssecOk() ? '\1' : '\0');
+    return key;
+}
+
+bool DnsCache::lookup(const std::string& key,
+                      const DnsPacket& request,
+                      std::vector<char>& response)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        return false;
+    }
+
+    auto entry = it->second;
+    auto age = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now() - entry->stored
+    ).count();
+    if (age >= entry->ttl)
+    {
+        m_index.erase(it);
+        m_entries.erase(entry);
+        return false;
+    }
+
+    // Most recently used moves to the front
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+
+    // Copy into the given buffer so that its memory is re-used
+    response.assign(entry->response.begin(), entry->response.end());
+    DnsPacket packet(std::move(response));
+    packet.setId(request.id());
+    // The name may have been asked with a different case to the request
+    // that was cached
+    (void) packet.copyQuestion(request);
+    packet.reduceTtls(static_cast<uint32_t>(age));
+    response = packet.move();
+    return true;
+}
+
+void DnsCache::store(const std::string& key, const std::vector<char>& response)
+{
+    if (key.empty() || m_maxEntries == 0u)
+    {
+        return;
+    }
+
+    DnsPacket packet(response);
+    uint32_t ttl;
+    int code = packet.responseCode();
+    if ((code != NO_ERROR && code != NAME_ERROR) || packet.truncated() ||
+            !packet.minimumTtl(ttl) || ttl == 0u)
+    {
+        return;
+    }
+    ttl = std::min(ttl, m_maxTtl);
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        it->second->response = response;
+        it->second->stored = std::chrono::steady_clock::now();
+        it->second->ttl = ttl;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+
+    if (m_entries.size() >= m_maxEntries)
+    {
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+    }
+    m_entries.push_front(Entry {
+        key, response, std::chrono::steady_clock::now(), ttl
+    });
+    m_index.emplace(key, m_entries.begin());
+}
+
+std::size_t DnsCache::size() const
+{
+    return m_entries.size();
+}
+
+}  // namespace dote
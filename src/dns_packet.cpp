@@ -2,6 +2,11 @@
 
 #include <arpa/inet.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+
 namespace dote {
 
 namespace {
@@ -25,6 +30,43 @@ constexpr unsigned short OPT = 41;
 /// The EDNS option for EDNS padding
 constexpr unsigned short PADDING = 12;
 
+/// The length of the type, class, TTL and data length of a record
+constexpr size_t RECORD_FIXED = 10u;
+
+/// The offset of the TTL in the fixed part of a record
+constexpr size_t RECORD_TTL = 4u;
+
+/// The offset of the data length in the fixed part of a record
+constexpr size_t RECORD_LENGTH = 8u;
+
+/// The offset of the EDNS flags in the fixed part of an OPT record
+constexpr size_t OPT_FLAGS = 6u;
+
+/// The DNSSEC OK bit in the first byte of the EDNS flags
+constexpr unsigned char DNSSEC_OK = 0x80;
+
+/// The truncated bit in the header flags
+constexpr unsigned short TRUNCATED = 0x0200;
+
+/// The response code bits in the header flags
+constexpr unsigned short RESPONSE_CODE = 0x000f;
+
+/// The header flags bit that marks a packet as a response
+constexpr unsigned short RESPONSE = 0x8000;
+
+/// The header flags bit to say that recursion is available
+constexpr unsigned short RECURSION_AVAILABLE = 0x0080;
+
+/// The header flags of a request that are copied to the response, which
+/// are the opcode, recursion desired and checking disabled bits
+constexpr unsigned short REQUEST_FLAGS = 0x7910;
+
+/// The response code for a server failure
+constexpr unsigned short SERVER_FAILURE = 2;
+
+/// The offset of the end of the ID in a TCP DNS packet
+constexpr size_t ID_END = offsetof(DnsHeader, flags);
+
 /// \brief  Get the DNS header from a packet
 ///
 /// \param packet  The packet to get the header from
@@ -62,7 +104,8 @@ std::vector<char>::const_iterator skipName(
         }
         else if ((*current & 0xc0) == 0xc0)
         {
-            return current + 2u;
+            // A pointer cut short by the end of the packet ends it
+            return end - current >= 2 ? current + 2u : end;
         }
         else if (end - current > *current + 1u)
         {
@@ -123,6 +166,33 @@ void setShort(
     *reinterpret_cast<unsigned short*>(&*it) = htons(value);
 }
 
+/// \brief  Get an unsigned 32-bit value from a given iterator
+///
+/// \tparam It  The type of the iterator
+///
+/// \param it  The iterator to read the value from
+///
+/// \return  The value read
+template<typename It>
+uint32_t getLong(It it)
+{
+    uint32_t value;
+    std::memcpy(&value, &*it, sizeof(value));
+    return ntohl(value);
+}
+
+/// \brief  Set an unsigned 32-bit value to a given iterator
+///
+/// \param it  The iterator to write the value to
+/// \param value  The value to set
+void setLong(
+        std::vector<char>::iterator it,
+        uint32_t value)
+{
+    value = htonl(value);
+    std::memcpy(&*it, &value, sizeof(value));
+}
+
 }  // anon namespace
 
 DnsPacket::DnsPacket(std::vector<char> packet) :
@@ -219,7 +289,7 @@ std::vector<char>::const_iterator DnsPacket::skipResponses(
     {
         it = skipName(it, m_packet.end());
         it = skipFixed(it, m_packet.end(), 8u);
-        if (m_packet.end() - it >= sizeof(unsigned short))
+        if (static_cast<size_t>(m_packet.end() - it) >= sizeof(unsigned short))
         {
             auto length = getShort(it);
             it += sizeof(unsigned short);
@@ -255,6 +325,209 @@ char* DnsPacket::data()
     return m_packet.data() + 2;
 }
 
+unsigned short DnsPacket::id() const
+{
+    if (m_packet.size() < ID_END)
+    {
+        return 0u;
+    }
+    return getShort(m_packet.cbegin() + sizeof(unsigned short));
+}
+
+void DnsPacket::setId(unsigned short id)
+{
+    if (m_packet.size() >= ID_END)
+    {
+        setShort(m_packet.begin() + sizeof(unsigned short), id);
+    }
+}
+
+bool DnsPacket::recordOffsets(std::vector<std::size_t>& offsets) const
+{
+    auto header = getHeader(m_packet);
+    if (header == nullptr)
+    {
+        return false;
+    }
+    auto end = m_packet.cend();
+    auto it = skipQueries(
+        ntohs(header->queries), m_packet.cbegin() + sizeof(DnsHeader)
+    );
+    unsigned int count = ntohs(header->answers) +
+        ntohs(header->authorities) + ntohs(header->additional);
+    while (count--)
+    {
+        it = skipName(it, end);
+        if (static_cast<size_t>(end - it) < RECORD_FIXED)
+        {
+            return false;
+        }
+        offsets.push_back(it - m_packet.cbegin());
+        size_t length = getShort(it + RECORD_LENGTH);
+        it += RECORD_FIXED;
+        if (static_cast<size_t>(end - it) < length)
+        {
+            return false;
+        }
+        it += length;
+    }
+    return true;
+}
+
+bool DnsPacket::question(std::string& question) const
+{
+    auto header = getHeader(m_packet);
+    if (header == nullptr || ntohs(header->queries) != 1u)
+    {
+        return false;
+    }
+    auto end = m_packet.cend();
+    auto it = m_packet.cbegin() + sizeof(DnsHeader);
+    question.clear();
+    while (true)
+    {
+        if (it == end)
+        {
+            return false;
+        }
+        unsigned char length = *it;
+        if (length == 0u)
+        {
+            question.push_back(*it++);
+            break;
+        }
+        // Compression isn't expected in the question of a request
+        if ((length & 0xc0) != 0 || end - it <= length)
+        {
+            return false;
+        }
+        question.push_back(*it++);
+        for (unsigned char i = 0u; i < length; ++i, ++it)
+        {
+            question.push_back(std::tolower(static_cast<unsigned char>(*it)));
+        }
+    }
+    // The type and class
+    if (end - it < 4)
+    {
+        return false;
+    }
+    question.append(it, it + 4);
+    return true;
+}
+
+bool DnsPacket::copyQuestion(const DnsPacket& request)
+{
+    auto header = getHeader(m_packet);
+    auto requestHeader = getHeader(request.m_packet);
+    if (header == nullptr || requestHeader == nullptr ||
+            ntohs(header->queries) != 1u || ntohs(requestHeader->queries) != 1u)
+    {
+        return false;
+    }
+    auto start = m_packet.cbegin() + sizeof(DnsHeader);
+    auto end = skipQueries(1u, start);
+    auto requestStart = request.m_packet.cbegin() + sizeof(DnsHeader);
+    auto requestEnd = request.skipQueries(1u, requestStart);
+    if (end - start != requestEnd - requestStart)
+    {
+        return false;
+    }
+    std::copy(requestStart, requestEnd, m_packet.begin() + sizeof(DnsHeader));
+    return true;
+}
+
+bool DnsPacket::dnssecOk() const
+{
+    std::vector<std::size_t> offsets;
+    (void) recordOffsets(offsets);
+    for (auto offset : offsets)
+    {
+        if (getShort(m_packet.cbegin() + offset) == OPT)
+        {
+            return (m_packet[offset + OPT_FLAGS] & DNSSEC_OK) != 0;
+        }
+    }
+    return false;
+}
+
+bool DnsPacket::truncated() const
+{
+    auto header = getHeader(m_packet);
+    return header != nullptr && (ntohs(header->flags) & TRUNCATED) != 0;
+}
+
+int DnsPacket::responseCode() const
+{
+    auto header = getHeader(m_packet);
+    return header == nullptr ? -1 : (ntohs(header->flags) & RESPONSE_CODE);
+}
+
+bool DnsPacket::setServerFailure()
+{
+    auto header = getHeader(m_packet);
+    if (header == nullptr)
+    {
+        return false;
+    }
+    auto end = skipQueries(
+        ntohs(header->queries), m_packet.cbegin() + sizeof(DnsHeader)
+    );
+    m_packet.resize(end - m_packet.cbegin());
+
+    auto response = reinterpret_cast<DnsHeader*>(m_packet.data());
+    response->length = htons(m_packet.size() - sizeof(response->length));
+    response->flags = htons(
+        (ntohs(response->flags) & REQUEST_FLAGS) |
+        RESPONSE | RECURSION_AVAILABLE | SERVER_FAILURE
+    );
+    response->answers = 0u;
+    response->authorities = 0u;
+    response->additional = 0u;
+    return true;
+}
+
+bool DnsPacket::minimumTtl(uint32_t& ttl) const
+{
+    std::vector<std::size_t> offsets;
+    if (!recordOffsets(offsets))
+    {
+        return false;
+    }
+    bool found = false;
+    for (auto offset : offsets)
+    {
+        auto it = m_packet.cbegin() + offset;
+        if (getShort(it) == OPT)
+        {
+            continue;
+        }
+        uint32_t recordTtl = getLong(it + RECORD_TTL);
+        if (!found || recordTtl < ttl)
+        {
+            ttl = recordTtl;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void DnsPacket::reduceTtls(uint32_t seconds)
+{
+    std::vector<std::size_t> offsets;
+    (void) recordOffsets(offsets);
+    for (auto offset : offsets)
+    {
+        auto it = m_packet.begin() + offset;
+        if (getShort(it) == OPT)
+        {
+            continue;
+        }
+        uint32_t ttl = getLong(it + RECORD_TTL);
+        setLong(it + RECORD_TTL, ttl > seconds ? ttl - seconds : 0u);
+    }
+}
+
 size_t DnsPacket::length() const
 {
     auto header = getHeader(m_packet);
@@ -1,102 +1,133 @@
 
 #include "dote.h"
+#include "worker.h"
 #include "log.h"
-#include "loop.h"
-#include "server.h"
 #include "config_parser.h"
-#include "client_forwarders.h"
-#include "forwarder_config.h"
-#include "openssl/context.h"
-#include "openssl/ssl_factory.h"
+#include "metrics.h"
+#include "stats_segment.h"
 
-#include <openssl/x509.h>
-#include <arpa/inet.h>
-#include <netinet/in.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <chrono>
+#include <thread>
 
 namespace dote {
 
-using namespace std::placeholders;
+namespace {
 
-Dote::Dote(const ConfigParser& config) :
-    m_loop(std::make_shared<Loop>()),
-    m_config(std::make_shared<ForwarderConfig>()),
-    m_context(std::make_shared<openssl::Context>(config.ciphers())),
-    m_forwarders(std::make_shared<ClientForwarders>(
-        m_loop,
-        m_config,
-        std::make_shared<openssl::SslFactory>(m_context),
-        config.maxConnections()
-    )),
-    m_server(nullptr),
-    m_cache(&X509_verify_cert, CACHE_SECONDS)
-{
-    setForwarders(config);
-    m_config->setTimeout(config.timeout());
-    m_context->setChainVerifier(std::bind(&VerifyCache::verify, &m_cache, _1));
-}
+/// The time between publishing the metrics in the shared memory segment
+constexpr std::chrono::milliseconds STATS_INTERVAL(100);
 
-void Dote::setForwarders(const ConfigParser& config)
+}  // anon namespace
+
+Dote::Dote(const ConfigParser& config) :
+    m_metrics(std::make_shared<Metrics>()),
+    m_workers(),
+    m_stats()
 {
-    m_config->clear();
-    for (const auto& forwarderConfig : config.forwarders())
+    for (unsigned int i = 0u; i < config.workers(); ++i)
     {
-        m_config->addForwarder(forwarderConfig);
+        m_workers.emplace_back(new Worker(config, m_metrics->shard()));
     }
 }
 
+Dote::~Dote() = default;
+
 bool Dote::listen(const ConfigParser& config)
 {
-    bool result = true;
-    m_server = std::make_shared<Server>(m_loop, m_forwarders);
-    for (const auto& serverConfig : config.servers())
+    // The workers share the ports so that the kernel spreads the
+    // clients between them
+    bool reusePort = m_workers.size() > 1u;
+    for (auto& worker : m_workers)
     {
-        char ip[64];
-        switch(serverConfig.address.ss_family) {
-            case AF_INET:
-                inet_ntop(AF_INET, &reinterpret_cast<const struct sockaddr_in&>(serverConfig.address).sin_addr, ip, sizeof(ip));
-                break;
-
-            case AF_INET6:
-                inet_ntop(AF_INET6, &reinterpret_cast<const struct sockaddr_in6&>(serverConfig.address).sin6_addr, ip, sizeof(ip));
-                break;
-            default:
-                ip[0] = '\0';
-                break;
-        }
-        if (!m_server->addServer(serverConfig))
+        if (!worker->listen(config, reusePort))
         {
-            Log::err << "Unable to bind to server port " << ip;
-            result = false;
+            return false;
         }
-        else
+    }
+    // The shards are summed when read, so only one worker needs to serve
+    // them
+    if (config.metricsAddress().ss_family != AF_UNSPEC && !m_workers.empty() &&
+            !m_workers.front()->serveMetrics(config.metricsAddress(), m_metrics))
+    {
+        return false;
+    }
+    if (!config.statsName().empty())
+    {
+        m_stats.reset(new StatsSegment(m_metrics));
+        if (!m_stats->open(config.statsName()))
         {
-            Log::info << "Bound server " << ip;
+            m_stats.reset();
+            return false;
         }
     }
-    if (!result)
+    return true;
+}
+
+void Dote::setForwarders(const ConfigParser& config)
+{
+    for (auto& worker : m_workers)
     {
-        m_server.reset();
+        worker->setForwarders(config);
     }
-    return result;
 }
 
 void Dote::run()
 {
-    if (m_loop)
+    if (m_workers.empty())
+    {
+        return;
+    }
+
+    // Signals are handled on this thread only, so block them while the
+    // other workers are started for them to inherit the mask
+    sigset_t signals;
+    sigset_t previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1u; i < m_workers.size(); ++i)
+    {
+        threads.emplace_back(&Worker::run, m_workers[i].get());
+    }
+    if (m_stats)
+    {
+        m_stats->start(STATS_INTERVAL);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    Log::info << "DoTe started and running with " << m_workers.size() <<
+        " worker" << (m_workers.size() == 1u ? "" : "s");
+    m_workers.front()->run();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    if (m_stats)
     {
-        Log::info << "DoTe started and running";
-        m_loop->run();
+        m_stats->stop();
     }
 }
 
 void Dote::shutdown()
 {
-    m_server.reset();
+    for (auto& worker : m_workers)
+    {
+        worker->shutdown();
+    }
+}
+
+std::shared_ptr<ILoop> Dote::looper()
+{
+    return m_workers.empty() ? nullptr : m_workers.front()->looper();
 }
 
-std::shared_ptr<Loop> Dote::looper()
+std::shared_ptr<Metrics> Dote::metrics()
 {
-    return m_loop;
+    return m_metrics;
 }
 
 }  // namespace dote
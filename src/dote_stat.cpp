@@ -0,0 +1,178 @@
+
+#include "stats_segment.h"
+#include "metrics.h"
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+/// The segment to read if none is given
+constexpr char DEFAULT_NAME[] = "/dote";
+
+/// \brief  Print the usage of the application
+///
+/// \param appName  The name of the executable
+void usage(const char* appName)
+{
+    std::cerr << "\n Usage: " << appName << " [OPTIONS]\n\n";
+    std::cerr << "  Options:\n";
+    std::cerr << "   -n --name  name           The statistics segment that DoTe was\n";
+    std::cerr << "                             started with --stats on, /dote if not\n";
+    std::cerr << "                             given.\n";
+    std::cerr << "   -i --interval  ms         Print the statistics again every\n";
+    std::cerr << "                             interval rather than once.\n";
+    std::cerr << "\n";
+}
+
+/// \brief  Get the time in microseconds that a share of the times in a
+///         histogram were within
+///
+/// \param counts    The count in each bucket
+/// \param total     The number of times in the histogram
+/// \param quantile  The share of the times, between zero and one
+///
+/// \return  The upper bound of the bucket the quantile falls in
+std::uint64_t quantile(const std::vector<std::uint64_t>& counts,
+                       std::uint64_t total,
+                       double quantile)
+{
+    std::uint64_t wanted = total * quantile;
+    std::uint64_t seen = 0u;
+    for (std::size_t bucket = 0u; bucket < counts.size(); ++bucket)
+    {
+        seen += counts[bucket];
+        if (seen > wanted)
+        {
+            return dote::Metrics::Histogram::upperBound(bucket);
+        }
+    }
+    return 0u;
+}
+
+/// \brief  Print a metric on a line of its own
+///
+/// \param metric  The metric to print
+void print(const dote::StatsReader::Metric& metric)
+{
+    std::cout << metric.name;
+    if (!metric.labels.empty())
+    {
+        std::cout << "{" << metric.labels << "}";
+    }
+    if (metric.values.empty())
+    {
+        std::cout << "\n";
+        return;
+    }
+    switch (metric.type)
+    {
+        case dote::StatsEntry::COUNTER:
+            std::cout << " " << metric.values[0] << "\n";
+            break;
+        case dote::StatsEntry::GAUGE:
+            std::cout << " " << static_cast<std::int64_t>(metric.values[0]) << "\n";
+            break;
+        case dote::StatsEntry::HISTOGRAM:
+        {
+            std::vector<std::uint64_t> counts(
+                metric.values.begin() + 1, metric.values.end()
+            );
+            std::uint64_t total = 0u;
+            for (auto count : counts)
+            {
+                total += count;
+            }
+            std::cout << " count=" << total;
+            if (total > 0u)
+            {
+                std::cout << " mean=" << metric.values[0] / total <<
+                    " p50=" << quantile(counts, total, 0.5) <<
+                    " p90=" << quantile(counts, total, 0.9) <<
+                    " p99=" << quantile(counts, total, 0.99);
+            }
+            std::cout << "\n";
+            break;
+        }
+        default:
+            std::cout << " unknown\n";
+            break;
+    }
+}
+
+}  // anon namespace
+
+int main(int argc, char* const argv[])
+{
+    static option long_options[] = {
+        {"name", required_argument, nullptr, 'n'},
+        {"interval", required_argument, nullptr, 'i'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    std::string name(DEFAULT_NAME);
+    long interval = 0;
+    int c;
+    while ((c = getopt_long(argc, argv, "n:i:", long_options, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                name = optarg;
+                break;
+            case 'i':
+            {
+                char* end;
+                interval = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end || interval < 1)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    dote::StatsReader reader;
+    if (!reader.open(name))
+    {
+        std::cerr << "Unable to open the statistics segment " << name << "\n";
+        return 1;
+    }
+
+    std::vector<dote::StatsReader::Metric> metrics;
+    do
+    {
+        std::uint64_t updated = 0u;
+        if (!reader.read(metrics, updated))
+        {
+            std::cerr << "Unable to read the statistics\n";
+            return 1;
+        }
+        std::cout << "# updated " << updated << "\n";
+        for (const auto& metric : metrics)
+        {
+            print(metric);
+        }
+        std::cout.flush();
+        if (interval > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        }
+    } while (interval > 0);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "epoll_loop.h"
+#include "log.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace dote {
+
+namespace {
+
+/// The maximum number of events to handle from a single wait
+constexpr int MAX_EVENTS = 64;
+
+}  // anon namespace
+
+EpollLoop::EpollLoop() :
+    HandleLoop(),
+    m_epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (m_epoll == -1)
+    {
+        Log::warn << "Unable to create epoll instance";
+    }
+}
+
+EpollLoop::~EpollLoop() noexcept
+{
+    if (m_epoll != -1)
+    {
+        close(m_epoll);
+    }
+}
+
+bool EpollLoop::valid() const
+{
+    return m_epoll != -1;
+}
+
+void EpollLoop::run()
+{
+    epoll_event events[MAX_EVENTS];
+    int currentTimeout = timeout();
+    while (m_epoll != -1 && active())
+    {
+        int count = epoll_wait(m_epoll, events, MAX_EVENTS, currentTimeout);
+        if (count < 0)
+        {
+            break;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            dispatch(
+                events[i].data.fd,
+                (events[i].events & EPOLLIN),
+                (events[i].events & EPOLLOUT),
+                (events[i].events & (EPOLLERR | EPOLLHUP))
+            );
+        }
+        currentTimeout = timeout();
+    }
+}
+
+bool EpollLoop::update(int handle, Handle& registration)
+{
+    if (!registration.read && !registration.write && !registration.except)
+    {
+        if (registration.key != 0u)
+        {
+            // May fail if the handle has already been closed, which is fine
+            (void) epoll_ctl(m_epoll, EPOLL_CTL_DEL, handle, nullptr);
+            registration.key = 0u;
+        }
+        return true;
+    }
+
+    uint32_t events = 0u;
+    if (registration.read)
+    {
+        events |= EPOLLIN;
+    }
+    if (registration.write)
+    {
+        events |= EPOLLOUT;
+    }
+    if (registration.key != 0u && registration.events == events)
+    {
+        return true;
+    }
+
+    epoll_event event {};
+    event.events = events;
+    event.data.fd = handle;
+    int result = epoll_ctl(
+        m_epoll,
+        registration.key != 0u ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+        handle,
+        &event
+    );
+    if (result == -1 && registration.key != 0u && errno == ENOENT)
+    {
+        // The handle was closed and re-opened without being removed
+        result = epoll_ctl(m_epoll, EPOLL_CTL_ADD, handle, &event);
+    }
+    if (result == -1)
+    {
+        return false;
+    }
+    registration.events = events;
+    registration.key = 1u;
+    return true;
+}
+
+}  // namespace dote
@@ -10,17 +10,30 @@
 
 namespace dote {
 
-ForwarderConfig::ForwarderConfig() :
-    m_timeout(5)
-{ }
+namespace {
 
-void ForwarderConfig::clear()
-{
-    Log::info << "Removed all forwarders";
-    m_forwarders.clear();
-}
+/// The weight given to a new measurement in the smoothed times
+constexpr double SMOOTHING = 0.125;
 
-void ForwarderConfig::addForwarder(const ConfigParser::Forwarder& config)
+/// How often a forwarder is chosen to be measured again rather than
+/// choosing the fastest
+constexpr unsigned int EXPLORE_INTERVAL = 32u;
+
+/// The default number of failures in a row to mark a forwarder down after
+constexpr unsigned int DEFAULT_FAILURE_THRESHOLD = 3u;
+
+/// The time to wait before first probing a forwarder that is marked down
+constexpr std::chrono::milliseconds INITIAL_BACKOFF(1000);
+
+/// The longest time to wait between probes of a forwarder
+constexpr std::chrono::milliseconds MAXIMUM_BACKOFF(60000);
+
+/// \brief  Format the address of a forwarder for logging
+///
+/// \param config  The forwarder to format
+///
+/// \return  The IP address of the forwarder
+std::string address(const ConfigParser::Forwarder& config)
 {
     char ip[64];
     switch(config.remote.ss_family) {
@@ -35,11 +48,291 @@ void ForwarderConfig::addForwarder(const ConfigParser::Forwarder& config)
             ip[0] = '\0';
             break;
     }
-    Log::info << "Adding forwarder " << ip;
+    return ip;
+}
+
+/// \brief  Get the label to tell the metrics of a forwarder apart
+///
+/// \param config  The forwarder to label
+///
+/// \return  The label with the address and port of the forwarder
+std::string label(const ConfigParser::Forwarder& config)
+{
+    unsigned short port = 0u;
+    if (config.remote.ss_family == AF_INET)
+    {
+        port = reinterpret_cast<const sockaddr_in&>(config.remote).sin_port;
+    }
+    else if (config.remote.ss_family == AF_INET6)
+    {
+        port = reinterpret_cast<const sockaddr_in6&>(config.remote).sin6_port;
+    }
+    std::string ip = address(config);
+    if (config.remote.ss_family == AF_INET6)
+    {
+        ip = "[" + ip + "]";
+    }
+    return "forwarder=\"" + ip + ":" + std::to_string(ntohs(port)) + "\"";
+}
+
+/// \brief  Add a measurement to a smoothed time
+///
+/// \param smoothed  The smoothed time, negative if not yet measured
+/// \param time      The new measurement
+void smooth(double& smoothed, std::chrono::microseconds time)
+{
+    double value = static_cast<double>(time.count());
+    if (smoothed < 0.0)
+    {
+        smoothed = value;
+    }
+    else
+    {
+        smoothed += SMOOTHING * (value - smoothed);
+    }
+}
+
+}  // anon namespace
+
+ForwarderConfig::ForwarderConfig(std::shared_ptr<Metrics> metrics) :
+    m_timeout(5),
+    m_failureThreshold(DEFAULT_FAILURE_THRESHOLD),
+    m_idleTimeout(10),
+    m_earlyData(false),
+    m_metrics(std::move(metrics)),
+    m_earlyDataSent(&m_metrics->counter(
+        "dote_early_data_total",
+        "Requests that were accepted as TLS early data"
+    )),
+    m_kernelTlsConnections(&m_metrics->counter(
+        "dote_kernel_tls_connections_total",
+        "Forwarder connections with encryption offloaded to the kernel"
+    )),
+    m_forwarders(),
+    m_stats(),
+    m_chosen(0u)
+{ }
+
+void ForwarderConfig::clear()
+{
+    Log::info << "Removed all forwarders";
+    for (auto& stats : m_stats)
+    {
+        if (stats.down)
+        {
+            stats.markedDown->add(-1);
+        }
+    }
+    m_forwarders.clear();
+    m_stats.clear();
+}
+
+void ForwarderConfig::addForwarder(const ConfigParser::Forwarder& config)
+{
+    Log::info << "Adding forwarder " << address(config);
     m_forwarders.push_back(config);
+    m_stats.push_back(Stats {
+        -1.0, -1.0, false, std::chrono::steady_clock::time_point(),
+        0u, false, INITIAL_BACKOFF, std::chrono::steady_clock::time_point(),
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+    });
+    registerMetrics(config, m_stats.back());
+}
+
+void ForwarderConfig::registerMetrics(const ConfigParser::Forwarder& config,
+                                      Stats& stats)
+{
+    std::string labels = label(config);
+    stats.connectTimes = &m_metrics->histogram(
+        "dote_forwarder_connect_microseconds",
+        "Time to make the TCP connection to a forwarder", labels
+    );
+    stats.handshakeTimes = &m_metrics->histogram(
+        "dote_forwarder_handshake_microseconds",
+        "Time to connect and complete the TLS handshake with a forwarder",
+        labels
+    );
+    stats.resumptions = &m_metrics->counter(
+        "dote_forwarder_resumptions_total",
+        "TLS handshakes with a forwarder that resumed a session", labels
+    );
+    stats.firstByteTimes = &m_metrics->histogram(
+        "dote_forwarder_first_byte_microseconds",
+        "Time from sending a request to the first byte of the response",
+        labels
+    );
+    stats.responseTimes = &m_metrics->histogram(
+        "dote_forwarder_response_microseconds",
+        "Time from sending a request to the whole response", labels
+    );
+    stats.errors = &m_metrics->counter(
+        "dote_forwarder_errors_total",
+        "Connections to a forwarder that failed", labels
+    );
+    stats.markedDown = &m_metrics->gauge(
+        "dote_forwarder_down",
+        "Workers that have a forwarder marked down", labels
+    );
+}
+
+ForwarderConfig::Stats* ForwarderConfig::find(const ConfigParser::Forwarder& config)
+{
+    for (std::size_t i = 0u; i < m_forwarders.size(); ++i)
+    {
+        if (memcmp(&m_forwarders[i].remote, &config.remote, sizeof(config.remote)) == 0)
+        {
+            return &m_stats[i];
+        }
+    }
+    return nullptr;
+}
+
+const ForwarderConfig::Stats* ForwarderConfig::find(
+        const ConfigParser::Forwarder& config) const
+{
+    return const_cast<ForwarderConfig*>(this)->find(config);
+}
+
+double ForwarderConfig::expected(const Stats& stats)
+{
+    // The handshake is paid once per connection, so prefer the response
+    // time but use the handshake if there have been no responses yet
+    return stats.response >= 0.0 ? stats.response : stats.handshake;
+}
+
+void ForwarderConfig::setHandshakeTime(const ConfigParser::Forwarder& config,
+                                       std::chrono::microseconds time)
+{
+    auto stats = find(config);
+    if (stats)
+    {
+        stats->handshakeTimes->record(time);
+        smooth(stats->handshake, time);
+        stats->bad = false;
+        stats->failures = 0u;
+        stats->updated = std::chrono::steady_clock::now();
+    }
+}
+
+void ForwarderConfig::setConnectTime(const ConfigParser::Forwarder& config,
+                                     std::chrono::microseconds time)
+{
+    auto stats = find(config);
+    if (stats)
+    {
+        stats->connectTimes->record(time);
+    }
+}
+
+void ForwarderConfig::setFirstByteTime(const ConfigParser::Forwarder& config,
+                                       std::chrono::microseconds time)
+{
+    auto stats = find(config);
+    if (stats)
+    {
+        stats->firstByteTimes->record(time);
+    }
+}
+
+void ForwarderConfig::setResponseTime(const ConfigParser::Forwarder& config,
+                                      std::chrono::microseconds time)
+{
+    auto stats = find(config);
+    if (stats)
+    {
+        stats->responseTimes->record(time);
+        smooth(stats->response, time);
+        stats->bad = false;
+        stats->failures = 0u;
+        stats->updated = std::chrono::steady_clock::now();
+    }
 }
 
 std::vector<ConfigParser::Forwarder>::const_iterator ForwarderConfig::get() const
+{
+    if (m_forwarders.size() < 2u)
+    {
+        return m_forwarders.cbegin();
+    }
+
+    if (++m_chosen % EXPLORE_INTERVAL == 0u)
+    {
+        // Measure the forwarder that has gone longest without
+        // a measurement, which may have recovered or sped up, leaving
+        // those marked down to the probes
+        std::size_t oldest = m_stats.size();
+        for (std::size_t i = 0u; i < m_stats.size(); ++i)
+        {
+            if (!m_stats[i].down &&
+                    (oldest == m_stats.size() ||
+                     m_stats[i].updated < m_stats[oldest].updated))
+            {
+                oldest = i;
+            }
+        }
+        if (oldest != m_stats.size())
+        {
+            return m_forwarders.cbegin() + oldest;
+        }
+    }
+
+    std::size_t chosen = fastest(nullptr);
+    if (chosen == m_stats.size())
+    {
+        // Everything has failed, so try them in turn
+        chosen = 0u;
+    }
+    return m_forwarders.cbegin() + chosen;
+}
+
+std::vector<ConfigParser::Forwarder>::const_iterator ForwarderConfig::getAlternative(
+        const ConfigParser::Forwarder& exclude) const
+{
+    std::size_t chosen = fastest(&exclude);
+    if (chosen == m_stats.size())
+    {
+        // Nothing else is healthy, but a failed forwarder is still
+        // worth trying rather than not trying at all
+        for (std::size_t i = 0u; i < m_forwarders.size(); ++i)
+        {
+            if (memcmp(&m_forwarders[i].remote, &exclude.remote, sizeof(exclude.remote)) != 0)
+            {
+                chosen = i;
+                break;
+            }
+        }
+    }
+    return m_forwarders.cbegin() + chosen;
+}
+
+std::size_t ForwarderConfig::fastest(const ConfigParser::Forwarder* exclude) const
+{
+    // Choose the fastest healthy forwarder, or the first healthy one
+    // if none have been measured, in the order setBad leaves them
+    std::size_t chosen = m_stats.size();
+    for (std::size_t i = 0u; i < m_stats.size(); ++i)
+    {
+        if (m_stats[i].bad || m_stats[i].down ||
+                (exclude != nullptr &&
+                 memcmp(&m_forwarders[i].remote, &exclude->remote, sizeof(exclude->remote)) == 0))
+        {
+            continue;
+        }
+        if (chosen == m_stats.size())
+        {
+            chosen = i;
+        }
+        else if (expected(m_stats[i]) >= 0.0 &&
+                (expected(m_stats[chosen]) < 0.0 ||
+                 expected(m_stats[i]) < expected(m_stats[chosen])))
+        {
+            chosen = i;
+        }
+    }
+    return chosen;
+}
+
+std::vector<ConfigParser::Forwarder>::const_iterator ForwarderConfig::begin() const
 {
     return m_forwarders.cbegin();
 }
@@ -56,12 +349,78 @@ void ForwarderConfig::setBad(const ConfigParser::Forwarder& config)
     {
         if (memcmp(&it->remote, &config.remote, sizeof(config.remote)) == 0)
         {
+            auto stats = m_stats.begin() + (it - m_forwarders.begin());
+            stats->bad = true;
+            stats->errors->add();
+            ++stats->failures;
+            if (!stats->down && m_failureThreshold > 0u &&
+                    stats->failures >= m_failureThreshold)
+            {
+                // Stop sending requests to it until a probe succeeds
+                Log::warn << "Forwarder " << address(*it) << " marked down after " <<
+                    stats->failures << " failures";
+                stats->down = true;
+                stats->markedDown->add(1);
+                stats->backoff = INITIAL_BACKOFF;
+                stats->probe = std::chrono::steady_clock::now() + stats->backoff;
+            }
             std::rotate(it, it + 1, m_forwarders.end());
+            std::rotate(stats, stats + 1, m_stats.end());
             break;
         }
     }
 }
 
+bool ForwarderConfig::healthy(const ConfigParser::Forwarder& config) const
+{
+    auto stats = find(config);
+    return stats == nullptr || !stats->down;
+}
+
+void ForwarderConfig::setFailureThreshold(unsigned int threshold)
+{
+    m_failureThreshold = threshold;
+}
+
+std::vector<ConfigParser::Forwarder> ForwarderConfig::dueForProbe()
+{
+    std::vector<ConfigParser::Forwarder> due;
+    auto now = std::chrono::steady_clock::now();
+    for (std::size_t i = 0u; i < m_stats.size(); ++i)
+    {
+        if (m_stats[i].down && m_stats[i].probe <= now)
+        {
+            m_stats[i].probe = std::chrono::steady_clock::time_point::max();
+            due.push_back(m_forwarders[i]);
+        }
+    }
+    return due;
+}
+
+void ForwarderConfig::setProbeResult(const ConfigParser::Forwarder& config,
+                                     bool success)
+{
+    auto stats = find(config);
+    if (stats == nullptr || !stats->down)
+    {
+        return;
+    }
+    if (success)
+    {
+        Log::notice << "Forwarder " << address(config) << " restored";
+        stats->down = false;
+        stats->markedDown->add(-1);
+        stats->bad = false;
+        stats->failures = 0u;
+        stats->updated = std::chrono::steady_clock::now();
+    }
+    else
+    {
+        stats->backoff = std::min(stats->backoff * 2, MAXIMUM_BACKOFF);
+        stats->probe = std::chrono::steady_clock::now() + stats->backoff;
+    }
+}
+
 void ForwarderConfig::setTimeout(unsigned int timeout)
 {
     m_timeout = timeout;
@@ -72,4 +431,53 @@ unsigned int ForwarderConfig::timeout() const
     return m_timeout;
 }
 
+void ForwarderConfig::setIdleTimeout(unsigned int timeout)
+{
+    m_idleTimeout = timeout;
+}
+
+unsigned int ForwarderConfig::idleTimeout() const
+{
+    return m_idleTimeout;
+}
+
+void ForwarderConfig::setEarlyData(bool earlyData)
+{
+    m_earlyData = earlyData;
+}
+
+bool ForwarderConfig::earlyData() const
+{
+    return m_earlyData;
+}
+
+void ForwarderConfig::addEarlyData()
+{
+    m_earlyDataSent->add();
+}
+
+std::size_t ForwarderConfig::earlyDataSent() const
+{
+    return m_earlyDataSent->value();
+}
+
+void ForwarderConfig::addKernelTls()
+{
+    m_kernelTlsConnections->add();
+}
+
+std::size_t ForwarderConfig::kernelTlsConnections() const
+{
+    return m_kernelTlsConnections->value();
+}
+
+void ForwarderConfig::addResumption(const ConfigParser::Forwarder& config)
+{
+    auto stats = find(config);
+    if (stats)
+    {
+        stats->resumptions->add();
+    }
+}
+
 }  // namespace dote
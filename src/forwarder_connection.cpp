@@ -5,48 +5,127 @@
 #include "openssl/i_ssl_factory.h"
 #include "openssl/spki_verifier.h"
 #include "socket.h"
+#include "packet_pool.h"
 #include "log.h"
 
+#include <algorithm>
+
 namespace dote {
 
+namespace {
+
+/// \brief  Get the DNS ID of a TCP framed message
+///
+/// \param frame  The message with its length in front
+///
+/// \return  The ID of the message, zero if it is too short to have one
+unsigned short frameId(const std::vector<char>& frame)
+{
+    if (frame.size() < 4u)
+    {
+        return 0u;
+    }
+    return (static_cast<unsigned char>(frame[2]) << 8) |
+        static_cast<unsigned char>(frame[3]);
+}
+
+}  // anon namespace
+
 using namespace std::placeholders;
 
 ForwarderConnection::ForwarderConnection(std::shared_ptr<ILoop> loop,
                                          std::shared_ptr<IForwarderConfig> config,
-                                         std::shared_ptr<openssl::ISslFactory> ssl) :
-    m_timeout(time(nullptr) + config->timeout()),
+                                         std::shared_ptr<openssl::ISslFactory> ssl,
+                                         std::shared_ptr<PacketPool> pool) :
     m_loop(std::move(loop)),
     m_config(std::move(config)),
     m_connection(ssl->create()),
+    m_pool(std::move(pool)),
     m_state(CONNECTING),
-    m_socket(nullptr)
+    m_earlyData(NO_EARLY_DATA),
+    m_socket(nullptr),
+    m_pending(),
+    m_alive(std::make_shared<bool>(true)),
+    m_connectStart(std::chrono::steady_clock::now()),
+    m_connected(false),
+    m_firstByte()
 {
     auto chosen = m_config->get();
-    if (m_connection && chosen != m_config->end())
+    if (chosen != m_config->end())
+    {
+        start(*chosen);
+    }
+    else
+    {
+        m_state = CLOSED;
+    }
+}
+
+ForwarderConnection::ForwarderConnection(std::shared_ptr<ILoop> loop,
+                                         std::shared_ptr<IForwarderConfig> config,
+                                         std::shared_ptr<openssl::ISslFactory> ssl,
+                                         std::shared_ptr<PacketPool> pool,
+                                         const ConfigParser::Forwarder& forwarder) :
+    m_loop(std::move(loop)),
+    m_config(std::move(config)),
+    m_connection(ssl->create()),
+    m_pool(std::move(pool)),
+    m_state(CONNECTING),
+    m_earlyData(NO_EARLY_DATA),
+    m_socket(nullptr),
+    m_pending(),
+    m_alive(std::make_shared<bool>(true)),
+    m_connectStart(std::chrono::steady_clock::now()),
+    m_connected(false),
+    m_firstByte()
+{
+    start(forwarder);
+}
+
+void ForwarderConnection::start(const ConfigParser::Forwarder& forwarder)
+{
+    if (!m_connection)
     {
-        m_forwarder = *chosen;
+        m_state = CLOSED;
+        return;
+    }
+
+    m_forwarder = forwarder;
 
-        configureVerifier();
+    configureVerifier();
+    m_connection->setServer(m_forwarder.remote, m_forwarder.host);
 
-        m_socket = Socket::connect(m_forwarder.remote, Socket::Type::TCP);
+    m_socket = Socket::connect(
+        m_forwarder.remote, Socket::Type::TCP, m_forwarder.fastOpen
+    );
 
-        if (m_socket)
+    if (m_socket)
+    {
+        m_connection->setSocket(m_socket->get());
+        m_exception = m_loop->registerException(
+            m_socket->get(),
+            std::bind(&ForwarderConnection::exception, this, _1)
+        );
+        resetTimeout(m_config->timeout());
+        if (m_config->earlyData() && m_connection->maxEarlyData() > 0u)
         {
-            m_connection->setSocket(m_socket->get());
-            m_exception = m_loop->registerException(
+            // Wait for the socket to connect so that the first request
+            // has been queued and can be sent along with the handshake
+            m_earlyData = EARLY_DATA_PENDING;
+            m_write = m_loop->registerWrite(
                 m_socket->get(),
-                std::bind(&ForwarderConnection::exception, this, _1)
+                std::bind(&ForwarderConnection::connect, this, _1),
+                0
             );
-            connect(m_socket->get());
         }
         else
         {
-            m_config->setBad(m_forwarder);
-            m_state = CLOSED;
+            connect(m_socket->get());
         }
     }
     else
     {
+        m_config->setBad(m_forwarder);
         m_state = CLOSED;
     }
 }
@@ -86,9 +165,72 @@ bool ForwarderConnection::closed()
     return (m_state == SHUTTING_DOWN || m_state == CLOSED);
 }
 
+bool ForwarderConnection::open() const
+{
+    return m_state == OPEN;
+}
+
+bool ForwarderConnection::idle() const
+{
+    return (m_state == CONNECTING || m_state == OPEN) && m_pending.empty();
+}
+
+std::size_t ForwarderConnection::outstanding() const
+{
+    return m_pending.size();
+}
+
+const ConfigParser::Forwarder& ForwarderConnection::forwarder() const
+{
+    return m_forwarder;
+}
+
+std::chrono::steady_clock::time_point ForwarderConnection::firstByte() const
+{
+    return m_firstByte;
+}
+
+bool ForwarderConnection::canSendEarlyData()
+{
+    return !m_buffers.empty() &&
+        m_buffers.front().size() <= m_connection->maxEarlyData();
+}
+
 void ForwarderConnection::connect(int handle)
 {
-    switch (m_connection->connect())
+    auto result = openssl::SslConnection::Result::FATAL;
+    if (m_earlyData == EARLY_DATA_PENDING && canSendEarlyData())
+    {
+        result = m_connection->writeEarlyData(m_buffers.front());
+        if (result == openssl::SslConnection::Result::SUCCESS)
+        {
+            m_earlyData = EARLY_DATA_SENT;
+            result = m_connection->connect();
+        }
+    }
+    else
+    {
+        if (m_earlyData == EARLY_DATA_PENDING)
+        {
+            m_earlyData = NO_EARLY_DATA;
+        }
+        result = m_connection->connect();
+    }
+
+    if (!m_connected && (result == openssl::SslConnection::Result::NEED_READ ||
+            result == openssl::SslConnection::Result::SUCCESS))
+    {
+        // The start of the handshake has been sent, so it's connected
+        m_connected = true;
+        m_config->setConnectTime(
+            m_forwarder,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - m_connectStart
+            )
+        );
+    }
+
+    switch (result)
     {
         case openssl::SslConnection::Result::NEED_READ:
             if (!m_read)
@@ -96,7 +238,7 @@ void ForwarderConnection::connect(int handle)
                 m_read = m_loop->registerRead(
                     m_socket->get(),
                     std::bind(&ForwarderConnection::connect, this, _1),
-                    m_timeout
+                    0
                 );
             }
             m_write.reset();
@@ -107,29 +249,57 @@ void ForwarderConnection::connect(int handle)
                 m_write = m_loop->registerWrite(
                     m_socket->get(),
                     std::bind(&ForwarderConnection::connect, this, _1),
-                    m_timeout
+                    0
                 );
             }
             m_read.reset();
             break;
         case openssl::SslConnection::Result::SUCCESS:
+            m_config->setHandshakeTime(
+                m_forwarder,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - m_connectStart
+                )
+            );
+            if (m_earlyData == EARLY_DATA_SENT)
+            {
+                if (m_connection->earlyDataAccepted())
+                {
+                    m_pool->release(std::move(m_buffers.front()));
+                    m_buffers.pop_front();
+                    m_config->addEarlyData();
+                }
+                // Otherwise it is written again now the handshake is done
+                m_earlyData = NO_EARLY_DATA;
+            }
+            if (m_connection->kernelTls())
+            {
+                m_config->addKernelTls();
+            }
+            if (m_connection->sessionResumed())
+            {
+                m_config->addResumption(m_forwarder);
+            }
             // Remove the handlers to add the running ones.
             m_read.reset();
             m_write.reset();
             m_read = m_loop->registerRead(
                 m_socket->get(),
                 std::bind(&ForwarderConnection::incoming, this, _1),
-                m_timeout
+                0
             );
-            if (!m_buffer.empty())
+            if (!m_buffers.empty())
             {
                 m_write = m_loop->registerWrite(
                     m_socket->get(),
                     std::bind(&ForwarderConnection::outgoing, this, _1),
-                    m_timeout
+                    0
                 );
             }
             m_state = State::OPEN;
+            // Opened ahead of any requests it is already idle, otherwise
+            // the requests queued while connecting have their deadlines
+            resetDeadline();
             break;
         case openssl::SslConnection::Result::FATAL:
             Log::notice << "Error handshaking with forwarder";
@@ -143,29 +313,94 @@ void ForwarderConnection::connect(int handle)
 
 void ForwarderConnection::incoming(int handle)
 {
-    std::vector<char> buffer;
-    switch (m_connection->read(buffer))
+    constexpr std::size_t SIZE_LENGTH = sizeof(unsigned short);
+    // Keep reading until OpenSSL has no more buffered data otherwise
+    // the poll won't wake us for the data it is holding on to
+    while (true)
     {
-        case openssl::SslConnection::Result::NEED_READ:
-            // Nothing required to do, we're always the read handler
-            break;
-        case openssl::SslConnection::Result::NEED_WRITE:
-            // Probably will be fine if we ignore this
-            break;
-        case openssl::SslConnection::Result::SUCCESS:
-            if (!buffer.empty() && m_incoming)
+        // Read the length and then exactly the rest of the response so
+        // that each one is read straight into a buffer of its own
+        std::size_t filled = m_readBuffer.size();
+        std::size_t wanted = SIZE_LENGTH;
+        if (filled >= SIZE_LENGTH)
+        {
+            wanted += (static_cast<unsigned char>(m_readBuffer[0]) << 8) |
+                static_cast<unsigned char>(m_readBuffer[1]);
+            if (filled == wanted)
             {
-                m_incoming(*this, std::move(buffer));
+                if (!handleFrame() || m_state != State::OPEN)
+                {
+                    return;
+                }
+                continue;
             }
-            break;
-        case openssl::SslConnection::Result::FATAL:
-            Log::notice << "Error reading from forwarder";
-            m_config->setBad(m_forwarder);
-            // Fall through to closed
-        case openssl::SslConnection::Result::CLOSED:
-            close();
-            break;
+        }
+
+        std::size_t length = 0u;
+        m_readBuffer.resize(wanted);
+        auto result = m_connection->read(
+            m_readBuffer.data() + filled, wanted - filled, length
+        );
+        m_readBuffer.resize(filled + length);
+        if (filled == 0u && length > 0u)
+        {
+            m_firstByte = std::chrono::steady_clock::now();
+        }
+        switch (result)
+        {
+            case openssl::SslConnection::Result::NEED_READ:
+                // Nothing required to do, we're always the read handler
+                return;
+            case openssl::SslConnection::Result::NEED_WRITE:
+                // Probably will be fine if we ignore this
+                return;
+            case openssl::SslConnection::Result::SUCCESS:
+                break;
+            case openssl::SslConnection::Result::FATAL:
+                Log::notice << "Error reading from forwarder";
+                m_config->setBad(m_forwarder);
+                // Fall through to closed
+            case openssl::SslConnection::Result::CLOSED:
+                close();
+                return;
+        }
+    }
+}
+
+bool ForwarderConnection::handleFrame()
+{
+    std::weak_ptr<bool> alive(m_alive);
+    std::vector<char> frame(std::move(m_readBuffer));
+    m_readBuffer = m_pool->acquire();
+
+    // A response has arrived, the deadline only moves if it was for the
+    // oldest request so a forwarder that stops answering some of them
+    // still times out however many more are sent
+    unsigned short id = frameId(frame);
+    auto pending = std::find_if(
+        m_pending.begin(), m_pending.end(),
+        [id](const Pending& request) { return request.id == id; }
+    );
+    if (pending != m_pending.end())
+    {
+        bool oldest = pending == m_pending.begin();
+        m_pending.erase(pending);
+        if (oldest)
+        {
+            resetDeadline();
+        }
     }
+
+    if (m_incoming)
+    {
+        m_incoming(*this, std::move(frame));
+        // The callback may have deleted this
+        if (alive.expired())
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
 void ForwarderConnection::shutdown()
@@ -189,7 +424,7 @@ void ForwarderConnection::_shutdown(int handle)
                 m_read = m_loop->registerRead(
                     m_socket->get(),
                     std::bind(&ForwarderConnection::_shutdown, this, _1),
-                    m_timeout
+                    0
                 );
             }
             m_write.reset();
@@ -200,7 +435,7 @@ void ForwarderConnection::_shutdown(int handle)
                 m_write = m_loop->registerWrite(
                     m_socket->get(),
                     std::bind(&ForwarderConnection::_shutdown, this, _1),
-                    m_timeout
+                    0
                 );
             }
             m_read.reset();
@@ -222,45 +457,92 @@ bool ForwarderConnection::send(std::vector<char> buffer)
         return false;
     }
 
-    if (m_buffer.empty())
+    bool waiting = !m_pending.empty();
+    m_pending.push_back(Pending {
+        frameId(buffer),
+        std::chrono::steady_clock::now() + std::chrono::seconds(m_config->timeout())
+    });
+    if (m_buffers.size() > 1u)
     {
-        if (m_state == State::OPEN && !m_write)
-        {
-            m_write = m_loop->registerWrite(
-                m_socket->get(),
-                std::bind(&ForwarderConnection::outgoing, this, _1),
-                m_timeout
-            );
-        }
-        m_buffer = std::move(buffer);
-        return true;
+        // Merge with the last waiting request so they go in one write
+        m_buffers.back().insert(
+            m_buffers.back().end(), buffer.begin(), buffer.end()
+        );
+        m_pool->release(std::move(buffer));
+    }
+    else
+    {
+        m_buffers.emplace_back(std::move(buffer));
+    }
+    if (m_state == State::OPEN && !waiting)
+    {
+        // While connecting the connection has its own time to give up,
+        // and otherwise the oldest request's deadline is still running
+        resetTimeout(m_config->timeout());
+    }
+    if (m_state == State::OPEN && !m_write)
+    {
+        m_write = m_loop->registerWrite(
+            m_socket->get(),
+            std::bind(&ForwarderConnection::outgoing, this, _1),
+            0
+        );
     }
+    return true;
+}
 
-    return false;
+void ForwarderConnection::resetTimeout(unsigned int seconds)
+{
+    m_timer.reset();
+    m_timer = m_loop->registerTimer(
+        std::chrono::seconds(seconds),
+        std::bind(&ForwarderConnection::timedOut, this, _1)
+    );
+}
+
+void ForwarderConnection::resetDeadline()
+{
+    if (m_pending.empty())
+    {
+        resetTimeout(m_config->idleTimeout());
+        return;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_pending.front().deadline - std::chrono::steady_clock::now()
+    );
+    m_timer.reset();
+    m_timer = m_loop->registerTimer(
+        std::max(remaining, std::chrono::milliseconds(0)),
+        std::bind(&ForwarderConnection::timedOut, this, _1)
+    );
 }
 
 void ForwarderConnection::outgoing(int handle)
 {
-    switch (m_connection->write(m_buffer))
+    while (!m_buffers.empty())
     {
-        case openssl::SslConnection::Result::NEED_READ:
-            // Probably fine to ignore like the incoming
-            break;
-        case openssl::SslConnection::Result::NEED_WRITE:
-            // Nothing required to do, we're always the write handler
-            break;
-        case openssl::SslConnection::Result::SUCCESS:
-            m_buffer.clear();
-            m_write.reset();
-            break;
-        case openssl::SslConnection::Result::FATAL:
-            Log::notice << "Error writing to forwarder";
-            m_config->setBad(m_forwarder);
-            // Fall through to closed
-        case openssl::SslConnection::Result::CLOSED:
-            close();
-            break;
+        switch (m_connection->write(m_buffers.front()))
+        {
+            case openssl::SslConnection::Result::NEED_READ:
+                // Probably fine to ignore like the incoming
+                return;
+            case openssl::SslConnection::Result::NEED_WRITE:
+                // Nothing required to do, we're always the write handler
+                return;
+            case openssl::SslConnection::Result::SUCCESS:
+                m_pool->release(std::move(m_buffers.front()));
+                m_buffers.pop_front();
+                break;
+            case openssl::SslConnection::Result::FATAL:
+                Log::notice << "Error writing to forwarder";
+                m_config->setBad(m_forwarder);
+                // Fall through to closed
+            case openssl::SslConnection::Result::CLOSED:
+                close();
+                return;
+        }
     }
+    m_write.reset();
 }
 
 void ForwarderConnection::exception(int handle)
@@ -273,6 +555,12 @@ void ForwarderConnection::exception(int handle)
     close();
 }
 
+void ForwarderConnection::timedOut(int)
+{
+    Log::info << "Timeout";
+    exception(m_socket ? m_socket->get() : -1);
+}
+
 void ForwarderConnection::close()
 {
     if (m_socket)
@@ -281,6 +569,7 @@ void ForwarderConnection::close()
         m_read.reset();
         m_write.reset();
         m_exception.reset();
+        m_timer.reset();
         m_state = State::CLOSED;
         m_socket.reset();
 
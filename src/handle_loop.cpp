@@ -0,0 +1,231 @@
+#include "handle_loop.h"
+#include "log.h"
+
+#include <vector>
+
+namespace dote {
+
+HandleLoop::HandleLoop() :
+    m_handles(),
+    m_nextTimeout(0),
+    m_timers()
+{ }
+
+HandleLoop::Callback& HandleLoop::callback(Handle& handle, Type type)
+{
+    switch (type)
+    {
+        case Type::Read:
+            return handle.read;
+        case Type::Write:
+            return handle.write;
+        default:
+            return handle.except;
+    }
+}
+
+ILoop::Registration HandleLoop::add(int handle, Type type, Callback function, time_t timeout)
+{
+    auto it = m_handles.find(handle);
+    if (it == m_handles.end())
+    {
+        it = m_handles.emplace(
+            handle, Handle { {}, 0, {}, 0, {}, 0u, 0u }
+        ).first;
+    }
+    else if (callback(it->second, type))
+    {
+        return {};
+    }
+
+    callback(it->second, type) = std::move(function);
+    if (type == Type::Read)
+    {
+        it->second.readTimeout = timeout;
+    }
+    else if (type == Type::Write)
+    {
+        it->second.writeTimeout = timeout;
+    }
+
+    if (!update(handle, it->second))
+    {
+        Log::warn << "Unable to register handle with the kernel";
+        remove(handle, type);
+        return {};
+    }
+    addTimeout(timeout);
+    return Registration(this, handle, type);
+}
+
+ILoop::Registration HandleLoop::registerRead(int handle, Callback callback, time_t timeout)
+{
+    return add(handle, Type::Read, std::move(callback), timeout);
+}
+
+ILoop::Registration HandleLoop::registerWrite(int handle, Callback callback, time_t timeout)
+{
+    return add(handle, Type::Write, std::move(callback), timeout);
+}
+
+ILoop::Registration HandleLoop::registerException(int handle, Callback callback)
+{
+    // Nothing to register for, the kernel always reports exceptions
+    return add(handle, Type::Exception, std::move(callback), 0);
+}
+
+ILoop::Registration HandleLoop::registerTimer(std::chrono::milliseconds delay, Callback callback)
+{
+    return Registration(this, m_timers.add(delay, std::move(callback)), Type::Timer);
+}
+
+ILoop::Registration HandleLoop::registerDeferred(Callback callback)
+{
+    return Registration(this, m_timers.defer(std::move(callback)), Type::Timer);
+}
+
+void HandleLoop::remove(int handle, Type type)
+{
+    auto it = m_handles.find(handle);
+    if (it != m_handles.end())
+    {
+        callback(it->second, type) = nullptr;
+        (void) apply(it);
+    }
+}
+
+void HandleLoop::removeRead(int handle)
+{
+    remove(handle, Type::Read);
+}
+
+void HandleLoop::removeWrite(int handle)
+{
+    remove(handle, Type::Write);
+}
+
+void HandleLoop::removeException(int handle)
+{
+    remove(handle, Type::Exception);
+}
+
+void HandleLoop::removeTimer(int id)
+{
+    m_timers.remove(id);
+}
+
+bool HandleLoop::active() const
+{
+    return !m_handles.empty() || m_timers.pending();
+}
+
+bool HandleLoop::apply(std::unordered_map<int, Handle>::iterator it)
+{
+    bool result = update(it->first, it->second);
+    if (!it->second.read && !it->second.write && !it->second.except)
+    {
+        m_handles.erase(it);
+    }
+    return result;
+}
+
+void HandleLoop::dispatch(int handle, bool readable, bool writable, bool error)
+{
+    // The callbacks may change the registrations, so look the handle up
+    // again before each one
+    auto it = m_handles.find(handle);
+    if (readable && it != m_handles.end() && it->second.read)
+    {
+        it->second.read(handle);
+        it = m_handles.find(handle);
+    }
+    if (writable && it != m_handles.end() && it->second.write)
+    {
+        it->second.write(handle);
+    }
+    if (error)
+    {
+        (void) raiseException(handle);
+    }
+}
+
+void HandleLoop::addTimeout(time_t timeout)
+{
+    if (timeout != 0 && (m_nextTimeout == 0 || timeout < m_nextTimeout))
+    {
+        m_nextTimeout = timeout;
+    }
+}
+
+int HandleLoop::timeout()
+{
+    time_t now = time(nullptr);
+    if (m_nextTimeout != 0 && m_nextTimeout <= now)
+    {
+        // Something may have timed out, so find what has and work out
+        // when the next check needs to be
+        std::vector<int> expired;
+        m_nextTimeout = 0;
+        for (auto& handle : m_handles)
+        {
+            const Handle& registration = handle.second;
+            bool hasExpired = false;
+            if (registration.read && registration.readTimeout != 0)
+            {
+                hasExpired = registration.readTimeout <= now;
+                if (!hasExpired)
+                {
+                    addTimeout(registration.readTimeout);
+                }
+            }
+            if (registration.write && registration.writeTimeout != 0)
+            {
+                if (registration.writeTimeout <= now)
+                {
+                    hasExpired = true;
+                }
+                else
+                {
+                    addTimeout(registration.writeTimeout);
+                }
+            }
+            if (hasExpired)
+            {
+                expired.push_back(handle.first);
+            }
+        }
+        for (int handle : expired)
+        {
+            if (raiseException(handle))
+            {
+                Log::info << "Timeout";
+            }
+        }
+    }
+
+    m_timers.expire();
+    int timers = m_timers.timeout();
+    if (m_nextTimeout == 0)
+    {
+        return timers;
+    }
+    else if (now >= m_nextTimeout)
+    {
+        return 0;
+    }
+    int handles = (m_nextTimeout - now) * 1000u;
+    return (timers >= 0 && timers < handles) ? timers : handles;
+}
+
+bool HandleLoop::raiseException(int handle)
+{
+    auto it = m_handles.find(handle);
+    if (it != m_handles.end() && it->second.except)
+    {
+        it->second.except(handle);
+        return true;
+    }
+    return false;
+}
+
+}  // namespace dote
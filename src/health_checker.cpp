@@ -0,0 +1,139 @@
+#include "health_checker.h"
+#include "i_forwarder_config.h"
+#include "forwarder_connection.h"
+#include "dns_packet.h"
+#include "packet_pool.h"
+#include "log.h"
+
+#include <functional>
+
+namespace dote {
+
+namespace {
+
+/// The time between checks for forwarders that are due to be probed
+constexpr std::chrono::milliseconds CHECK_INTERVAL(1000);
+
+/// The ID that the probe is sent with
+constexpr unsigned short PROBE_ID = 0x6f6b;
+
+/// The response code for a server failure
+constexpr int SERVER_FAILURE = 2;
+
+/// The TCP framed probe, a recursive query for the NS records of the root
+constexpr char PROBE[] = {
+    0x00, 0x11,  // Length
+    0x6f, 0x6b,  // ID
+    0x01, 0x00,  // Flags, recursion desired
+    0x00, 0x01,  // Questions
+    0x00, 0x00,  // Answers
+    0x00, 0x00,  // Authorities
+    0x00, 0x00,  // Additional
+    0x00,        // Root name
+    0x00, 0x02,  // Type NS
+    0x00, 0x01   // Class IN
+};
+
+}  // anon namespace
+
+using namespace std::placeholders;
+
+HealthChecker::HealthChecker(std::shared_ptr<ILoop> loop,
+                             std::shared_ptr<IForwarderConfig> config,
+                             std::shared_ptr<openssl::ISslFactory> ssl,
+                             std::shared_ptr<PacketPool> pool) :
+    m_loop(std::move(loop)),
+    m_config(std::move(config)),
+    m_ssl(std::move(ssl)),
+    m_pool(std::move(pool)),
+    m_probes(),
+    m_timer()
+{
+    m_timer = m_loop->registerTimer(
+        CHECK_INTERVAL, std::bind(&HealthChecker::check, this, _1)
+    );
+}
+
+HealthChecker::~HealthChecker() noexcept
+{
+    // Don't get called back while the connections are destroyed
+    for (auto& probe : m_probes)
+    {
+        probe.connection->setShutdownCallback(nullptr);
+    }
+}
+
+void HealthChecker::check(int)
+{
+    m_timer.reset();
+    for (const auto& forwarder : m_config->dueForProbe())
+    {
+        probe(forwarder);
+    }
+    m_timer = m_loop->registerTimer(
+        CHECK_INTERVAL, std::bind(&HealthChecker::check, this, _1)
+    );
+}
+
+void HealthChecker::probe(const ConfigParser::Forwarder& forwarder)
+{
+    auto connection = std::make_shared<ForwarderConnection>(
+        m_loop, m_config, m_ssl, m_pool, forwarder
+    );
+    std::vector<char> request(m_pool->acquire());
+    request.assign(PROBE, PROBE + sizeof(PROBE));
+    if (connection->closed() || !connection->send(std::move(request)))
+    {
+        m_config->setProbeResult(forwarder, false);
+        return;
+    }
+    connection->setIncomingCallback(
+        std::bind(&HealthChecker::handleResponse, this, _1, _2)
+    );
+    connection->setShutdownCallback(
+        std::bind(&HealthChecker::handleShutdown, this, _1)
+    );
+    m_probes.emplace_back(Probe { std::move(connection), false });
+    Log::debug << "Probing forwarder that is marked down";
+}
+
+void HealthChecker::handleResponse(ForwarderConnection& connection,
+                                   std::vector<char> buffer)
+{
+    DnsPacket packet(std::move(buffer));
+    for (auto& probe : m_probes)
+    {
+        if (probe.connection.get() == &connection && !probe.finished)
+        {
+            // Any answer other than a failure means it's resolving again
+            probe.finished = true;
+            m_config->setProbeResult(
+                connection.forwarder(),
+                packet.id() == PROBE_ID &&
+                    packet.responseCode() != -1 &&
+                    packet.responseCode() != SERVER_FAILURE
+            );
+            break;
+        }
+    }
+    m_pool->release(packet.move());
+    connection.shutdown();
+}
+
+void HealthChecker::handleShutdown(ForwarderConnection& connection)
+{
+    for (auto it = m_probes.begin(); it != m_probes.end(); ++it)
+    {
+        if (it->connection.get() == &connection)
+        {
+            if (!it->finished)
+            {
+                m_config->setProbeResult(connection.forwarder(), false);
+            }
+            m_probes.erase(it);
+            break;
+        }
+    }
+}
+
+}  // namespace dote
@@ -48,6 +48,9 @@ void ILoop::Registration::reset() {
         case Exception:
             m_loop->removeException(m_handle);
             break;
+        case Timer:
+            m_loop->removeTimer(m_handle);
+            break;
     }
     m_type = Type::Moved;
 }
@@ -3,6 +3,8 @@
 
 #include <syslog.h>
 
+#include <mutex>
+
 namespace dote {
 
 #ifdef NDEBUG
@@ -17,8 +19,16 @@ StreamLogStart Log::err(LOG_ERR);
 StreamLogStart Log::critical(LOG_CRIT);
 std::shared_ptr<ILogger> Log::m_logger;
 
+namespace {
+
+/// Stops the workers from logging over each other
+std::mutex g_logMutex;
+
+}  // anon namespace
+
 void Log::log(int level, const std::string& value)
 {
+    std::lock_guard<std::mutex> lock(g_logMutex);
     if (m_logger)
     {
         m_logger->log(level, value);
@@ -27,6 +37,7 @@ void Log::log(int level, const std::string& value)
 
 void Log::setLogger(std::shared_ptr<ILogger> logger)
 {
+    std::lock_guard<std::mutex> lock(g_logMutex);
     m_logger = std::move(logger);
 }
 
@@ -11,8 +11,8 @@ void Loop::run()
     int currentTimeout = timeout();
     std::vector<pollfd> fds;
     populateFds(fds);
-    while (fds.size() > 0 &&
-            poll(&fds.front(), fds.size(), currentTimeout) >= 0)
+    while ((fds.size() > 0 || m_timers.pending()) &&
+            poll(fds.data(), fds.size(), currentTimeout) >= 0)
     {
         for (const auto& fd : fds)
         {
@@ -29,8 +29,9 @@ void Loop::run()
                 (void) raiseException(fd.fd);
             }
         }
-        populateFds(fds);
+        // Timers and deferred callbacks may change the registrations
         currentTimeout = timeout();
+        populateFds(fds);
     }
 }
 
@@ -135,6 +136,16 @@ ILoop::Registration Loop::registerException(int handle, Callback callback)
     return Registration(this, handle, Type::Exception);
 }
 
+ILoop::Registration Loop::registerTimer(std::chrono::milliseconds delay, Callback callback)
+{
+    return Registration(this, m_timers.add(delay, std::move(callback)), Type::Timer);
+}
+
+ILoop::Registration Loop::registerDeferred(Callback callback)
+{
+    return Registration(this, m_timers.defer(std::move(callback)), Type::Timer);
+}
+
 void Loop::removeRead(int handle)
 {
     m_readFunctions.erase(handle);
@@ -150,6 +161,11 @@ void Loop::removeException(int handle)
     m_exceptFunctions.erase(handle);
 }
 
+void Loop::removeTimer(int id)
+{
+    m_timers.remove(id);
+}
+
 time_t Loop::timeout(time_t now, std::map<int, std::pair<Callback, time_t>>& functions)
 {
     time_t earliest = 0u;
@@ -188,15 +204,18 @@ int Loop::timeout()
     time_t earliestRead = timeout(now, m_readFunctions);
     time_t earliestWrite = timeout(now, m_writeFunctions);
     time_t earliest = earliestRead < earliestWrite ? earliestRead : earliestWrite;
+    m_timers.expire();
+    int timers = m_timers.timeout();
     if (earliest == 0u)
     {
-        return -1;
+        return timers;
     }
     else if (now >= earliest)
     {
         return 0;
     }
-    return (earliest - now) * 1000u;
+    int handles = (earliest - now) * 1000u;
+    return (timers >= 0 && timers < handles) ? timers : handles;
 }
 
 bool Loop::raiseException(int handle)
@@ -31,9 +31,9 @@ std::unique_ptr<dote::Dote> g_dote;
 /// \param signum  The signal that is being caught
 void shutdownHandler(int signum)
 {
-    dote::Log::info << "Shutdown signal received";
     // Stop listening, which will cause us to exit when
-    // no more requests are in progress
+    // no more requests are in progress, this only wakes
+    // the workers as it isn't safe to do more in here
     g_dote->shutdown();
     // Reset the signal handler
     signal(signum, SIG_DFL);
@@ -94,6 +94,8 @@ void usage(const char* appName)
     std::cerr << "                             previously specified forwarders' public key.\n";
     std::cerr << "   -i --insecure             Disable any certificate verification for the\n";
     std::cerr << "                             forwarder\n";
+    std::cerr << "      --fast_open            Connect to the previously specified\n";
+    std::cerr << "                             forwarder using TCP Fast Open.\n";
     std::cerr << "   -c --ciphers  ciphers     The OpenSSL ciphers to use for connecting\n";
     std::cerr << "   -m --connections  max     The maximum number of outgoing requests at a\n";
     std::cerr << "                             time before buffering the requests.\n";
@@ -102,6 +104,40 @@ void usage(const char* appName)
     std::cerr << "   -l --ip_lookup  IP        Lookup the hostname and certificate pin for\n";
     std::cerr << "                             an IP address and then exit.\n";
     std::cerr << "   -t --timeout  timeout     The number of seconds to allow a forwarder\n";
+    std::cerr << "      --pool_size  count     The number of idle connections to keep open\n";
+    std::cerr << "                             to each forwarder for re-use.\n";
+    std::cerr << "      --warm_connections n   The number of connections to open to\n";
+    std::cerr << "                             each forwarder before they're needed.\n";
+    std::cerr << "      --idle_timeout  secs   The number of seconds to keep an idle\n";
+    std::cerr << "                             forwarder connection open for.\n";
+    std::cerr << "      --pipeline  count      The number of requests that may be waiting\n";
+    std::cerr << "                             on a response on one connection at once.\n";
+    std::cerr << "      --cache_size  count    The number of responses to cache, zero to\n";
+    std::cerr << "                             disable the cache.\n";
+    std::cerr << "      --cache_ttl  secs      The longest time to cache a response for.\n";
+    std::cerr << "      --workers  count       The number of threads to handle requests\n";
+    std::cerr << "                             on, each with its own connections.\n";
+    std::cerr << "      --queue_size  count    The number of requests that may wait for\n";
+    std::cerr << "                             a connection before more are failed.\n";
+    std::cerr << "      --queue_deadline  ms   The longest time a request may wait for a\n";
+    std::cerr << "                             connection, zero for no limit.\n";
+    std::cerr << "      --hedge_delay  ms      The least time to wait for a forwarder\n";
+    std::cerr << "                             before also asking another, zero to\n";
+    std::cerr << "                             disable.\n";
+    std::cerr << "      --retries  count       The number of times to send a request\n";
+    std::cerr << "                             again if its connection fails, one by\n";
+    std::cerr << "                             default, zero to drop it.\n";
+    std::cerr << "      --failure_threshold n  The failures in a row before a forwarder\n";
+    std::cerr << "                             is marked down, zero to disable.\n";
+    std::cerr << "      --early_data           Send the first request on a resumed\n";
+    std::cerr << "                             forwarder connection as TLS 1.3 early data.\n";
+    std::cerr << "      --ktls                 Offload the encryption of forwarder\n";
+    std::cerr << "                             connections to the kernel if supported.\n";
+    std::cerr << "      --metrics  IP[:port]   Serve the metrics in the Prometheus format\n";
+    std::cerr << "                             on an address, or a Unix socket if given\n";
+    std::cerr << "                             an absolute path.\n";
+    std::cerr << "      --stats  /name         Publish the metrics in a shared memory\n";
+    std::cerr << "                             segment for dote-stat to read.\n";
     std::cerr << "\n";
 }
 
@@ -245,14 +281,23 @@ int main(int argc, char* const argv[])
     (void) signal(SIGINT, &shutdownHandler);
     (void) signal(SIGTERM, &shutdownHandler);
 
-    // Reload configuration if /config/config.boot changes
+    // A forwarder closing its connection is handled as a failed write
+    // rather than killing the process
+    (void) signal(SIGPIPE, SIG_IGN);
+
+    {
+        // Reload configuration if /config/config.boot changes
 #ifdef __linux__
-    dote::VyattaCheck checker(clParser);
-    checker.configure(*g_dote);
+        dote::VyattaCheck checker(clParser);
+        checker.configure(*g_dote);
 #endif
 
-    // Start the event loop
-    g_dote->run();
+        // Start the event loop
+        g_dote->run();
+    }
+
+    // Clean up while OpenSSL is still available, rather than at exit
+    g_dote.reset();
 
     return 0;
 }
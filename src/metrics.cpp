@@ -0,0 +1,225 @@
+#include "metrics.h"
+
+#include <limits>
+
+namespace dote {
+
+namespace {
+
+/// The number of buckets for each power of two
+constexpr std::size_t SUB_BUCKETS = 1u << Metrics::Histogram::SUB_BITS;
+
+}  // anon namespace
+
+Metrics::Counter::Counter() :
+    m_value(0u)
+{ }
+
+void Metrics::Counter::add(std::uint64_t count)
+{
+    m_value.fetch_add(count, std::memory_order_relaxed);
+}
+
+std::uint64_t Metrics::Counter::value() const
+{
+    return m_value.load(std::memory_order_relaxed);
+}
+
+Metrics::Gauge::Gauge() :
+    m_value(0)
+{ }
+
+void Metrics::Gauge::add(std::int64_t delta)
+{
+    m_value.fetch_add(delta, std::memory_order_relaxed);
+}
+
+std::int64_t Metrics::Gauge::value() const
+{
+    return m_value.load(std::memory_order_relaxed);
+}
+
+Metrics::Histogram::Histogram() :
+    m_counts(),
+    m_total(0u),
+    m_sum(0u)
+{
+    for (auto& count : m_counts)
+    {
+        count.store(0u, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::Histogram::record(std::chrono::microseconds time)
+{
+    std::uint64_t micros = time.count() > 0 ? time.count() : 0u;
+    m_counts[bucket(micros)].fetch_add(1u, std::memory_order_relaxed);
+    m_total.fetch_add(1u, std::memory_order_relaxed);
+    m_sum.fetch_add(micros, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::add(const Histogram& other)
+{
+    for (std::size_t bucket = 0u; bucket < BUCKETS; ++bucket)
+    {
+        m_counts[bucket].fetch_add(
+            other.count(bucket), std::memory_order_relaxed
+        );
+    }
+    m_total.fetch_add(other.total(), std::memory_order_relaxed);
+    m_sum.fetch_add(other.sum(), std::memory_order_relaxed);
+}
+
+std::uint64_t Metrics::Histogram::count(std::size_t bucket) const
+{
+    return m_counts[bucket].load(std::memory_order_relaxed);
+}
+
+std::uint64_t Metrics::Histogram::total() const
+{
+    return m_total.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Metrics::Histogram::sum() const
+{
+    return m_sum.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Metrics::Histogram::upperBound(std::size_t bucket)
+{
+    if (bucket >= BUCKETS - 1u)
+    {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    // Each power of two is split into SUB_BUCKETS of equal width
+    std::size_t exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BITS;
+    std::size_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return ((static_cast<std::uint64_t>(SUB_BUCKETS + sub + 1u)) <<
+        (exponent - SUB_BITS)) - 1u;
+}
+
+std::size_t Metrics::Histogram::bucket(std::uint64_t micros)
+{
+    if (micros < SUB_BUCKETS)
+    {
+        return micros;
+    }
+    // The position of the top bit picks the power of two, and the bits
+    // below it pick the bucket within it
+    std::size_t exponent = 63u - __builtin_clzll(micros);
+    if (exponent > MAX_EXPONENT)
+    {
+        return BUCKETS - 1u;
+    }
+    std::size_t sub = (micros >> (exponent - SUB_BITS)) - SUB_BUCKETS;
+    return SUB_BUCKETS + (exponent - SUB_BITS) * SUB_BUCKETS + sub;
+}
+
+Metrics::Metrics() :
+    m_mutex(),
+    m_counters(),
+    m_gauges(),
+    m_histograms(),
+    m_shards()
+{ }
+
+std::shared_ptr<Metrics> Metrics::shard()
+{
+    auto shard = std::make_shared<Metrics>();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shards.push_back(shard);
+    return shard;
+}
+
+template<typename Metric>
+Metric& Metrics::findOrAdd(Entries<Metric>& entries,
+                           const std::string& name,
+                           const std::string& help,
+                           const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& entry : entries)
+    {
+        if (entry.info.name == name && entry.info.labels == labels)
+        {
+            return entry.metric;
+        }
+    }
+    entries.emplace_back(Info { name, labels, help });
+    return entries.back().metric;
+}
+
+Metrics::Counter& Metrics::counter(const std::string& name,
+                                   const std::string& help,
+                                   const std::string& labels)
+{
+    return findOrAdd(m_counters, name, help, labels);
+}
+
+Metrics::Gauge& Metrics::gauge(const std::string& name,
+                               const std::string& help,
+                               const std::string& labels)
+{
+    return findOrAdd(m_gauges, name, help, labels);
+}
+
+Metrics::Histogram& Metrics::histogram(const std::string& name,
+                                       const std::string& help,
+                                       const std::string& labels)
+{
+    return findOrAdd(m_histograms, name, help, labels);
+}
+
+void Metrics::sumInto(Metrics& total) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& entry : m_counters)
+    {
+        total.counter(entry.info.name, entry.info.help, entry.info.labels)
+            .add(entry.metric.value());
+    }
+    for (const auto& entry : m_gauges)
+    {
+        total.gauge(entry.info.name, entry.info.help, entry.info.labels)
+            .add(entry.metric.value());
+    }
+    for (const auto& entry : m_histograms)
+    {
+        total.histogram(entry.info.name, entry.info.help, entry.info.labels)
+            .add(entry.metric);
+    }
+    for (const auto& shard : m_shards)
+    {
+        shard->sumInto(total);
+    }
+}
+
+void Metrics::visit(
+        const std::function<void(const Info&, const Counter&)>& counters,
+        const std::function<void(const Info&, const Gauge&)>& gauges,
+        const std::function<void(const Info&, const Histogram&)>& histograms
+    ) const
+{
+    // Sum into a registry of its own so that each metric is visited once
+    // with the total of every worker
+    Metrics total;
+    sumInto(total);
+    for (const auto& entry : total.m_counters)
+    {
+        counters(entry.info, entry.metric);
+    }
+    for (const auto& entry : total.m_gauges)
+    {
+        gauges(entry.info, entry.metric);
+    }
+    for (const auto& entry : total.m_histograms)
+    {
+        histograms(entry.info, entry.metric);
+    }
+}
+
+}  // namespace dote
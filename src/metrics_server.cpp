@@ -0,0 +1,377 @@
+
+#include "metrics_server.h"
+#include "metrics.h"
+#include "socket.h"
+#include "log.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <utility>
+
+namespace dote {
+
+namespace {
+
+/// The longest time a client may take to send its request and read the
+/// response
+constexpr std::chrono::milliseconds CLIENT_TIMEOUT(5000);
+
+/// The most clients that may be connected at once, more are dropped
+constexpr std::size_t MAX_CLIENTS = 16u;
+
+/// The largest request that is read from a client
+constexpr std::size_t MAX_REQUEST = 8192u;
+
+/// The most to read from a client in one go
+constexpr std::size_t READ_SIZE = 1024u;
+
+/// \brief  Build an HTTP response that closes the connection
+///
+/// \param status  The status line after the version
+/// \param body    The body of the response
+///
+/// \return  The response to write
+std::string httpResponse(const char* status, const std::string& body)
+{
+    std::string response("HTTP/1.1 ");
+    response += status;
+    response += "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8";
+    response += "\r\nContent-Length: ";
+    response += std::to_string(body.size());
+    response += "\r\nConnection: close\r\n\r\n";
+    response += body;
+    return response;
+}
+
+/// \brief  The lines of one metric with all of its labels, which must be
+///         together in the output
+struct Family
+{
+    /// The HELP and TYPE lines
+    std::string header;
+    /// The sample lines
+    std::string samples;
+};
+
+/// \brief  Collects the metrics into families by name in the order that
+///         the names were first seen
+class Families
+{
+  public:
+    /// \brief  Get the family of a metric, adding it if this is the first
+    ///
+    /// \param info  The description of the metric
+    /// \param type  The Prometheus type of the metric
+    ///
+    /// \return  The family to add the samples of the metric to
+    Family& get(const Metrics::Info& info, const char* type)
+    {
+        auto it = m_index.find(info.name);
+        if (it != m_index.end())
+        {
+            return m_families[it->second];
+        }
+        m_index.emplace(info.name, m_families.size());
+        m_families.emplace_back();
+        Family& family = m_families.back();
+        family.header = "# HELP " + info.name + " " + info.help + "\n" +
+            "# TYPE " + info.name + " " + type + "\n";
+        return family;
+    }
+
+    /// \brief  Join the families into the text to serve
+    ///
+    /// \return  The text of all of the families
+    std::string str() const
+    {
+        std::string output;
+        for (const auto& family : m_families)
+        {
+            output += family.header;
+            output += family.samples;
+        }
+        return output;
+    }
+
+  private:
+    /// The families in the order they were first seen
+    std::vector<Family> m_families;
+    /// The position of each family by name
+    std::map<std::string, std::size_t> m_index;
+};
+
+/// \brief  Add a sample line to a family
+///
+/// \param family  The family to add to
+/// \param name    The name of the sample
+/// \param labels  The labels of the sample, may be empty
+/// \param value   The value of the sample
+void addSample(Family& family,
+               const std::string& name,
+               const std::string& labels,
+               const std::string& value)
+{
+    family.samples += name;
+    if (!labels.empty())
+    {
+        family.samples += "{" + labels + "}";
+    }
+    family.samples += " " + value + "\n";
+}
+
+/// \brief  Join a label on to a list of labels
+///
+/// \param labels  The existing labels, may be empty
+/// \param label   The label to add
+///
+/// \return  The labels with the new one on the end
+std::string withLabel(const std::string& labels, const std::string& label)
+{
+    return labels.empty() ? label : labels + "," + label;
+}
+
+}  // anon namespace
+
+using namespace std::placeholders;
+
+MetricsServer::MetricsServer(std::shared_ptr<ILoop> loop,
+                             std::shared_ptr<Metrics> metrics) :
+    m_loop(std::move(loop)),
+    m_metrics(std::move(metrics)),
+    m_address(),
+    m_socket(),
+    m_accept(),
+    m_clients()
+{
+    m_address.ss_family = AF_UNSPEC;
+}
+
+MetricsServer::~MetricsServer()
+{
+    m_clients.clear();
+    m_accept.reset();
+    if (m_socket && m_address.ss_family == AF_UNIX)
+    {
+        (void) unlink(reinterpret_cast<const sockaddr_un&>(m_address).sun_path);
+    }
+}
+
+bool MetricsServer::listen(const sockaddr_storage& address)
+{
+    m_socket = Socket::listen(address);
+    if (!m_socket)
+    {
+        return false;
+    }
+    m_address = address;
+    m_accept = m_loop->registerRead(
+        m_socket->get(), std::bind(&MetricsServer::handleAccept, this, _1), 0
+    );
+    return m_accept.valid();
+}
+
+void MetricsServer::handleAccept(int)
+{
+    std::shared_ptr<Socket> socket;
+    while ((socket = m_socket->accept()))
+    {
+        if (m_clients.size() >= MAX_CLIENTS)
+        {
+            Log::notice << "Too many metrics clients, dropping one";
+            continue;
+        }
+        int clientHandle = socket->get();
+        Client client {
+            std::move(socket),
+            std::string(),
+            m_loop->registerRead(
+                clientHandle,
+                std::bind(&MetricsServer::handleRead, this, _1),
+                0
+            ),
+            m_loop->registerTimer(
+                CLIENT_TIMEOUT,
+                std::bind(&MetricsServer::close, this, clientHandle)
+            )
+        };
+        m_clients.emplace_back(std::move(client));
+    }
+}
+
+void MetricsServer::handleRead(int handle)
+{
+    auto client = find(handle);
+    if (client == m_clients.end())
+    {
+        return;
+    }
+
+    char buffer[READ_SIZE];
+    ssize_t length;
+    while ((length = read(handle, buffer, sizeof(buffer))) > 0)
+    {
+        client->buffer.append(buffer, length);
+        if (client->buffer.size() > MAX_REQUEST)
+        {
+            close(handle);
+            return;
+        }
+    }
+    bool closed = length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+
+    // Wait for the end of the headers, there's no body to a GET
+    auto end = client->buffer.find("\r\n\r\n");
+    if (end == std::string::npos)
+    {
+        end = client->buffer.find("\n\n");
+    }
+    if (end == std::string::npos)
+    {
+        if (closed)
+        {
+            close(handle);
+        }
+        return;
+    }
+    client->buffer = respond(client->buffer);
+    client->registration.reset();
+    client->registration = m_loop->registerWrite(
+        handle, std::bind(&MetricsServer::handleWrite, this, _1), 0
+    );
+}
+
+void MetricsServer::handleWrite(int handle)
+{
+    auto client = find(handle);
+    if (client == m_clients.end())
+    {
+        return;
+    }
+
+    while (!client->buffer.empty())
+    {
+        ssize_t written = send(
+            handle, client->buffer.data(), client->buffer.size(), 0
+        );
+        if (written < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                close(handle);
+            }
+            return;
+        }
+        client->buffer.erase(0, written);
+    }
+    close(handle);
+}
+
+std::string MetricsServer::respond(const std::string& request) const
+{
+    auto lineEnd = request.find_first_of("\r\n");
+    std::string line(request, 0, lineEnd);
+    if (line.compare(0, 4, "GET ") != 0)
+    {
+        return httpResponse("405 Method Not Allowed", "Method not allowed\n");
+    }
+    auto pathEnd = line.find(' ', 4);
+    std::string path(line, 4, pathEnd == std::string::npos ?
+        std::string::npos : pathEnd - 4);
+    if (path != "/metrics" && path != "/")
+    {
+        return httpResponse("404 Not Found", "Not found\n");
+    }
+    return httpResponse("200 OK", format(*m_metrics));
+}
+
+std::vector<MetricsServer::Client>::iterator MetricsServer::find(int handle)
+{
+    for (auto it = m_clients.begin(); it != m_clients.end(); ++it)
+    {
+        if (it->socket->get() == handle)
+        {
+            return it;
+        }
+    }
+    return m_clients.end();
+}
+
+void MetricsServer::close(int handle)
+{
+    auto client = find(handle);
+    if (client != m_clients.end())
+    {
+        m_clients.erase(client);
+    }
+}
+
+std::string MetricsServer::format(const Metrics& metrics)
+{
+    Families families;
+    metrics.visit(
+        [&families](const Metrics::Info& info, const Metrics::Counter& counter)
+        {
+            addSample(
+                families.get(info, "counter"), info.name, info.labels,
+                std::to_string(counter.value())
+            );
+        },
+        [&families](const Metrics::Info& info, const Metrics::Gauge& gauge)
+        {
+            addSample(
+                families.get(info, "gauge"), info.name, info.labels,
+                std::to_string(gauge.value())
+            );
+        },
+        [&families](const Metrics::Info& info, const Metrics::Histogram& histogram)
+        {
+            Family& family = families.get(info, "histogram");
+            std::string bucketName = info.name + "_bucket";
+            // Only the buckets that have been used are listed to keep the
+            // output small, they stay listed as the counts never go down
+            std::uint64_t total = 0u;
+            for (std::size_t bucket = 0u;
+                 bucket < Metrics::Histogram::BUCKETS - 1u;
+                 ++bucket)
+            {
+                std::uint64_t count = histogram.count(bucket);
+                if (count == 0u)
+                {
+                    continue;
+                }
+                total += count;
+                addSample(
+                    family, bucketName,
+                    withLabel(info.labels, "le=\"" + std::to_string(
+                        Metrics::Histogram::upperBound(bucket)
+                    ) + "\""),
+                    std::to_string(total)
+                );
+            }
+            // Total the buckets rather than use total() so that the
+            // count matches them while they're being recorded into
+            total += histogram.count(Metrics::Histogram::BUCKETS - 1u);
+            addSample(
+                family, bucketName, withLabel(info.labels, "le=\"+Inf\""),
+                std::to_string(total)
+            );
+            addSample(
+                family, info.name + "_sum", info.labels,
+                std::to_string(histogram.sum())
+            );
+            addSample(
+                family, info.name + "_count", info.labels,
+                std::to_string(total)
+            );
+        }
+    );
+    return families.str();
+}
+
+}  // namespace dote
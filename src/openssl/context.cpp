@@ -9,6 +9,8 @@
 #include <openssl/conf.h>
 #include <openssl/opensslv.h>
 
+#include <ctime>
+
 namespace dote {
 namespace openssl {
 
@@ -32,11 +34,50 @@ constexpr int ALLOWED_ERRORS[] = {
     X509_V_ERR_UNABLE_TO_VERIFY_LEAF_SIGNATURE
 };
 
+/// The most sessions to keep for each server, TLS 1.3 servers usually
+/// issue two tickets per connection and each ticket should be used once,
+/// so keep enough for a burst of connections to be opened together
+constexpr std::size_t MAX_SESSIONS = 16u;
+
+/// \brief  Check whether a session can still be resumed
+///
+/// \param session  The session to check
+/// \param now      The current time
+///
+/// \return  True if the session has not expired or been invalidated
+bool sessionValid(SSL_SESSION* session, std::time_t now)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x010101000
+    // A connection that was closed without a shutdown invalidates the
+    // last session it received after it has been cached
+    if (!SSL_SESSION_is_resumable(session))
+    {
+        return false;
+    }
+#endif
+    return SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) > now;
+}
+
+/// \brief  Check whether a session is a TLS 1.3 ticket which should
+///         not be used for more than one connection
+///
+/// \param session  The session to check
+///
+/// \return  True if the session should only be used once
+bool singleUse(SSL_SESSION* session)
+{
+#ifdef TLS1_3_VERSION
+    return SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION;
+#else
+    return false;
+#endif
+}
+
 }  // anon namespace
 
 Context::Context(const std::string& ciphers) :
     m_context(nullptr),
-    m_session(nullptr)
+    m_sessions()
 {
     // Flag to track if we've tried initialising the OpenSSL
     // library yet because we shouldn't keep trying
@@ -84,7 +125,14 @@ Context::Context(const std::string& ciphers) :
 
 Context::~Context()
 {
-    cacheSession(nullptr);
+    for (auto& server : m_sessions)
+    {
+        for (auto session : server.second)
+        {
+            SSL_SESSION_free(session);
+        }
+    }
+    m_sessions.clear();
     if (m_context)
     {
         SSL_CTX_free(m_context);
@@ -113,6 +161,20 @@ void Context::setChainVerifier(Verifier verifier)
     }
 }
 
+void Context::enableKernelTls()
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    if (m_context)
+    {
+        // OpenSSL falls back to encrypting itself for any connection
+        // that the kernel is unable to take over
+        SSL_CTX_set_options(m_context, SSL_OP_ENABLE_KTLS);
+    }
+#else
+    Log::warn << "Kernel TLS is not supported by this OpenSSL";
+#endif
+}
+
 void Context::setSslConnection(SSL* ssl, SslConnection* connection)
 {
     if (m_context && ssl)
@@ -176,18 +238,74 @@ int Context::chainVerifyTrampoline(X509_STORE_CTX *store, void *context)
     return result;
 }
 
-void Context::cacheSession(SSL_SESSION* session)
+int Context::newSessionTrampoline(SSL* ssl, SSL_SESSION* session)
+{
+    auto connection = reinterpret_cast<SslConnection*>(
+        SSL_get_ex_data(ssl, s_connectionIndex)
+    );
+    return (connection && connection->newSession(session)) ? 1 : 0;
+}
+
+void Context::cacheSession(const std::string& server, SSL_SESSION* session)
 {
-    if (m_session)
+    auto& sessions = m_sessions[server];
+    sessions.push_back(session);
+    while (sessions.size() > MAX_SESSIONS)
     {
-        SSL_SESSION_free(m_session);
+        SSL_SESSION_free(sessions.front());
+        sessions.pop_front();
     }
-    m_session = session;
 }
 
-SSL_SESSION* Context::getSession()
+SSL_SESSION* Context::getSession(const std::string& server)
 {
-    return m_session;
+    auto it = m_sessions.find(server);
+    if (it == m_sessions.end())
+    {
+        return nullptr;
+    }
+
+    // Use the most recent session, discarding any which are no longer valid
+    SSL_SESSION* session = nullptr;
+    auto now = std::time(nullptr);
+    auto& sessions = it->second;
+    while (session == nullptr && !sessions.empty())
+    {
+        SSL_SESSION* latest = sessions.back();
+        if (!sessionValid(latest, now))
+        {
+            SSL_SESSION_free(latest);
+            sessions.pop_back();
+        }
+        else if (singleUse(latest))
+        {
+            session = latest;
+            sessions.pop_back();
+        }
+        else
+        {
+            SSL_SESSION_up_ref(latest);
+            session = latest;
+        }
+    }
+    if (sessions.empty())
+    {
+        m_sessions.erase(it);
+    }
+    return session;
+}
+
+void Context::clearSessions(const std::string& server)
+{
+    auto it = m_sessions.find(server);
+    if (it != m_sessions.end())
+    {
+        for (auto session : it->second)
+        {
+            SSL_SESSION_free(session);
+        }
+        m_sessions.erase(it);
+    }
 }
 
 void Context::configureContext()
@@ -204,6 +322,13 @@ void Context::configureContext()
 
     // By default perform verification using standard OpenSSL routines
     SSL_CTX_set_verify(m_context, SSL_VERIFY_PEER, &Context::verifyTrampoline);
+
+    // Keep client sessions ourselves so that they are per server and
+    // TLS 1.3 tickets which arrive after the handshake are captured
+    SSL_CTX_set_session_cache_mode(
+        m_context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE
+    );
+    SSL_CTX_sess_set_new_cb(m_context, &Context::newSessionTrampoline);
 }
 
 SSL_CTX* Context::get()
@@ -3,9 +3,12 @@
 #include "openssl/context.h"
 #include "openssl/certificate_utilities.h"
 
+#include <openssl/err.h>
 #include <openssl/x509.h>
 #include <openssl/x509_vfy.h>
 
+#include <netinet/in.h>
+
 #include <string>
 #include <array>
 
@@ -40,6 +43,39 @@ T certificateOperation(T(CertificateUtilities::*utility)(), SSL* ssl)
     return result;
 }
 
+/// \brief  Create the key to cache sessions for a server against
+///
+/// \param remote  The address of the server
+/// \param host    The name of the server
+///
+/// \return  The key for the server
+std::string sessionKey(const sockaddr_storage& remote, const std::string& host)
+{
+    std::string key;
+    if (remote.ss_family == AF_INET)
+    {
+        auto& address = reinterpret_cast<const sockaddr_in&>(remote);
+        key.append(reinterpret_cast<const char*>(&address.sin_addr),
+                   sizeof(address.sin_addr));
+        key.append(reinterpret_cast<const char*>(&address.sin_port),
+                   sizeof(address.sin_port));
+    }
+    else if (remote.ss_family == AF_INET6)
+    {
+        auto& address = reinterpret_cast<const sockaddr_in6&>(remote);
+        key.append(reinterpret_cast<const char*>(&address.sin6_addr),
+                   sizeof(address.sin6_addr));
+        key.append(reinterpret_cast<const char*>(&address.sin6_port),
+                   sizeof(address.sin6_port));
+    }
+    else
+    {
+        return key;
+    }
+    key.append(host);
+    return key;
+}
+
 }  // anon namespace
 
 SslConnection::SslConnection(std::shared_ptr<Context> context) :
@@ -50,10 +86,11 @@ SslConnection::SslConnection(std::shared_ptr<Context> context) :
     {
         m_ssl = SSL_new(m_context->get());
         m_context->setSslConnection(m_ssl, this);
-        SSL_SESSION* session = m_context->getSession();
-        if (m_ssl && session)
+        if (m_ssl)
         {
-            SSL_set_session(m_ssl, session);
+            // Always a client, this has to be known before early data
+            // is written rather than waiting for the first SSL_connect
+            SSL_set_connect_state(m_ssl);
         }
     }
 }
@@ -80,7 +117,30 @@ void SslConnection::setSocket(int handle)
     }
 }
 
+void SslConnection::setServer(const sockaddr_storage& remote,
+                              const std::string& host)
+{
+    if (!m_ssl)
+    {
+        return;
+    }
+
+    if (!host.empty())
+    {
+        SSL_set_tlsext_host_name(m_ssl, host.c_str());
+    }
 
+    m_server = sessionKey(remote, host);
+    if (!m_server.empty())
+    {
+        SSL_SESSION* session = m_context->getSession(m_server);
+        if (session)
+        {
+            SSL_set_session(m_ssl, session);
+            SSL_SESSION_free(session);
+        }
+    }
+}
 
 std::vector<unsigned char> SslConnection::getPeerCertificatePublicKeyHash()
 {
@@ -105,6 +165,9 @@ SslConnection::Result SslConnection::doFunction(std::function<int(SSL*)> functio
     Result result = Result::FATAL;
     if (m_ssl)
     {
+        // The error queue is shared by every connection on the thread, so
+        // a failure left on it by another would be taken to be this one's
+        ERR_clear_error();
         int ret = function(m_ssl);
         if (ret > 0)
         {
@@ -136,23 +199,73 @@ SslConnection::Result SslConnection::doFunction(std::function<int(SSL*)> functio
 
 SslConnection::Result SslConnection::connect()
 {
+    // New sessions are cached as they arrive by newSession
     Result result = doFunction(&SSL_connect);
-    if (result == Result::SUCCESS)
+    if (result == Result::FATAL && !m_server.empty())
     {
-        SSL_SESSION* session = SSL_get1_session(m_ssl);
-        if (session)
-        {
-            m_context->cacheSession(session);
-        }
+        // The server may have rejected the session, start afresh with it
+        m_context->clearSessions(m_server);
     }
-    else if (result == Result::FATAL)
+    return result;
+}
+
+std::size_t SslConnection::maxEarlyData()
+{
+    std::size_t result = 0u;
+#if OPENSSL_VERSION_NUMBER >= 0x010101000
+    SSL_SESSION* session = m_ssl ? SSL_get_session(m_ssl) : nullptr;
+    if (session)
     {
-        // Going to change servers, invalidate the session
-        m_context->cacheSession(nullptr);
+        result = SSL_SESSION_get_max_early_data(session);
     }
+#endif
     return result;
 }
 
+SslConnection::Result SslConnection::writeEarlyData(const std::vector<char>& buffer)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x010101000
+    return doFunction(
+        [&buffer](SSL* ssl)
+        {
+            std::size_t written = 0u;
+            // Returns zero on any failure, so map it to an error to check
+            return SSL_write_early_data(
+                ssl, buffer.data(), buffer.size(), &written
+            ) == 1 ? 1 : -1;
+        }
+    );
+#else
+    return Result::FATAL;
+#endif
+}
+
+bool SslConnection::earlyDataAccepted()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x010101000
+    return m_ssl &&
+        SSL_get_early_data_status(m_ssl) == SSL_EARLY_DATA_ACCEPTED;
+#else
+    return false;
+#endif
+}
+
+bool SslConnection::kernelTls()
+{
+#ifdef BIO_get_ktls_send
+    return m_ssl &&
+        (BIO_get_ktls_send(SSL_get_wbio(m_ssl)) ||
+         BIO_get_ktls_recv(SSL_get_rbio(m_ssl)));
+#else
+    return false;
+#endif
+}
+
+bool SslConnection::sessionResumed()
+{
+    return m_ssl && SSL_session_reused(m_ssl);
+}
+
 SslConnection::Result SslConnection::shutdown()
 {
     return doFunction(&SSL_shutdown);
@@ -171,22 +284,19 @@ SslConnection::Result SslConnection::write(const std::vector<char>& buffer)
     );
 }
 
-SslConnection::Result SslConnection::read(std::vector<char>& buffer)
+SslConnection::Result SslConnection::read(char* buffer,
+                                          std::size_t length,
+                                          std::size_t& readLength)
 {
-    int readLength = 0;
-    char stackBuffer[MAX_FRAME];
+    int ret = 0;
     Result result = doFunction(
-        [&readLength, &stackBuffer](SSL* ssl)
+        [&ret, buffer, length](SSL* ssl)
         {
-            readLength = SSL_read(ssl, stackBuffer, sizeof(stackBuffer));
-            return readLength;
+            ret = SSL_read(ssl, buffer, static_cast<int>(length));
+            return ret;
         }
     );
-    if (result == Result::SUCCESS)
-    {
-        buffer.resize(readLength);
-        std::copy(stackBuffer, &stackBuffer[readLength], buffer.begin());
-    }
+    readLength = result == Result::SUCCESS ? static_cast<std::size_t>(ret) : 0u;
     return result;
 }
 
@@ -206,5 +316,15 @@ int SslConnection::verify(X509_STORE_CTX *store)
     return result;
 }
 
+bool SslConnection::newSession(SSL_SESSION* session)
+{
+    if (m_server.empty())
+    {
+        return false;
+    }
+    m_context->cacheSession(m_server, session);
+    return true;
+}
+
 }  // namespace openssl
 }  // namespace dote
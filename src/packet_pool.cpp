@@ -0,0 +1,42 @@
+
+#include "packet_pool.h"
+
+namespace dote {
+
+constexpr std::size_t PacketPool::BUFFER_SIZE;
+constexpr std::size_t PacketPool::DEFAULT_MAX_BUFFERS;
+
+PacketPool::PacketPool(std::size_t maxBuffers) :
+    m_maxBuffers(maxBuffers),
+    m_buffers()
+{ }
+
+std::vector<char> PacketPool::acquire()
+{
+    if (m_buffers.empty())
+    {
+        std::vector<char> buffer;
+        buffer.reserve(BUFFER_SIZE);
+        return buffer;
+    }
+    std::vector<char> buffer(std::move(m_buffers.back()));
+    m_buffers.pop_back();
+    return buffer;
+}
+
+void PacketPool::release(std::vector<char> buffer)
+{
+    // A buffer that has been moved from has no memory worth keeping
+    if (m_buffers.size() < m_maxBuffers && buffer.capacity() >= BUFFER_SIZE)
+    {
+        buffer.clear();
+        m_buffers.emplace_back(std::move(buffer));
+    }
+}
+
+std::size_t PacketPool::size() const
+{
+    return m_buffers.size();
+}
+
+}  // namespace dote
@@ -4,6 +4,7 @@
 #include "i_loop.h"
 #include "forwarder_connection.h"
 #include "i_forwarders.h"
+#include "packet_pool.h"
 #include "log.h"
 
 #ifdef __APPLE__
@@ -18,6 +19,57 @@ namespace dote {
 
 namespace {
 
+/// The most requests to read from a socket in one go
+constexpr unsigned int REQUEST_BATCH = 32u;
+
+/// The largest UDP DNS request that is accepted
+constexpr size_t DNS_BUFFER = 512u;
+
+/// The space for the control data of each request
+constexpr size_t CONTROL_BUFFER = 256u;
+
+/// The space for the TCP length in front of each request
+constexpr size_t SIZE_LENGTH = sizeof(unsigned short);
+
+/// \brief  Receive the requests that are waiting on a socket
+///
+/// \param handle    The socket to receive from
+/// \param messages  The messages to receive into
+/// \param lengths   The length of each message that was received
+/// \param count     The number of messages to receive at most
+///
+/// \return  The number of messages received or -1 if there were none
+int receiveMessages(int handle, msghdr* messages, size_t* lengths, unsigned int count)
+{
+#ifdef __linux__
+    mmsghdr batch[REQUEST_BATCH];
+    for (unsigned int i = 0u; i < count; ++i)
+    {
+        batch[i].msg_hdr = messages[i];
+        batch[i].msg_len = 0u;
+    }
+    int received = recvmmsg(handle, batch, count, MSG_DONTWAIT, nullptr);
+    for (int i = 0; i < received; ++i)
+    {
+        messages[i] = batch[i].msg_hdr;
+        lengths[i] = batch[i].msg_len;
+    }
+    return received;
+#else
+    int received = 0;
+    while (received < static_cast<int>(count))
+    {
+        ssize_t length = recvmsg(handle, &messages[received], 0);
+        if (length == -1)
+        {
+            break;
+        }
+        lengths[received++] = length;
+    }
+    return received == 0 ? -1 : received;
+#endif
+}
+
 void getDestinationAddress(msghdr& message, sockaddr_storage& dstAddr, int& ifIndex)
 {
     // Process ancillary data  received in msgheader - cmsg(3)
@@ -74,16 +126,45 @@ void getDestinationAddress(msghdr& message, sockaddr_storage& dstAddr, int& ifIn
 using namespace std::placeholders;
 
 Server::Server(std::shared_ptr<ILoop> loop,
-               std::shared_ptr<IForwarders> forwarders) :
+               std::shared_ptr<IForwarders> forwarders,
+               std::shared_ptr<Metrics> metrics) :
     m_loop(std::move(loop)),
-    m_forwarders(std::move(forwarders))
+    m_forwarders(std::move(forwarders)),
+    m_serverSockets(),
+    m_reusePort(false),
+    m_pool(std::make_shared<PacketPool>()),
+    m_packets(REQUEST_BATCH),
+    m_control(REQUEST_BATCH * CONTROL_BUFFER),
+    m_metrics(std::move(metrics)),
+    m_requests(&m_metrics->counter(
+        "dote_requests_total", "Requests received from clients"
+    )),
+    m_tooBig(&m_metrics->counter(
+        "dote_requests_too_big_total", "Requests dropped as they were too big"
+    )),
+    m_batchTimes(&m_metrics->histogram(
+        "dote_receive_microseconds",
+        "Time to receive a batch of requests and pass them on"
+    ))
 { }
 
 Server::~Server() = default;
 
+void Server::setReusePort(bool reusePort)
+{
+    m_reusePort = reusePort;
+}
+
+void Server::setPacketPool(std::shared_ptr<PacketPool> pool)
+{
+    m_pool = std::move(pool);
+}
+
 bool Server::addServer(const ConfigParser::Server& config)
 {
-    auto serverSocket = Socket::bind(config.address, Socket::Type::UDP);
+    auto serverSocket = Socket::bind(
+        config.address, Socket::Type::UDP, m_reusePort
+    );
     if (!serverSocket)
     {
         return false;
@@ -119,44 +200,70 @@ void Server::handleDnsRequest(int handle)
         return;
     }
 
-    constexpr size_t SIZE_LENGTH = sizeof(unsigned short);
-    constexpr size_t DNS_BUFFER = 512;
-    std::vector<char> tcpBuffer(DNS_BUFFER + SIZE_LENGTH);
-    sockaddr_storage srcAddr;
-    iovec iov[1] = {
-        { tcpBuffer.data() + SIZE_LENGTH, tcpBuffer.size() - SIZE_LENGTH }
-    };
-    char controlBuf[256];
-    msghdr message = {
-        &srcAddr, sizeof(srcAddr), iov, 1, controlBuf, sizeof(controlBuf), 0
-    };
-
-    ssize_t count = recvmsg(handle, &message, 0);
+    auto start = std::chrono::steady_clock::now();
+    sockaddr_storage srcAddr[REQUEST_BATCH];
+    iovec iov[REQUEST_BATCH];
+    msghdr messages[REQUEST_BATCH];
+    size_t lengths[REQUEST_BATCH];
+    for (unsigned int i = 0u; i < REQUEST_BATCH; ++i)
+    {
+        // Replace the buffers that were passed on with the last batch
+        if (m_packets[i].size() != SIZE_LENGTH + DNS_BUFFER)
+        {
+            m_packets[i] = m_pool->acquire();
+            m_packets[i].resize(SIZE_LENGTH + DNS_BUFFER);
+        }
+        iov[i] = { m_packets[i].data() + SIZE_LENGTH, DNS_BUFFER };
+        messages[i] = {
+            &srcAddr[i], sizeof(srcAddr[i]), &iov[i], 1,
+            &m_control[i * CONTROL_BUFFER], CONTROL_BUFFER, 0
+        };
+    }
+
+    int count = receiveMessages(handle, messages, lengths, REQUEST_BATCH);
     if (count == -1)
     {
         Log::notice << "No message to receive";
         return;
     }
-    else if ((message.msg_flags & MSG_TRUNC))
+    m_requests->add(count);
+
+    std::vector<IForwarders::Request> requests;
+    requests.reserve(count);
+    for (int i = 0; i < count; ++i)
     {
-        Log::notice << "DNS request packet was too big";
-        return;
-    }
+        if ((messages[i].msg_flags & MSG_TRUNC))
+        {
+            Log::notice << "DNS request packet was too big";
+            m_tooBig->add();
+            continue;
+        }
 
-    // Construct a TCP DNS request which is two bytes of length
-    // followed by the DNS request packet
-    tcpBuffer.resize(count + SIZE_LENGTH);
-    *reinterpret_cast<unsigned short*>(tcpBuffer.data()) = htons(count);
+        // Construct a TCP DNS request which is two bytes of length
+        // followed by the DNS request packet, which was received after
+        // the space left for the length
+        std::vector<char> tcpBuffer(std::move(m_packets[i]));
+        tcpBuffer.resize(lengths[i] + SIZE_LENGTH);
+        *reinterpret_cast<unsigned short*>(tcpBuffer.data()) = htons(lengths[i]);
 
-    sockaddr_storage dstAddr;
-    dstAddr.ss_family = AF_UNSPEC;
-    int ifIndex = -1;
-    getDestinationAddress(message, dstAddr, ifIndex);
+        sockaddr_storage dstAddr;
+        dstAddr.ss_family = AF_UNSPEC;
+        int ifIndex = -1;
+        getDestinationAddress(messages[i], dstAddr, ifIndex);
 
-    // Send the request
-    m_forwarders->handleRequest(
-        std::move(handleSocket), srcAddr, dstAddr, ifIndex, std::move(tcpBuffer)
-    );
+        requests.emplace_back(IForwarders::Request {
+            srcAddr[i], dstAddr, ifIndex, std::move(tcpBuffer)
+        });
+    }
+
+    // Send the requests
+    if (!requests.empty())
+    {
+        m_forwarders->handleRequests(std::move(handleSocket), std::move(requests));
+    }
+    m_batchTimes->record(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start
+    ));
 }
 
 }  // namespace dote
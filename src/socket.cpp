@@ -7,6 +7,7 @@
 #endif
 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <fcntl.h>
@@ -52,6 +53,8 @@ int toDomain(int family)
             return PF_INET;
         case AF_INET6:
             return PF_INET6;
+        case AF_UNIX:
+            return PF_UNIX;
         default:
             return -1;
     }
@@ -71,6 +74,8 @@ int addressLength(int family)
             return sizeof(sockaddr_in);
         case AF_INET6:
             return sizeof(sockaddr_in6);
+        case AF_UNIX:
+            return sizeof(sockaddr_un);
         default:
             return 0;
     }
@@ -123,10 +128,32 @@ void Socket::close()
 
 std::shared_ptr<Socket> Socket::connect(const sockaddr_storage& address,
                                         Type type)
+{
+    return connect(address, type, false);
+}
+
+std::shared_ptr<Socket> Socket::connect(const sockaddr_storage& address,
+                                        Type type,
+                                        bool fastOpen)
 {
     auto socket = std::make_shared<Socket>(
         toDomain(address.ss_family), type
     );
+    if (fastOpen)
+    {
+#ifdef TCP_FASTOPEN_CONNECT
+        // The connect returns straight away and the SYN is sent with the
+        // first write, the kernel falls back to a normal handshake itself
+        int enable = 1;
+        if (setsockopt(socket->get(), IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                       &enable, sizeof(enable)) == -1)
+        {
+            Log::info << "Unable to use TCP Fast Open: " << strerror(errno);
+        }
+#else
+        Log::info << "TCP Fast Open is not supported";
+#endif
+    }
     if (socket && !socket->connect(
                 reinterpret_cast<const sockaddr*>(&address),
                 addressLength(address.ss_family)
@@ -140,10 +167,30 @@ std::shared_ptr<Socket> Socket::connect(const sockaddr_storage& address,
 
 std::shared_ptr<Socket> Socket::bind(const sockaddr_storage& address,
                                      Type type)
+{
+    return bind(address, type, false);
+}
+
+std::shared_ptr<Socket> Socket::bind(const sockaddr_storage& address,
+                                     Type type,
+                                     bool reusePort)
 {
     auto socket = std::make_shared<Socket>(
         toDomain(address.ss_family), type
     );
+    if (reusePort)
+    {
+#ifdef SO_REUSEPORT
+        int enable = 1;
+        if (setsockopt(socket->get(), SOL_SOCKET, SO_REUSEPORT,
+                       &enable, sizeof(enable)) == -1)
+        {
+            Log::warn << "Unable to share the port: " << strerror(errno);
+        }
+#else
+        Log::warn << "Sharing ports is not supported";
+#endif
+    }
     if (socket && !socket->bind(
                 reinterpret_cast<const sockaddr*>(&address),
                 addressLength(address.ss_family)
@@ -155,6 +202,35 @@ std::shared_ptr<Socket> Socket::bind(const sockaddr_storage& address,
     return socket;
 }
 
+std::shared_ptr<Socket> Socket::listen(const sockaddr_storage& address)
+{
+    auto socket = std::make_shared<Socket>(
+        toDomain(address.ss_family), Type::TCP
+    );
+    if (address.ss_family == AF_UNIX)
+    {
+        // A socket left behind by a previous run would stop the bind
+        (void) unlink(reinterpret_cast<const sockaddr_un&>(address).sun_path);
+    }
+    else
+    {
+        // Allow a restart while the old connections are in TIME_WAIT
+        int enable = 1;
+        (void) setsockopt(socket->get(), SOL_SOCKET, SO_REUSEADDR,
+                          &enable, sizeof(enable));
+    }
+    if (!socket->bind(
+                reinterpret_cast<const sockaddr*>(&address),
+                addressLength(address.ss_family)
+            ) ||
+            ::listen(socket->get(), SOMAXCONN) != 0)
+    {
+        Log::info << "Listen failed: " << strerror(errno);
+        socket.reset();
+    }
+    return socket;
+}
+
 bool Socket::connect(const sockaddr* address, size_t addressLength)
 {
     if (m_handle == -1)
@@ -174,6 +250,20 @@ bool Socket::bind(const sockaddr* address, size_t addressLength)
         ::bind(m_handle, address, addressLength) == 0;
 }
 
+std::shared_ptr<Socket> Socket::accept()
+{
+    if (m_handle == -1)
+    {
+        return nullptr;
+    }
+    int handle = ::accept(m_handle, nullptr, nullptr);
+    if (handle == -1)
+    {
+        return nullptr;
+    }
+    return std::make_shared<Socket>(handle);
+}
+
 int Socket::get()
 {
     return m_handle;
@@ -0,0 +1,374 @@
+
+#include "stats_segment.h"
+#include "metrics.h"
+#include "log.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace dote {
+
+namespace {
+
+/// The least size to map, more is mapped as the metrics grow
+constexpr std::size_t MINIMUM_SIZE = 4096u;
+
+/// The most times to try to read a copy that isn't being written
+constexpr unsigned int READ_ATTEMPTS = 1000u;
+
+/// \brief  Copy a string into a fixed size field, truncating it if needed
+///
+/// \param output  The field to copy into
+/// \param size    The size of the field
+/// \param value   The string to copy
+void copyString(char* output, std::size_t size, const std::string& value)
+{
+    std::size_t length = std::min(value.size(), size - 1u);
+    memcpy(output, value.data(), length);
+    memset(output + length, 0, size - length);
+}
+
+/// \brief  Add an entry to the end of a buffer
+///
+/// \param buffer  The buffer to add to
+/// \param info    The description of the metric
+/// \param type    The type of the metric
+/// \param values  The number of values that will follow the entry
+void appendEntry(std::vector<char>& buffer,
+                 const Metrics::Info& info,
+                 StatsEntry::Type type,
+                 std::uint32_t values)
+{
+    StatsEntry entry;
+    entry.type = type;
+    entry.values = values;
+    copyString(entry.name, sizeof(entry.name), info.name);
+    copyString(entry.labels, sizeof(entry.labels), info.labels);
+    const char* data = reinterpret_cast<const char*>(&entry);
+    buffer.insert(buffer.end(), data, data + sizeof(entry));
+}
+
+/// \brief  Add a value to the end of a buffer
+///
+/// \param buffer  The buffer to add to
+/// \param value   The value to add
+void appendValue(std::vector<char>& buffer, std::uint64_t value)
+{
+    const char* data = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), data, data + sizeof(value));
+}
+
+}  // anon namespace
+
+StatsSegment::StatsSegment(std::shared_ptr<Metrics> metrics) :
+    m_metrics(std::move(metrics)),
+    m_name(),
+    m_handle(-1),
+    m_data(nullptr),
+    m_size(0u),
+    m_buffer(),
+    m_thread(),
+    m_mutex(),
+    m_condition(),
+    m_stopping(false)
+{ }
+
+StatsSegment::~StatsSegment()
+{
+    stop();
+    if (m_data)
+    {
+        (void) munmap(m_data, m_size);
+    }
+    if (m_handle != -1)
+    {
+        (void) close(m_handle);
+        (void) shm_unlink(m_name.c_str());
+    }
+}
+
+bool StatsSegment::open(const std::string& name)
+{
+    // Start afresh rather than truncate a segment a reader may have mapped
+    (void) shm_unlink(name.c_str());
+    m_handle = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (m_handle == -1)
+    {
+        Log::err << "Unable to create the statistics segment: " <<
+            strerror(errno);
+        return false;
+    }
+    m_name = name;
+    if (!reserve(sizeof(StatsHeader)))
+    {
+        return false;
+    }
+    auto header = reinterpret_cast<StatsHeader*>(m_data);
+    header->magic = StatsHeader::MAGIC;
+    header->version = StatsHeader::VERSION;
+    header->sequence.store(0u, std::memory_order_relaxed);
+    header->size = sizeof(StatsHeader);
+    header->updated = 0u;
+    header->entries = 0u;
+    header->reserved = 0u;
+    return true;
+}
+
+bool StatsSegment::reserve(std::size_t size)
+{
+    if (size <= m_size)
+    {
+        return true;
+    }
+    // The segment only ever grows so that a reader's mapping of it stays
+    // valid, and it can remap once it sees the larger size
+    std::size_t newSize = std::max(std::max(size, m_size * 2u), MINIMUM_SIZE);
+    if (ftruncate(m_handle, newSize) == -1)
+    {
+        Log::warn << "Unable to grow the statistics segment";
+        return false;
+    }
+    void* data = mmap(
+        nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_handle, 0
+    );
+    if (data == MAP_FAILED)
+    {
+        Log::warn << "Unable to map the statistics segment";
+        return false;
+    }
+    if (m_data)
+    {
+        (void) munmap(m_data, m_size);
+    }
+    m_data = static_cast<char*>(data);
+    m_size = newSize;
+    return true;
+}
+
+void StatsSegment::publish()
+{
+    if (!m_data)
+    {
+        return;
+    }
+
+    // Take the values without holding anything up, then copy them in
+    m_buffer.clear();
+    std::uint32_t entries = 0u;
+    m_metrics->visit(
+        [this, &entries](const Metrics::Info& info, const Metrics::Counter& counter)
+        {
+            appendEntry(m_buffer, info, StatsEntry::COUNTER, 1u);
+            appendValue(m_buffer, counter.value());
+            ++entries;
+        },
+        [this, &entries](const Metrics::Info& info, const Metrics::Gauge& gauge)
+        {
+            appendEntry(m_buffer, info, StatsEntry::GAUGE, 1u);
+            appendValue(m_buffer, static_cast<std::uint64_t>(gauge.value()));
+            ++entries;
+        },
+        [this, &entries](const Metrics::Info& info, const Metrics::Histogram& histogram)
+        {
+            appendEntry(
+                m_buffer, info, StatsEntry::HISTOGRAM,
+                Metrics::Histogram::BUCKETS + 1u
+            );
+            appendValue(m_buffer, histogram.sum());
+            for (std::size_t bucket = 0u;
+                 bucket < Metrics::Histogram::BUCKETS;
+                 ++bucket)
+            {
+                appendValue(m_buffer, histogram.count(bucket));
+            }
+            ++entries;
+        }
+    );
+
+    std::size_t size = sizeof(StatsHeader) + m_buffer.size();
+    if (!reserve(size))
+    {
+        return;
+    }
+    auto header = reinterpret_cast<StatsHeader*>(m_data);
+    std::uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1u, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->size = size;
+    header->updated = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+    header->entries = entries;
+    memcpy(m_data + sizeof(StatsHeader), m_buffer.data(), m_buffer.size());
+    header->sequence.store(sequence + 2u, std::memory_order_release);
+}
+
+void StatsSegment::start(std::chrono::milliseconds interval)
+{
+    if (m_data && !m_thread.joinable())
+    {
+        m_stopping = false;
+        m_thread = std::thread(&StatsSegment::run, this, interval);
+    }
+}
+
+void StatsSegment::stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+    publish();
+}
+
+void StatsSegment::run(std::chrono::milliseconds interval)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping)
+    {
+        lock.unlock();
+        publish();
+        lock.lock();
+        m_condition.wait_for(lock, interval, [this]() { return m_stopping; });
+    }
+}
+
+StatsReader::StatsReader() :
+    m_handle(-1),
+    m_data(nullptr),
+    m_size(0u)
+{ }
+
+StatsReader::~StatsReader()
+{
+    if (m_data)
+    {
+        (void) munmap(m_data, m_size);
+    }
+    if (m_handle != -1)
+    {
+        (void) close(m_handle);
+    }
+}
+
+bool StatsReader::open(const std::string& name)
+{
+    m_handle = shm_open(name.c_str(), O_RDONLY, 0);
+    if (m_handle == -1 || !map())
+    {
+        return false;
+    }
+    auto header = reinterpret_cast<const StatsHeader*>(m_data);
+    return header->magic == StatsHeader::MAGIC &&
+        header->version == StatsHeader::VERSION;
+}
+
+bool StatsReader::map()
+{
+    struct stat info;
+    if (fstat(m_handle, &info) == -1 ||
+            static_cast<std::size_t>(info.st_size) < sizeof(StatsHeader))
+    {
+        return false;
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, m_handle, 0);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    if (m_data)
+    {
+        (void) munmap(m_data, m_size);
+    }
+    m_data = static_cast<char*>(data);
+    m_size = info.st_size;
+    return true;
+}
+
+bool StatsReader::read(std::vector<Metric>& metrics, std::uint64_t& updated)
+{
+    if (!m_data)
+    {
+        return false;
+    }
+
+    std::vector<char> copy;
+    std::uint32_t entries = 0u;
+    bool consistent = false;
+    for (unsigned int attempt = 0u; !consistent && attempt < READ_ATTEMPTS; ++attempt)
+    {
+        auto header = reinterpret_cast<const StatsHeader*>(m_data);
+        std::uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence & 1u)
+        {
+            // Being written
+            sched_yield();
+            continue;
+        }
+        std::size_t size = header->size;
+        if (size > m_size)
+        {
+            // The segment has grown since it was mapped
+            if (!map())
+            {
+                return false;
+            }
+            continue;
+        }
+        updated = header->updated;
+        entries = header->entries;
+        copy.assign(m_data, m_data + size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        consistent =
+            header->sequence.load(std::memory_order_relaxed) == sequence;
+    }
+    if (!consistent)
+    {
+        return false;
+    }
+
+    metrics.clear();
+    std::size_t offset = sizeof(StatsHeader);
+    for (std::uint32_t i = 0u; i < entries; ++i)
+    {
+        StatsEntry entry;
+        if (offset + sizeof(entry) > copy.size())
+        {
+            return false;
+        }
+        memcpy(&entry, copy.data() + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (entry.values > (copy.size() - offset) / sizeof(std::uint64_t))
+        {
+            return false;
+        }
+        Metric metric {
+            entry.type,
+            std::string(entry.name, strnlen(entry.name, sizeof(entry.name))),
+            std::string(entry.labels, strnlen(entry.labels, sizeof(entry.labels))),
+            std::vector<std::uint64_t>(entry.values)
+        };
+        memcpy(
+            metric.values.data(), copy.data() + offset,
+            entry.values * sizeof(std::uint64_t)
+        );
+        offset += entry.values * sizeof(std::uint64_t);
+        metrics.emplace_back(std::move(metric));
+    }
+    return true;
+}
+
+}  // namespace dote
@@ -0,0 +1,230 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace dote {
+
+constexpr unsigned int TimerWheel::LEVEL_BITS;
+constexpr unsigned int TimerWheel::SLOTS;
+constexpr unsigned int TimerWheel::LEVELS;
+
+TimerWheel::TimerWheel() :
+    m_start(std::chrono::steady_clock::now()),
+    m_current(0u),
+    m_nextId(1),
+    m_pending(0u),
+    m_timers(),
+    m_slots(),
+    m_deferred()
+{ }
+
+uint64_t TimerWheel::now() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_start
+    ).count();
+}
+
+int TimerWheel::allocate(Callback callback)
+{
+    int id;
+    do
+    {
+        id = m_nextId;
+        m_nextId = (m_nextId == std::numeric_limits<int>::max() ? 1 : m_nextId + 1);
+    } while (m_timers.count(id) != 0u);
+
+    Timer& timer = m_timers[id];
+    timer.callback = std::move(callback);
+    timer.expiry = 0u;
+    timer.slot = nullptr;
+    return id;
+}
+
+int TimerWheel::add(std::chrono::milliseconds delay, Callback callback)
+{
+    int id = allocate(std::move(callback));
+    Timer& timer = m_timers[id];
+    timer.expiry = now() + std::max<std::chrono::milliseconds::rep>(delay.count(), 0);
+    place(id, timer);
+    ++m_pending;
+    return id;
+}
+
+int TimerWheel::defer(Callback callback)
+{
+    int id = allocate(std::move(callback));
+    m_deferred.push_back(id);
+    return id;
+}
+
+void TimerWheel::remove(int id)
+{
+    auto it = m_timers.find(id);
+    if (it != m_timers.end())
+    {
+        if (it->second.slot != nullptr)
+        {
+            it->second.slot->erase(it->second.position);
+            --m_pending;
+        }
+        m_timers.erase(it);
+    }
+}
+
+bool TimerWheel::pending() const
+{
+    return m_pending != 0u;
+}
+
+void TimerWheel::place(int id, Timer& timer)
+{
+    constexpr uint64_t RANGE = uint64_t(1u) << (LEVEL_BITS * LEVELS);
+
+    // The current tick has already been fired
+    uint64_t expiry = std::max(timer.expiry, m_current + 1u);
+    uint64_t delta = expiry - m_current;
+    unsigned int level = 0u;
+    while (level + 1u < LEVELS && delta >= (uint64_t(1u) << (LEVEL_BITS * (level + 1u))))
+    {
+        ++level;
+    }
+    if (delta >= RANGE)
+    {
+        // Park it at the furthest point, it will be placed again once it
+        // gets there
+        expiry = m_current + RANGE - 1u;
+    }
+
+    Slot& slot = m_slots[level][(expiry >> (LEVEL_BITS * level)) & (SLOTS - 1u)];
+    timer.position = slot.insert(slot.end(), id);
+    timer.slot = &slot;
+}
+
+void TimerWheel::cascade(unsigned int level)
+{
+    Slot& slot = m_slots[level][(m_current >> (LEVEL_BITS * level)) & (SLOTS - 1u)];
+    while (!slot.empty())
+    {
+        int id = slot.front();
+        slot.pop_front();
+        place(id, m_timers[id]);
+    }
+}
+
+void TimerWheel::fire()
+{
+    Slot& slot = m_slots[0][m_current & (SLOTS - 1u)];
+    while (!slot.empty())
+    {
+        int id = slot.front();
+        slot.pop_front();
+        Timer& timer = m_timers[id];
+        timer.slot = nullptr;
+        --m_pending;
+        // The callback may remove the timer, so take it out first
+        Callback callback = std::move(timer.callback);
+        timer.callback = nullptr;
+        if (callback)
+        {
+            callback(id);
+        }
+    }
+}
+
+void TimerWheel::expire()
+{
+    uint64_t target = now();
+    if (m_pending == 0u)
+    {
+        // Nothing in the wheel so nothing to move through it
+        m_current = std::max(m_current, target);
+    }
+    else
+    {
+        while (m_current < target)
+        {
+            ++m_current;
+            for (unsigned int level = LEVELS - 1u; level > 0u; --level)
+            {
+                if ((m_current & ((uint64_t(1u) << (LEVEL_BITS * level)) - 1u)) == 0u)
+                {
+                    cascade(level);
+                }
+            }
+            fire();
+        }
+    }
+
+    runDeferred();
+}
+
+void TimerWheel::runDeferred()
+{
+    while (!m_deferred.empty())
+    {
+        int id = m_deferred.front();
+        m_deferred.pop_front();
+        // The identifier may have been removed and re-used by a timer
+        auto it = m_timers.find(id);
+        if (it == m_timers.end() || it->second.slot != nullptr)
+        {
+            continue;
+        }
+        // The callback may remove itself, so take it out first
+        Callback callback = std::move(it->second.callback);
+        it->second.callback = nullptr;
+        if (callback)
+        {
+            callback(id);
+        }
+    }
+}
+
+int TimerWheel::timeout() const
+{
+    if (!m_deferred.empty())
+    {
+        return 0;
+    }
+    if (m_pending == 0u)
+    {
+        return -1;
+    }
+
+    // Find the next tick that either fires a timer or moves some down
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+    for (unsigned int i = 1u; i < SLOTS; ++i)
+    {
+        if (!m_slots[0][(m_current + i) & (SLOTS - 1u)].empty())
+        {
+            next = m_current + i;
+            break;
+        }
+    }
+    for (unsigned int level = 1u; level < LEVELS; ++level)
+    {
+        unsigned int shift = LEVEL_BITS * level;
+        for (unsigned int i = 1u; i <= SLOTS; ++i)
+        {
+            uint64_t tick = ((m_current >> shift) + i) << shift;
+            if (!m_slots[level][(tick >> shift) & (SLOTS - 1u)].empty())
+            {
+                next = std::min(next, tick);
+                break;
+            }
+        }
+    }
+
+    uint64_t current = now();
+    if (next <= current)
+    {
+        return 0;
+    }
+    return static_cast<int>(std::min<uint64_t>(
+        next - current, std::numeric_limits<int>::max()
+    ));
+}
+
+}  // namespace dote
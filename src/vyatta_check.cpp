@@ -2,9 +2,10 @@
 #include "vyatta_check.h"
 #include "vyatta.h"
 #include "dote.h"
-#include "loop.h"
+#include "i_loop.h"
 #include "log.h"
 
+#include <climits>
 #include <cstring>
 #include <sys/inotify.h>
 #include <unistd.h>
@@ -0,0 +1,297 @@
+
+#include "worker.h"
+#include "log.h"
+#include "loop.h"
+#ifdef __linux__
+#include "epoll_loop.h"
+#endif
+#include "server.h"
+#include "config_parser.h"
+#include "client_forwarders.h"
+#include "forwarder_config.h"
+#include "health_checker.h"
+#include "dns_cache.h"
+#include "packet_pool.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "openssl/context.h"
+#include "openssl/ssl_factory.h"
+
+#include <openssl/x509.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dote {
+
+using namespace std::placeholders;
+
+namespace {
+
+/// \brief  Create the most efficient loop available on this platform
+///
+/// \return  The loop to run the worker on
+std::shared_ptr<ILoop> createLoop()
+{
+#ifdef __linux__
+    auto loop = std::make_shared<EpollLoop>();
+    if (loop->valid())
+    {
+        return loop;
+    }
+    Log::warn << "Falling back to poll for the event loop";
+#endif
+    return std::make_shared<Loop>();
+}
+
+/// \brief  Create a pipe that doesn't block on either end
+///
+/// \param handles  The read and write ends of the pipe, -1 on failure
+void createPipe(int handles[2])
+{
+    if (pipe(handles) == -1)
+    {
+        handles[0] = handles[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        int flags = fcntl(handles[i], F_GETFL, 0);
+        if (flags != -1)
+        {
+            (void) fcntl(handles[i], F_SETFL, flags | O_NONBLOCK);
+        }
+    }
+}
+
+}  // anon namespace
+
+Worker::Worker(const ConfigParser& config, std::shared_ptr<Metrics> metrics) :
+    m_loop(createLoop()),
+    m_metrics(std::move(metrics)),
+    m_packetPool(std::make_shared<PacketPool>()),
+    m_config(std::make_shared<ForwarderConfig>(m_metrics)),
+    m_context(std::make_shared<openssl::Context>(config.ciphers())),
+    m_forwarders(std::make_shared<ClientForwarders>(
+        m_loop,
+        m_config,
+        std::make_shared<openssl::SslFactory>(m_context),
+        config.maxConnections(),
+        m_metrics
+    )),
+    m_health(nullptr),
+    m_server(nullptr),
+    m_metricsServer(nullptr),
+    m_cache(&X509_verify_cert, CACHE_SECONDS),
+    m_wakePipe{-1, -1},
+    m_wake(),
+    m_stopping(false),
+    m_mutex(),
+    m_tasks()
+{
+    applyForwarders(config);
+    m_config->setTimeout(config.timeout());
+    m_config->setIdleTimeout(config.idleTimeout());
+    m_config->setEarlyData(config.earlyData());
+    m_config->setFailureThreshold(config.failureThreshold());
+    m_forwarders->setPacketPool(m_packetPool);
+    m_forwarders->setPoolSize(config.poolSize());
+    m_forwarders->setPipelineDepth(config.pipelineDepth());
+    m_forwarders->setQueueLimits(
+        config.queueSize(), std::chrono::milliseconds(config.queueDeadline())
+    );
+    m_forwarders->setHedgeDelay(std::chrono::milliseconds(config.hedgeDelay()));
+    m_forwarders->setWarmConnections(config.warmConnections());
+    m_forwarders->setRetries(config.retries());
+    if (config.cacheSize() > 0u)
+    {
+        m_forwarders->setCache(std::make_shared<DnsCache>(
+            config.cacheSize(), config.cacheTtl()
+        ));
+    }
+    m_context->setChainVerifier(std::bind(&VerifyCache::verify, &m_cache, _1));
+    if (config.kernelTls())
+    {
+        m_context->enableKernelTls();
+    }
+    if (config.failureThreshold() > 0u)
+    {
+        m_health = std::make_shared<HealthChecker>(
+            m_loop,
+            m_config,
+            std::make_shared<openssl::SslFactory>(m_context),
+            m_packetPool
+        );
+    }
+
+    createPipe(m_wakePipe);
+    if (m_wakePipe[0] != -1)
+    {
+        m_wake = m_loop->registerRead(
+            m_wakePipe[0], std::bind(&Worker::wake, this, _1), 0
+        );
+    }
+    else
+    {
+        Log::err << "Unable to create the pipe to wake the worker";
+    }
+}
+
+Worker::~Worker()
+{
+    m_wake.reset();
+    for (int handle : m_wakePipe)
+    {
+        if (handle != -1)
+        {
+            close(handle);
+        }
+    }
+}
+
+bool Worker::listen(const ConfigParser& config, bool reusePort)
+{
+    bool result = true;
+    m_server = std::make_shared<Server>(m_loop, m_forwarders, m_metrics);
+    m_server->setReusePort(reusePort);
+    m_server->setPacketPool(m_packetPool);
+    for (const auto& serverConfig : config.servers())
+    {
+        char ip[64];
+        switch(serverConfig.address.ss_family) {
+            case AF_INET:
+                inet_ntop(AF_INET, &reinterpret_cast<const struct sockaddr_in&>(serverConfig.address).sin_addr, ip, sizeof(ip));
+                break;
+
+            case AF_INET6:
+                inet_ntop(AF_INET6, &reinterpret_cast<const struct sockaddr_in6&>(serverConfig.address).sin6_addr, ip, sizeof(ip));
+                break;
+            default:
+                ip[0] = '\0';
+                break;
+        }
+        if (!m_server->addServer(serverConfig))
+        {
+            Log::err << "Unable to bind to server port " << ip;
+            result = false;
+        }
+        else
+        {
+            Log::info << "Bound server " << ip;
+        }
+    }
+    if (!result)
+    {
+        m_server.reset();
+    }
+    else
+    {
+        // Have connections ready for the first requests
+        m_forwarders->warm();
+    }
+    return result;
+}
+
+bool Worker::serveMetrics(const sockaddr_storage& address,
+                          std::shared_ptr<Metrics> metrics)
+{
+    m_metricsServer = std::make_shared<MetricsServer>(m_loop, std::move(metrics));
+    if (!m_metricsServer->listen(address))
+    {
+        Log::err << "Unable to serve the metrics";
+        m_metricsServer.reset();
+        return false;
+    }
+    return true;
+}
+
+void Worker::setForwarders(const ConfigParser& config)
+{
+    if (m_wakePipe[1] == -1)
+    {
+        // Can't pass it to the loop, so this must be its only thread
+        applyForwarders(config);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back([this, config]() { applyForwarders(config); });
+    }
+    char byte = 0;
+    (void) write(m_wakePipe[1], &byte, sizeof(byte));
+}
+
+void Worker::applyForwarders(const ConfigParser& config)
+{
+    m_config->clear();
+    for (const auto& forwarderConfig : config.forwarders())
+    {
+        m_config->addForwarder(forwarderConfig);
+    }
+    if (m_server)
+    {
+        // Warm up connections to any forwarders that have been added
+        m_forwarders->warm();
+    }
+}
+
+void Worker::run()
+{
+    m_loop->run();
+}
+
+void Worker::shutdown()
+{
+    // This may be a signal handler, so the worker's own thread is woken to
+    // stop listening rather than doing it here
+    m_stopping = true;
+    if (m_wakePipe[1] != -1)
+    {
+        char byte = 0;
+        (void) write(m_wakePipe[1], &byte, sizeof(byte));
+    }
+    else
+    {
+        m_server.reset();
+        m_metricsServer.reset();
+        m_forwarders->setWarmConnections(0u);
+        m_health.reset();
+    }
+}
+
+void Worker::wake(int handle)
+{
+    char buffer[64];
+    while (read(handle, buffer, sizeof(buffer)) > 0)
+    { }
+
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(tasks, m_tasks);
+    }
+    for (auto& task : tasks)
+    {
+        task();
+    }
+
+    if (m_stopping)
+    {
+        // Stop listening, and stop waiting for wake ups so that the
+        // loop exits when no more requests are in progress
+        Log::info << "Shutdown signal received";
+        m_server.reset();
+        m_metricsServer.reset();
+        m_wake.reset();
+        m_forwarders->setWarmConnections(0u);
+        m_health.reset();
+    }
+}
+
+std::shared_ptr<ILoop> Worker::looper()
+{
+    return m_loop;
+}
+
+}  // namespace dote
@@ -15,9 +15,23 @@ class MockForwarderConfig : public IForwarderConfig
 
     MOCK_METHOD1(addForwarder, void(const ConfigParser::Forwarder&));
     MOCK_METHOD1(setBad, void(const ConfigParser::Forwarder&));
+    MOCK_METHOD2(setHandshakeTime, void(const ConfigParser::Forwarder&, std::chrono::microseconds));
+    MOCK_METHOD2(setConnectTime, void(const ConfigParser::Forwarder&, std::chrono::microseconds));
+    MOCK_METHOD2(setFirstByteTime, void(const ConfigParser::Forwarder&, std::chrono::microseconds));
+    MOCK_METHOD2(setResponseTime, void(const ConfigParser::Forwarder&, std::chrono::microseconds));
+    MOCK_CONST_METHOD1(healthy, bool(const ConfigParser::Forwarder&));
+    MOCK_METHOD0(dueForProbe, std::vector<ConfigParser::Forwarder>());
+    MOCK_METHOD2(setProbeResult, void(const ConfigParser::Forwarder&, bool));
     MOCK_CONST_METHOD0(get, std::vector<ConfigParser::Forwarder>::const_iterator());
+    MOCK_CONST_METHOD1(getAlternative, std::vector<ConfigParser::Forwarder>::const_iterator(const ConfigParser::Forwarder&));
+    MOCK_CONST_METHOD0(begin, std::vector<ConfigParser::Forwarder>::const_iterator());
     MOCK_CONST_METHOD0(end, std::vector<ConfigParser::Forwarder>::const_iterator());
     MOCK_CONST_METHOD0(timeout, unsigned int());
+    MOCK_CONST_METHOD0(idleTimeout, unsigned int());
+    MOCK_CONST_METHOD0(earlyData, bool());
+    MOCK_METHOD0(addEarlyData, void());
+    MOCK_METHOD0(addKernelTls, void());
+    MOCK_METHOD1(addResumption, void(const ConfigParser::Forwarder&));
 };
 
 }  // namespace dote
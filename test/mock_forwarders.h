@@ -18,6 +18,9 @@ class MockForwarders : public IForwarders
                                      const sockaddr_storage& server,
                                      int interface,
                                      std::vector<char> request));
+
+    MOCK_METHOD2(handleRequests, void(std::shared_ptr<Socket> socket,
+                                      std::vector<Request> requests));
 };
 
 }  // namespace dote
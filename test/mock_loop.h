@@ -16,9 +16,13 @@ class MockLoop : public ILoop
     MOCK_METHOD3(registerRead, ILoop::Registration(int, Callback, time_t));
     MOCK_METHOD3(registerWrite, ILoop::Registration(int, Callback, time_t));
     MOCK_METHOD2(registerException, ILoop::Registration(int, Callback));
+    MOCK_METHOD2(registerTimer, ILoop::Registration(std::chrono::milliseconds, Callback));
+    MOCK_METHOD1(registerDeferred, ILoop::Registration(Callback));
+    MOCK_METHOD0(run, void());
     MOCK_METHOD1(removeRead, void(int));
     MOCK_METHOD1(removeWrite, void(int));
     MOCK_METHOD1(removeException, void(int));
+    MOCK_METHOD1(removeTimer, void(int));
 };
 
 }  // namespace dote
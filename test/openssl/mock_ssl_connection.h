@@ -15,14 +15,20 @@ class MockSslConnection : public ISslConnection
     { }
 
     MOCK_METHOD1(setSocket, void(int));
+    MOCK_METHOD2(setServer, void(const sockaddr_storage&, const std::string&));
     MOCK_METHOD0(disableVerification, void());
     MOCK_METHOD1(setVerifier, void(Verifier));
     MOCK_METHOD0(getPeerCertificatePublicKeyHash, std::vector<unsigned char>());
     MOCK_METHOD0(getCommonName, std::string());
     MOCK_METHOD0(connect, Result());
+    MOCK_METHOD0(maxEarlyData, std::size_t());
+    MOCK_METHOD1(writeEarlyData, Result(const std::vector<char>&));
+    MOCK_METHOD0(earlyDataAccepted, bool());
+    MOCK_METHOD0(kernelTls, bool());
+    MOCK_METHOD0(sessionResumed, bool());
     MOCK_METHOD0(shutdown, Result());
     MOCK_METHOD1(write, Result(const std::vector<char>&));
-    MOCK_METHOD1(read, Result(std::vector<char>&));
+    MOCK_METHOD3(read, Result(char*, std::size_t, std::size_t&));
 };
 
 }  // namespace openssl
@@ -1,8 +1,12 @@
 
 #include "openssl/context.h"
 
+#include <openssl/ssl.h>
+
 #include <gtest/gtest.h>
 
+#include <ctime>
+
 namespace dote {
 namespace openssl {
 
@@ -14,13 +18,66 @@ class TestingContext : public Context
     { }
 
     using Context::get;
+    using Context::cacheSession;
+    using Context::getSession;
+    using Context::clearSessions;
 };
 
+namespace {
+
+SSL_SESSION* createSession(int version, long age)
+{
+    const unsigned char id[] = { 0x1 };
+    SSL_SESSION* session = SSL_SESSION_new();
+    SSL_SESSION_set1_id(session, id, sizeof(id));
+    SSL_SESSION_set_protocol_version(session, version);
+    SSL_SESSION_set_time(session, std::time(nullptr) - age);
+    SSL_SESSION_set_timeout(session, 300);
+    return session;
+}
+
+}  // anon namespace
+
 TEST(TestContext, ContextCreated)
 {
     TestingContext context("ALL");
     EXPECT_NE(nullptr, context.get());
 }
 
+TEST(TestContext, SessionsPerServer)
+{
+    TestingContext context("ALL");
+    SSL_SESSION* first = createSession(TLS1_2_VERSION, 0);
+    context.cacheSession("one", first);
+    EXPECT_EQ(nullptr, context.getSession("two"));
+    SSL_SESSION* session = context.getSession("one");
+    EXPECT_EQ(first, session);
+    SSL_SESSION_free(session);
+    // TLS 1.2 sessions may be resumed more than once
+    session = context.getSession("one");
+    EXPECT_EQ(first, session);
+    SSL_SESSION_free(session);
+    context.clearSessions("one");
+    EXPECT_EQ(nullptr, context.getSession("one"));
+}
+
+TEST(TestContext, TicketsUsedOnce)
+{
+    TestingContext context("ALL");
+    SSL_SESSION* first = createSession(TLS1_3_VERSION, 0);
+    SSL_SESSION* second = createSession(TLS1_3_VERSION, 0);
+    context.cacheSession("one", createSession(TLS1_3_VERSION, 600));
+    context.cacheSession("one", first);
+    context.cacheSession("one", second);
+    SSL_SESSION* session = context.getSession("one");
+    EXPECT_EQ(second, session);
+    SSL_SESSION_free(session);
+    session = context.getSession("one");
+    EXPECT_EQ(first, session);
+    SSL_SESSION_free(session);
+    // The expired ticket is not used
+    EXPECT_EQ(nullptr, context.getSession("one"));
+}
+
 }  // namespace openssl
 }  // namespace dote
@@ -1,5 +1,6 @@
 
 #include "client_forwarders.h"
+#include "dns_cache.h"
 #include "socket.h"
 #include "parse_inet.h"
 #include "mock_loop.h"
@@ -7,9 +8,17 @@
 #include "openssl/mock_ssl_factory.h"
 #include "openssl/mock_ssl_connection.h"
 
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <thread>
+
 namespace dote {
 
 using ::testing::Return;
+using ::testing::NiceMock;
+using ::testing::Invoke;
+using ::testing::_;
 
 class TestClientForwarders : public ::testing::Test
 {
@@ -36,7 +45,9 @@ TEST_F(TestClientForwarders, HandleRequest)
     sockaddr_storage client = parse4("127.0.0.1", htons(60000));
     sockaddr_storage server = { 0, AF_UNSPEC };
     int interface = -1;
-    ClientForwarders forwarders(m_loop, m_config, m_ssl, 1u);
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 1u, std::make_shared<Metrics>()
+    );
     std::shared_ptr<openssl::MockSslConnection> connection(
         std::make_shared<openssl::MockSslConnection>()
     );
@@ -44,7 +55,7 @@ TEST_F(TestClientForwarders, HandleRequest)
         .WillOnce(Return(connection));
     std::vector<ConfigParser::Forwarder> configurations;
     configurations.emplace_back(ConfigParser::Forwarder {
-        parse4("127.0.0.1", 4000), false, "", {}
+        parse4("127.0.0.1", 4000), false, "", {}, false
     });
     EXPECT_CALL(*m_config, get())
         .WillOnce(Return(configurations.begin()));
@@ -53,4 +64,633 @@ TEST_F(TestClientForwarders, HandleRequest)
     forwarders.handleRequest(socketOne, client, server, interface, request);
 }
 
+/// \brief  Passes requests through forwarder connections with a fake loop
+///         and mocked TLS so that the requests written to each forwarder
+///         and the replies sent to the client can be checked
+class TestClientForwardersExchange : public ::testing::Test
+{
+  public:
+    /// \brief  A connection to a forwarder and the data passed over it
+    struct Upstream
+    {
+        /// The mocked TLS connection
+        std::shared_ptr<NiceMock<openssl::MockSslConnection>> ssl;
+        /// The forwarder the connection was made to
+        sockaddr_storage remote;
+        /// The handle of the socket the connection was given
+        int handle;
+        /// The bytes that have been written to the forwarder
+        std::vector<char> written;
+        /// The bytes waiting to be read from the forwarder
+        std::vector<char> pending;
+        /// Set once the forwarder has closed the connection
+        bool closed;
+    };
+
+    TestClientForwardersExchange() :
+        m_loop(std::make_shared<NiceMock<MockLoop>>()),
+        m_config(std::make_shared<NiceMock<MockForwarderConfig>>()),
+        m_ssl(std::make_shared<openssl::MockSslFactory>()),
+        m_listeners(),
+        m_configurations(),
+        m_upstreams(),
+        m_reads(),
+        m_writes(),
+        m_timers(),
+        m_nextTimer(0),
+        m_server(std::make_shared<Socket>(AF_INET, Socket::Type::UDP)),
+        m_client(Socket::bind(parse4("127.0.0.1", 0), Socket::Type::UDP)),
+        m_clientAddress()
+    {
+        socklen_t length = sizeof(m_clientAddress);
+        getsockname(
+            m_client->get(), reinterpret_cast<sockaddr*>(&m_clientAddress),
+            &length
+        );
+        for (int i = 0; i < 2; ++i)
+        {
+            // Somewhere for the connections to the forwarders to go
+            sockaddr_storage address;
+            length = sizeof(address);
+            m_listeners.emplace_back(Socket::listen(parse4("127.0.0.1", 0)));
+            getsockname(
+                m_listeners.back()->get(),
+                reinterpret_cast<sockaddr*>(&address),
+                &length
+            );
+            m_configurations.emplace_back(ConfigParser::Forwarder {
+                address, false, "", {}, false
+            });
+        }
+
+        ON_CALL(*m_loop, registerRead(_, _, _))
+            .WillByDefault(Invoke([this](int handle, ILoop::Callback callback, time_t)
+            {
+                m_reads[handle] = std::move(callback);
+                return ILoop::Registration(m_loop.get(), handle, ILoop::Read);
+            }));
+        ON_CALL(*m_loop, registerWrite(_, _, _))
+            .WillByDefault(Invoke([this](int handle, ILoop::Callback callback, time_t)
+            {
+                m_writes[handle] = std::move(callback);
+                return ILoop::Registration(m_loop.get(), handle, ILoop::Write);
+            }));
+        ON_CALL(*m_loop, registerTimer(_, _))
+            .WillByDefault(Invoke([this](std::chrono::milliseconds delay,
+                                         ILoop::Callback callback)
+            {
+                int id = m_nextTimer++;
+                m_timers[id] = std::make_pair(delay, std::move(callback));
+                return ILoop::Registration(m_loop.get(), id, ILoop::Timer);
+            }));
+        ON_CALL(*m_loop, removeRead(_))
+            .WillByDefault(Invoke([this](int handle) { m_reads.erase(handle); }));
+        ON_CALL(*m_loop, removeWrite(_))
+            .WillByDefault(Invoke([this](int handle) { m_writes.erase(handle); }));
+        ON_CALL(*m_loop, removeTimer(_))
+            .WillByDefault(Invoke([this](int id) { m_timers.erase(id); }));
+
+        ON_CALL(*m_config, get())
+            .WillByDefault(Return(m_configurations.cbegin()));
+        ON_CALL(*m_config, begin())
+            .WillByDefault(Return(m_configurations.cbegin()));
+        ON_CALL(*m_config, end())
+            .WillByDefault(Return(m_configurations.cend()));
+        ON_CALL(*m_config, getAlternative(_))
+            .WillByDefault(Invoke([this](const ConfigParser::Forwarder& exclude)
+            {
+                return memcmp(&exclude.remote, &m_configurations[0].remote,
+                              sizeof(exclude.remote)) == 0 ?
+                    m_configurations.cbegin() + 1 : m_configurations.cbegin();
+            }));
+        ON_CALL(*m_config, healthy(_))
+            .WillByDefault(Return(true));
+        ON_CALL(*m_config, timeout())
+            .WillByDefault(Return(5u));
+        ON_CALL(*m_config, idleTimeout())
+            .WillByDefault(Return(10u));
+
+        EXPECT_CALL(*m_ssl, create())
+            .WillRepeatedly(Invoke([this]()
+            {
+                m_upstreams.emplace_back();
+                Upstream& upstream = m_upstreams.back();
+                upstream.ssl =
+                    std::make_shared<NiceMock<openssl::MockSslConnection>>();
+                upstream.handle = -1;
+                upstream.closed = false;
+                ON_CALL(*upstream.ssl, setServer(_, _))
+                    .WillByDefault(Invoke([&upstream](const sockaddr_storage& remote,
+                                                      const std::string&)
+                    {
+                        upstream.remote = remote;
+                    }));
+                ON_CALL(*upstream.ssl, setSocket(_))
+                    .WillByDefault(Invoke([&upstream](int handle)
+                    {
+                        upstream.handle = handle;
+                    }));
+                ON_CALL(*upstream.ssl, connect())
+                    .WillByDefault(Return(openssl::ISslConnection::Result::SUCCESS));
+                ON_CALL(*upstream.ssl, write(_))
+                    .WillByDefault(Invoke([&upstream](const std::vector<char>& buffer)
+                    {
+                        upstream.written.insert(
+                            upstream.written.end(), buffer.begin(), buffer.end()
+                        );
+                        return openssl::ISslConnection::Result::SUCCESS;
+                    }));
+                ON_CALL(*upstream.ssl, read(_, _, _))
+                    .WillByDefault(Invoke([&upstream](char* buffer,
+                                                      std::size_t size,
+                                                      std::size_t& length)
+                    {
+                        length = std::min(size, upstream.pending.size());
+                        if (length == 0u && upstream.closed)
+                        {
+                            return openssl::ISslConnection::Result::CLOSED;
+                        }
+                        if (length == 0u)
+                        {
+                            return openssl::ISslConnection::Result::NEED_READ;
+                        }
+                        std::copy(
+                            upstream.pending.begin(),
+                            upstream.pending.begin() + length,
+                            buffer
+                        );
+                        upstream.pending.erase(
+                            upstream.pending.begin(),
+                            upstream.pending.begin() + length
+                        );
+                        return openssl::ISslConnection::Result::SUCCESS;
+                    }));
+                return upstream.ssl;
+            }));
+    }
+
+  protected:
+    /// \brief  Build a TCP framed request for the A record of a name
+    static std::vector<char> request(const std::string& name, unsigned short id)
+    {
+        std::vector<char> packet = {
+            0x00, 0x00, static_cast<char>(id >> 8), static_cast<char>(id),
+            0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        };
+        std::size_t start = 0u;
+        for (std::size_t i = 0u; i <= name.size(); ++i)
+        {
+            if (i == name.size() || name[i] == '.')
+            {
+                packet.push_back(i - start);
+                packet.insert(
+                    packet.end(), name.begin() + start, name.begin() + i
+                );
+                start = i + 1u;
+            }
+        }
+        packet.insert(packet.end(), { 0x00, 0x00, 0x01, 0x00, 0x01 });
+        packet[0] = (packet.size() - 2u) >> 8;
+        packet[1] = (packet.size() - 2u) & 0xff;
+        return packet;
+    }
+
+    /// \brief  Split the bytes written to a forwarder into the requests
+    static std::vector<std::vector<char>> frames(const std::vector<char>& stream)
+    {
+        std::vector<std::vector<char>> result;
+        std::size_t offset = 0u;
+        while (stream.size() - offset >= 2u)
+        {
+            std::size_t length = 2u + (
+                (static_cast<unsigned char>(stream[offset]) << 8) |
+                static_cast<unsigned char>(stream[offset + 1u])
+            );
+            result.emplace_back(
+                stream.begin() + offset, stream.begin() + offset + length
+            );
+            offset += length;
+        }
+        return result;
+    }
+
+    /// \brief  Send a request from the client
+    void ask(ClientForwarders& forwarders,
+             const std::string& name,
+             unsigned short id)
+    {
+        sockaddr_storage server = { 0, AF_UNSPEC };
+        forwarders.handleRequest(
+            m_server, m_clientAddress, server, -1, request(name, id)
+        );
+    }
+
+    /// \brief  Let every connection that is waiting to write do so
+    void flush()
+    {
+        auto writes = m_writes;
+        for (auto& write : writes)
+        {
+            if (m_writes.count(write.first))
+            {
+                write.second(write.first);
+            }
+        }
+    }
+
+    /// \brief  Answer a request that was written to a forwarder
+    ///
+    /// \param upstream  The connection the request was written to
+    /// \param frame     The request to answer, in the order written
+    void answer(Upstream& upstream, std::size_t frame)
+    {
+        std::vector<char> response = frames(upstream.written).at(frame);
+        response[4] |= 0x80;
+        upstream.pending.insert(
+            upstream.pending.end(), response.begin(), response.end()
+        );
+        auto read = m_reads.find(upstream.handle);
+        ASSERT_NE(m_reads.end(), read);
+        auto callback = read->second;
+        callback(upstream.handle);
+    }
+
+    /// \brief  Close a connection from the forwarder's end
+    void disconnect(Upstream& upstream)
+    {
+        upstream.closed = true;
+        auto read = m_reads.find(upstream.handle);
+        ASSERT_NE(m_reads.end(), read);
+        auto callback = read->second;
+        callback(upstream.handle);
+    }
+
+    /// \brief  Fire the timers registered with a given delay
+    void fireTimers(std::chrono::milliseconds delay)
+    {
+        auto timers = m_timers;
+        for (auto& timer : timers)
+        {
+            if (timer.second.first == delay && m_timers.count(timer.first))
+            {
+                timer.second.second(timer.first);
+            }
+        }
+    }
+
+    /// \brief  Fire the timers in a copy of m_timers that are still
+    ///         registered
+    void fireTimers(
+        const std::map<int, std::pair<std::chrono::milliseconds, ILoop::Callback>>& timers)
+    {
+        for (auto& timer : timers)
+        {
+            if (m_timers.count(timer.first))
+            {
+                timer.second.second(timer.first);
+            }
+        }
+    }
+
+    /// \brief  Get the replies that the client has been sent by their ID
+    std::map<unsigned short, std::vector<char>> received()
+    {
+        std::map<unsigned short, std::vector<char>> packets;
+        char buffer[512];
+        ssize_t length;
+        while ((length = recv(m_client->get(), buffer, sizeof(buffer),
+                              MSG_DONTWAIT)) >= 2)
+        {
+            packets[
+                (static_cast<unsigned char>(buffer[0]) << 8) |
+                static_cast<unsigned char>(buffer[1])
+            ] = std::vector<char>(buffer, buffer + length);
+        }
+        return packets;
+    }
+
+    /// \brief  Get the IDs of the replies that the client has been sent
+    std::vector<unsigned short> replies()
+    {
+        std::vector<unsigned short> ids;
+        for (const auto& packet : received())
+        {
+            ids.push_back(packet.first);
+        }
+        return ids;
+    }
+
+    /// \brief  Check that a reply is a server failure
+    static bool serverFailure(const std::vector<char>& reply)
+    {
+        return reply.size() >= 4u && (reply[2] & 0x80) != 0 &&
+            (reply[3] & 0x0f) == 2;
+    }
+
+    /// \brief  Check that a reply has the question as it was asked
+    static bool sameQuestion(const std::vector<char>& reply,
+                             const std::string& name)
+    {
+        // The request is framed, the reply isn't, both have a header
+        std::vector<char> asked = request(name, 0u);
+        return reply.size() >= asked.size() - 2u && std::equal(
+            asked.begin() + 14, asked.end(), reply.begin() + 12
+        );
+    }
+
+    std::shared_ptr<NiceMock<MockLoop>> m_loop;
+    std::shared_ptr<NiceMock<MockForwarderConfig>> m_config;
+    std::shared_ptr<openssl::MockSslFactory> m_ssl;
+    std::vector<std::shared_ptr<Socket>> m_listeners;
+    std::vector<ConfigParser::Forwarder> m_configurations;
+    std::deque<Upstream> m_upstreams;
+    std::map<int, ILoop::Callback> m_reads;
+    std::map<int, ILoop::Callback> m_writes;
+    std::map<int, std::pair<std::chrono::milliseconds, ILoop::Callback>> m_timers;
+    int m_nextTimer;
+    std::shared_ptr<Socket> m_server;
+    std::shared_ptr<Socket> m_client;
+    sockaddr_storage m_clientAddress;
+};
+
+TEST_F(TestClientForwardersExchange, CoalescesIdenticalRequests)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 2u, std::make_shared<Metrics>()
+    );
+    ask(forwarders, "example.com", 1u);
+    ask(forwarders, "Example.com", 2u);
+    ask(forwarders, "EXAMPLE.com", 3u);
+    flush();
+    ASSERT_EQ(1u, m_upstreams.size());
+    EXPECT_EQ(1u, frames(m_upstreams[0].written).size());
+    answer(m_upstreams[0], 0u);
+    auto packets = received();
+    ASSERT_EQ(3u, packets.size());
+    EXPECT_TRUE(sameQuestion(packets[1u], "example.com"));
+    EXPECT_TRUE(sameQuestion(packets[2u], "Example.com"));
+    EXPECT_TRUE(sameQuestion(packets[3u], "EXAMPLE.com"));
+}
+
+TEST_F(TestClientForwardersExchange, CoalescesIdenticalRequestsWithCache)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 2u, std::make_shared<Metrics>()
+    );
+    forwarders.setCache(std::make_shared<DnsCache>(10u, 60u));
+    ask(forwarders, "example.com", 1u);
+    ask(forwarders, "example.com", 2u);
+    flush();
+    ASSERT_EQ(1u, m_upstreams.size());
+    EXPECT_EQ(1u, frames(m_upstreams[0].written).size());
+    answer(m_upstreams[0], 0u);
+    EXPECT_EQ((std::vector<unsigned short>{ 1u, 2u }), replies());
+}
+
+TEST_F(TestClientForwardersExchange, DifferentQuestionsSentSeparately)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 2u, std::make_shared<Metrics>()
+    );
+    ask(forwarders, "example.com", 1u);
+    ask(forwarders, "example.org", 2u);
+    flush();
+    ASSERT_EQ(2u, m_upstreams.size());
+    answer(m_upstreams[1], 0u);
+    EXPECT_EQ((std::vector<unsigned short>{ 2u }), replies());
+    answer(m_upstreams[0], 0u);
+    EXPECT_EQ((std::vector<unsigned short>{ 1u }), replies());
+}
+
+TEST_F(TestClientForwardersExchange, HedgedRequestRetriedWhenBothConnectionsFail)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 4u, std::make_shared<Metrics>()
+    );
+    forwarders.setHedgeDelay(std::chrono::milliseconds(50));
+    forwarders.setRetries(1u);
+    ask(forwarders, "example.com", 7u);
+    flush();
+    fireTimers(std::chrono::milliseconds(50));
+    flush();
+    ASSERT_EQ(2u, m_upstreams.size());
+    EXPECT_EQ(1u, forwarders.hedgesSent());
+    EXPECT_EQ(1u, frames(m_upstreams[1].written).size());
+
+    // The hedge is lost, and then the original
+    disconnect(m_upstreams[1]);
+    disconnect(m_upstreams[0]);
+    flush();
+    EXPECT_EQ(1u, forwarders.retriesSent());
+    ASSERT_EQ(3u, m_upstreams.size());
+    ASSERT_EQ(1u, frames(m_upstreams[2].written).size());
+    answer(m_upstreams[2], 0u);
+    EXPECT_EQ((std::vector<unsigned short>{ 7u }), replies());
+}
+
+TEST_F(TestClientForwardersExchange, HedgeAnswersFirst)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 4u, std::make_shared<Metrics>()
+    );
+    forwarders.setHedgeDelay(std::chrono::milliseconds(50));
+    ask(forwarders, "example.com", 7u);
+    flush();
+    fireTimers(std::chrono::milliseconds(50));
+    flush();
+    ASSERT_EQ(2u, m_upstreams.size());
+    answer(m_upstreams[1], 0u);
+    EXPECT_EQ(1u, forwarders.hedgesWon());
+    EXPECT_EQ((std::vector<unsigned short>{ 7u }), replies());
+
+    // The original's reply arrives late and isn't given to the client
+    answer(m_upstreams[0], 0u);
+    EXPECT_TRUE(replies().empty());
+}
+
+TEST_F(TestClientForwardersExchange, LostRequestRetriedOnce)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 4u, std::make_shared<Metrics>()
+    );
+    forwarders.setRetries(1u);
+    ask(forwarders, "example.com", 7u);
+    flush();
+    disconnect(m_upstreams[0]);
+    flush();
+    EXPECT_EQ(1u, forwarders.retriesSent());
+    ASSERT_EQ(2u, m_upstreams.size());
+    // Sent to the other forwarder
+    EXPECT_EQ(0, memcmp(&m_configurations[1].remote, &m_upstreams[1].remote,
+                        sizeof(sockaddr_storage)));
+    ASSERT_EQ(1u, frames(m_upstreams[1].written).size());
+    answer(m_upstreams[1], 0u);
+    EXPECT_EQ((std::vector<unsigned short>{ 7u }), replies());
+}
+
+TEST_F(TestClientForwardersExchange, RetriedWaitersKeepTheirIds)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 4u, std::make_shared<Metrics>()
+    );
+    forwarders.setRetries(1u);
+    ask(forwarders, "example.com", 7u);
+    ask(forwarders, "eXample.com", 8u);
+    flush();
+    disconnect(m_upstreams[0]);
+    flush();
+    ASSERT_EQ(2u, m_upstreams.size());
+    ASSERT_EQ(1u, frames(m_upstreams[1].written).size());
+    answer(m_upstreams[1], 0u);
+    auto packets = received();
+    ASSERT_EQ(2u, packets.size());
+    EXPECT_TRUE(sameQuestion(packets[7u], "example.com"));
+    EXPECT_TRUE(sameQuestion(packets[8u], "eXample.com"));
+}
+
+TEST_F(TestClientForwardersExchange, RetriesLimited)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 4u, std::make_shared<Metrics>()
+    );
+    forwarders.setRetries(1u);
+    ask(forwarders, "example.com", 7u);
+    flush();
+    disconnect(m_upstreams[0]);
+    flush();
+    ASSERT_EQ(2u, m_upstreams.size());
+    disconnect(m_upstreams[1]);
+    flush();
+    EXPECT_EQ(1u, forwarders.retriesSent());
+    EXPECT_EQ(2u, m_upstreams.size());
+    EXPECT_TRUE(replies().empty());
+}
+
+TEST_F(TestClientForwardersExchange, NoRetriesWhenDisabled)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 4u, std::make_shared<Metrics>()
+    );
+    forwarders.setRetries(0u);
+    ask(forwarders, "example.com", 7u);
+    flush();
+    disconnect(m_upstreams[0]);
+    flush();
+    EXPECT_EQ(0u, forwarders.retriesSent());
+    EXPECT_EQ(1u, m_upstreams.size());
+    EXPECT_TRUE(replies().empty());
+}
+
+TEST_F(TestClientForwardersExchange, SilentPipelinedForwarderTimesOut)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 1u, std::make_shared<Metrics>()
+    );
+    forwarders.setPipelineDepth(4u);
+    forwarders.setRetries(1u);
+    ask(forwarders, "example.com", 1u);
+    flush();
+    // The first request's deadline must not be moved by the later ones
+    auto timers = m_timers;
+    ask(forwarders, "example.org", 2u);
+    ask(forwarders, "example.net", 3u);
+    flush();
+    ASSERT_EQ(1u, m_upstreams.size());
+    EXPECT_EQ(3u, frames(m_upstreams[0].written).size());
+
+    fireTimers(timers);
+    flush();
+    EXPECT_EQ(3u, forwarders.retriesSent());
+    ASSERT_EQ(2u, m_upstreams.size());
+    ASSERT_EQ(3u, frames(m_upstreams[1].written).size());
+    for (std::size_t frame = 0u; frame < 3u; ++frame)
+    {
+        answer(m_upstreams[1], frame);
+    }
+    EXPECT_EQ((std::vector<unsigned short>{ 1u, 2u, 3u }), replies());
+}
+
+TEST_F(TestClientForwardersExchange, LostPipelinedResponseTimesOut)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 1u, std::make_shared<Metrics>()
+    );
+    forwarders.setPipelineDepth(4u);
+    forwarders.setRetries(1u);
+    ask(forwarders, "example.com", 1u);
+    flush();
+    auto timers = m_timers;
+    ask(forwarders, "example.org", 2u);
+    flush();
+    ASSERT_EQ(1u, m_upstreams.size());
+
+    // Answering the later request leaves the first one's deadline
+    answer(m_upstreams[0], 1u);
+    EXPECT_EQ((std::vector<unsigned short>{ 2u }), replies());
+    fireTimers(timers);
+    flush();
+    EXPECT_EQ(1u, forwarders.retriesSent());
+    ASSERT_EQ(2u, m_upstreams.size());
+    ASSERT_EQ(1u, frames(m_upstreams[1].written).size());
+    answer(m_upstreams[1], 0u);
+    EXPECT_EQ((std::vector<unsigned short>{ 1u }), replies());
+}
+
+TEST_F(TestClientForwardersExchange, FullQueueFailsRequest)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 1u, std::make_shared<Metrics>()
+    );
+    forwarders.setQueueLimits(1u, std::chrono::milliseconds(0));
+    ask(forwarders, "example.com", 1u);
+    ask(forwarders, "example.org", 2u);
+    ask(forwarders, "example.net", 3u);
+    flush();
+
+    // The first is sent, the second queued and the third doesn't fit
+    auto packets = received();
+    ASSERT_EQ(1u, packets.size());
+    ASSERT_EQ(1u, packets.count(3u));
+    EXPECT_TRUE(serverFailure(packets[3u]));
+    EXPECT_TRUE(sameQuestion(packets[3u], "example.net"));
+
+    // The queued request is sent once the connection is free
+    ASSERT_EQ(1u, m_upstreams.size());
+    answer(m_upstreams[0], 0u);
+    flush();
+    ASSERT_EQ(2u, frames(m_upstreams[0].written).size());
+    answer(m_upstreams[0], 1u);
+    packets = received();
+    ASSERT_EQ(2u, packets.size());
+    EXPECT_FALSE(serverFailure(packets[1u]));
+    EXPECT_FALSE(serverFailure(packets[2u]));
+}
+
+TEST_F(TestClientForwardersExchange, QueueDeadlineFailsRequest)
+{
+    ClientForwarders forwarders(
+        m_loop, m_config, m_ssl, 1u, std::make_shared<Metrics>()
+    );
+    forwarders.setQueueLimits(10u, std::chrono::milliseconds(10));
+    ask(forwarders, "example.com", 1u);
+    ask(forwarders, "example.org", 2u);
+    flush();
+    EXPECT_TRUE(replies().empty());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    fireTimers(std::chrono::milliseconds(10));
+    auto packets = received();
+    ASSERT_EQ(1u, packets.size());
+    ASSERT_EQ(1u, packets.count(2u));
+    EXPECT_TRUE(serverFailure(packets[2u]));
+    EXPECT_TRUE(sameQuestion(packets[2u], "example.org"));
+
+    // The request that was sent is still answered, and the failed one
+    // isn't sent after it
+    answer(m_upstreams[0], 0u);
+    flush();
+    EXPECT_EQ((std::vector<unsigned short>{ 1u }), replies());
+    EXPECT_EQ(1u, frames(m_upstreams[0].written).size());
+}
+
 }  // namespace dote
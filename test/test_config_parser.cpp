@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 
 bool operator==(const sockaddr_storage& a,
                 const sockaddr_storage& b)
@@ -79,7 +80,8 @@ void PrintTo(const ConfigParser::Server& server, ::std::ostream* os) {
 bool operator==(const ConfigParser::Forwarder& a,
                 const ConfigParser::Forwarder& b)
 {
-    return a.remote == b.remote && a.host == b.host && a.pin == b.pin;
+    return a.remote == b.remote && a.host == b.host && a.pin == b.pin &&
+        a.disablePki == b.disablePki && a.fastOpen == b.fastOpen;
 }
 
 void PrintTo(const ConfigParser::Forwarder& server, ::std::ostream* os) {
@@ -274,7 +276,7 @@ TEST_F(TestConfigParser, OneForwarderDefaultPort)
 {
     const char* const args[] = { "", "-f", "1.1.1.1" };
     std::vector<ConfigParser::Forwarder> expected{
-        { parse4("1.1.1.1", 853), false, "", {} }
+        { parse4("1.1.1.1", 853), false, "", {}, false }
     };
     ConfigParser parser;
     parser.parseConfig(
@@ -288,7 +290,7 @@ TEST_F(TestConfigParser, OneForwarderWithPort)
 {
     const char* const args[] = { "", "-f", "1.1.1.1:8853" };
     std::vector<ConfigParser::Forwarder> expected{
-        { parse4("1.1.1.1", 8853), false, "", {} }
+        { parse4("1.1.1.1", 8853), false, "", {}, false }
     };
     ConfigParser parser;
     parser.parseConfig(
@@ -302,7 +304,7 @@ TEST_F(TestConfigParser, OneForwarderWithHostname)
 {
     const char* const args[] = { "", "-f", "1.1.1.1", "-h", "domain.com" };
     std::vector<ConfigParser::Forwarder> expected{
-        {parse4("1.1.1.1", 853), false, "domain.com", {} }
+        {parse4("1.1.1.1", 853), false, "domain.com", {}, false }
     };
     ConfigParser parser;
     parser.parseConfig(
@@ -316,7 +318,7 @@ TEST_F(TestConfigParser, OneForwarderWithHostnameLong)
 {
     const char* const args[] = { "", "--forwarder", "1.1.1.1", "--hostname", "domain.com" };
     std::vector<ConfigParser::Forwarder> expected{
-        {parse4("1.1.1.1", 853), false, "domain.com", {} }
+        {parse4("1.1.1.1", 853), false, "domain.com", {}, false }
     };
     ConfigParser parser;
     parser.parseConfig(
@@ -330,7 +332,22 @@ TEST_F(TestConfigParser, OneForwarderWithPin)
 {
     const char* const args[] = { "", "-f", "1.1.1.1", "-p", "AQ==" };
     std::vector<ConfigParser::Forwarder> expected{
-        { parse4("1.1.1.1", 853), false, "", { 0x01 } }
+        { parse4("1.1.1.1", 853), false, "", { 0x01 }, false }
+    };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(expected, parser.forwarders());
+}
+
+TEST_F(TestConfigParser, OneForwarderFastOpen)
+{
+    const char* const args[] = { "", "-f", "1.1.1.1", "--fast_open", "-f", "1.0.0.1" };
+    std::vector<ConfigParser::Forwarder> expected{
+        { parse4("1.1.1.1", 853), false, "", {}, true },
+        { parse4("1.0.0.1", 853), false, "", {}, false }
     };
     ConfigParser parser;
     parser.parseConfig(
@@ -344,7 +361,7 @@ TEST_F(TestConfigParser, OneForwarderWithPinLong)
 {
     const char* const args[] = { "", "--forwarder", "1.1.1.1", "--pin", "AQ==" };
     std::vector<ConfigParser::Forwarder> expected{
-        { parse4("1.1.1.1", 853), false, "", { 0x01 } }
+        { parse4("1.1.1.1", 853), false, "", { 0x01 }, false }
     };
     ConfigParser parser;
     parser.parseConfig(
@@ -492,6 +509,30 @@ TEST_F(TestConfigParser, NotDaemoniseDefault)
     EXPECT_FALSE(parser.daemonise());
 }
 
+TEST_F(TestConfigParser, EarlyData)
+{
+    const char* const args[] = { "", "--early_data" };
+    ConfigParser parser;
+    EXPECT_FALSE(parser.earlyData());
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_TRUE(parser.earlyData());
+}
+
+TEST_F(TestConfigParser, KernelTls)
+{
+    const char* const args[] = { "", "--ktls" };
+    ConfigParser parser;
+    EXPECT_FALSE(parser.kernelTls());
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_TRUE(parser.kernelTls());
+}
+
 TEST_F(TestConfigParser, PidFile)
 {
     const char* const args[] = { "", "-P", "pidfile" };
@@ -605,6 +646,244 @@ TEST_F(TestConfigParser, TimeoutTooSmall)
     EXPECT_FALSE(parser.valid());
 }
 
+TEST_F(TestConfigParser, PoolSizeDefault)
+{
+    const char* const args[] = { "" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(2u, parser.poolSize());
+}
+
+TEST_F(TestConfigParser, PoolSize)
+{
+    const char* const args[] = { "", "--pool_size", "0" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(0u, parser.poolSize());
+}
+
+TEST_F(TestConfigParser, PoolSizeInvalid)
+{
+    const char* const args[] = { "", "--pool_size", "-1" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
+TEST_F(TestConfigParser, IdleTimeout)
+{
+    const char* const args[] = { "", "--idle_timeout", "30" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(30u, parser.idleTimeout());
+}
+
+TEST_F(TestConfigParser, IdleTimeoutTooSmall)
+{
+    const char* const args[] = { "", "--idle_timeout", "0" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
+TEST_F(TestConfigParser, Pipeline)
+{
+    const char* const args[] = { "", "--pipeline", "100" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(100u, parser.pipelineDepth());
+}
+
+TEST_F(TestConfigParser, PipelineTooSmall)
+{
+    const char* const args[] = { "", "--pipeline", "0" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
+TEST_F(TestConfigParser, CacheSize)
+{
+    const char* const args[] = { "", "--cache_size", "1000" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(1000u, parser.cacheSize());
+}
+
+TEST_F(TestConfigParser, CacheTtl)
+{
+    const char* const args[] = { "", "--cache_ttl", "60" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(60u, parser.cacheTtl());
+}
+
+TEST_F(TestConfigParser, CacheTtlTooSmall)
+{
+    const char* const args[] = { "", "--cache_ttl", "0" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
+TEST_F(TestConfigParser, Workers)
+{
+    const char* const args[] = { "", "--workers", "4" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(4u, parser.workers());
+}
+
+TEST_F(TestConfigParser, WorkersTooSmall)
+{
+    const char* const args[] = { "", "--workers", "0" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
+TEST_F(TestConfigParser, HedgeDelay)
+{
+    const char* const args[] = { "", "--hedge_delay", "20" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(20u, parser.hedgeDelay());
+}
+
+TEST_F(TestConfigParser, QueueSize)
+{
+    const char* const args[] = { "", "--queue_size", "50" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(50u, parser.queueSize());
+}
+
+TEST_F(TestConfigParser, QueueSizeTooSmall)
+{
+    const char* const args[] = { "", "--queue_size", "0" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
+TEST_F(TestConfigParser, QueueDeadline)
+{
+    const char* const args[] = { "", "--queue_deadline", "500" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(500u, parser.queueDeadline());
+}
+
+TEST_F(TestConfigParser, WarmConnections)
+{
+    const char* const args[] = { "", "--warm_connections", "3" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(3u, parser.warmConnections());
+}
+
+TEST_F(TestConfigParser, FailureThreshold)
+{
+    const char* const args[] = { "", "--failure_threshold", "5" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(5u, parser.failureThreshold());
+}
+
+TEST_F(TestConfigParser, Retries)
+{
+    const char* const args[] = { "", "--retries", "2" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(2u, parser.retries());
+}
+
+TEST_F(TestConfigParser, MetricsDefaultPort)
+{
+    sockaddr_storage expected = parse4("127.0.0.1", 9153);
+    const char* const args[] = { "", "--metrics", "127.0.0.1" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    EXPECT_EQ(expected, parser.metricsAddress());
+}
+
+TEST_F(TestConfigParser, MetricsUnixSocket)
+{
+    const char* const args[] = { "", "--metrics", "/run/dote.sock" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_TRUE(parser.valid());
+    auto& local = reinterpret_cast<const sockaddr_un&>(parser.metricsAddress());
+    EXPECT_EQ(AF_UNIX, local.sun_family);
+    EXPECT_STREQ("/run/dote.sock", local.sun_path);
+}
+
+TEST_F(TestConfigParser, StatsNameNeedsLeadingSlash)
+{
+    const char* const args[] = { "", "--stats", "dote" };
+    ConfigParser parser;
+    parser.parseConfig(
+        sizeof(args) / sizeof(args[0]), const_cast<char* const*>(args)
+    );
+    EXPECT_FALSE(parser.valid());
+}
+
 TEST_F(TestConfigParser, UnknownOption)
 {
     const char* const args[] = { "", "-x", "a" };
@@ -0,0 +1,170 @@
+#include "dns_cache.h"
+#include "dns_packet.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+namespace dote {
+
+namespace {
+
+/// \brief  Build a TCP framed packet for a question on a name
+std::vector<char> makePacket(const std::string& name,
+                             unsigned short id,
+                             unsigned char flags,
+                             unsigned char responseCode,
+                             bool dnssecOk,
+                             int ttl)
+{
+    std::vector<unsigned char> packet = {
+        0x00, 0x00,
+        static_cast<unsigned char>(id >> 8), static_cast<unsigned char>(id),
+        flags, responseCode, 0x00, 0x01,
+        0x00, static_cast<unsigned char>(ttl >= 0 ? 1 : 0),
+        0x00, 0x00, 0x00, static_cast<unsigned char>(dnssecOk ? 1 : 0)
+    };
+    std::size_t start = 0u;
+    for (std::size_t i = 0u; i <= name.size(); ++i)
+    {
+        if (i == name.size() || name[i] == '.')
+        {
+            packet.push_back(i - start);
+            packet.insert(packet.end(), name.begin() + start, name.begin() + i);
+            start = i + 1u;
+        }
+    }
+    packet.insert(packet.end(), { 0x00, 0x00, 0x01, 0x00, 0x01 });
+    if (ttl >= 0)
+    {
+        packet.insert(packet.end(), {
+            0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01,
+            0x00, 0x00, 0x00, static_cast<unsigned char>(ttl),
+            0x00, 0x04, 0x7f, 0x00, 0x00, 0x01
+        });
+    }
+    if (dnssecOk)
+    {
+        packet.insert(packet.end(), {
+            0x00, 0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00
+        });
+    }
+    packet[0] = (packet.size() - 2u) >> 8;
+    packet[1] = (packet.size() - 2u) & 0xff;
+    return std::vector<char>(packet.begin(), packet.end());
+}
+
+std::vector<char> makeRequest(const std::string& name,
+                              unsigned short id,
+                              bool dnssecOk = false)
+{
+    return makePacket(name, id, 0x01, 0x00, dnssecOk, -1);
+}
+
+std::vector<char> makeResponse(const std::string& name,
+                               int ttl,
+                               unsigned char responseCode = 0x80)
+{
+    return makePacket(name, 0x1234, 0x81, responseCode, false, ttl);
+}
+
+std::string key(const std::vector<char>& request)
+{
+    return DnsCache::key(DnsPacket(request));
+}
+
+bool lookup(DnsCache& cache,
+            const std::vector<char>& request,
+            std::vector<char>& response)
+{
+    DnsPacket packet(request);
+    return cache.lookup(DnsCache::key(packet), packet, response);
+}
+
+}  // anon namespace
+
+TEST(TestDnsCache, KeyIgnoresCase)
+{
+    EXPECT_FALSE(key(makeRequest("example.com", 1u)).empty());
+    EXPECT_EQ(key(makeRequest("example.com", 1u)),
+              key(makeRequest("ExAmPlE.COM", 2u)));
+}
+
+TEST(TestDnsCache, KeyIncludesDnssecOk)
+{
+    EXPECT_NE(key(makeRequest("example.com", 1u, false)),
+              key(makeRequest("example.com", 1u, true)));
+}
+
+TEST(TestDnsCache, InvalidRequestNotCacheable)
+{
+    EXPECT_TRUE(key(std::vector<char>(4u)).empty());
+}
+
+TEST(TestDnsCache, LookupPatchesId)
+{
+    DnsCache cache(10u, 3600u);
+    cache.store(key(makeRequest("example.com", 1u)), makeResponse("example.com", 60));
+    std::vector<char> response;
+    ASSERT_TRUE(lookup(cache, makeRequest("example.com", 0xabcd), response));
+    EXPECT_EQ(0xabcd, DnsPacket(response).id());
+    uint32_t ttl = 0u;
+    EXPECT_TRUE(DnsPacket(response).minimumTtl(ttl));
+    EXPECT_LE(ttl, 60u);
+    EXPECT_GE(ttl, 59u);
+}
+
+TEST(TestDnsCache, LookupKeepsQuestionCase)
+{
+    DnsCache cache(10u, 3600u);
+    cache.store(key(makeRequest("example.com", 1u)), makeResponse("example.com", 60));
+    std::vector<char> request = makeRequest("ExAmPlE.cOm", 2u);
+    std::vector<char> response;
+    ASSERT_TRUE(lookup(cache, request, response));
+    ASSERT_GT(response.size(), request.size());
+    // The header is followed by the question as the client asked it
+    EXPECT_TRUE(std::equal(
+        request.begin() + 14, request.end(), response.begin() + 14
+    ));
+    uint32_t ttl = 0u;
+    EXPECT_TRUE(DnsPacket(response).minimumTtl(ttl));
+}
+
+TEST(TestDnsCache, LookupMiss)
+{
+    DnsCache cache(10u, 3600u);
+    cache.store(key(makeRequest("example.com", 1u)), makeResponse("example.com", 60));
+    std::vector<char> response;
+    EXPECT_FALSE(lookup(cache, makeRequest("example.org", 1u), response));
+}
+
+TEST(TestDnsCache, ZeroTtlNotStored)
+{
+    DnsCache cache(10u, 3600u);
+    cache.store(key(makeRequest("example.com", 1u)), makeResponse("example.com", 0));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(TestDnsCache, ServerFailureNotStored)
+{
+    DnsCache cache(10u, 3600u);
+    cache.store(key(makeRequest("example.com", 1u)), makeResponse("example.com", 60, 0x82));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(TestDnsCache, EvictsLeastRecentlyUsed)
+{
+    DnsCache cache(2u, 3600u);
+    std::vector<char> response;
+    cache.store(key(makeRequest("a.com", 1u)), makeResponse("a.com", 60));
+    cache.store(key(makeRequest("b.com", 1u)), makeResponse("b.com", 60));
+    EXPECT_TRUE(lookup(cache, makeRequest("a.com", 1u), response));
+    cache.store(key(makeRequest("c.com", 1u)), makeResponse("c.com", 60));
+    EXPECT_EQ(2u, cache.size());
+    EXPECT_TRUE(lookup(cache, makeRequest("a.com", 1u), response));
+    EXPECT_FALSE(lookup(cache, makeRequest("b.com", 1u), response));
+    EXPECT_TRUE(lookup(cache, makeRequest("c.com", 1u), response));
+}
+
+}  // namespace dote
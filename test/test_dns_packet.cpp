@@ -121,4 +121,98 @@ TEST(TestDnsPacket, RemovePaddingWithCompressedName)
     EXPECT_EQ(240u, packet.packet().size());
 }
 
+TEST(TestDnsPacket, SetId)
+{
+    std::vector<char> PACKET = {
+        0x00, 0x0c, 0x12, 0x34, 0x01, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    DnsPacket packet(PACKET);
+    EXPECT_EQ(0x1234, packet.id());
+    packet.setId(0x5678);
+    EXPECT_EQ(0x5678, packet.id());
+    EXPECT_EQ(0x56, packet.packet()[2]);
+    EXPECT_EQ(0x78, packet.packet()[3]);
+}
+
+TEST(TestDnsPacket, SetServerFailure)
+{
+    std::vector<char> PACKET = {
+        0x00, 0x22, 0x12, 0x34, 0x01, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x61,
+        0x03, 0x63, 0x6f, 0x6d, 0x00, 0x00, 0x01, 0x00,
+        0x01, 0x00, 0x00, 0x29, 0x10, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00
+    };
+    DnsPacket packet(PACKET);
+    EXPECT_TRUE(packet.setServerFailure());
+    EXPECT_TRUE(packet.valid());
+    EXPECT_EQ(25u, packet.packet().size());
+    EXPECT_EQ(0x1234, packet.id());
+    EXPECT_EQ(2, packet.responseCode());
+    EXPECT_EQ(static_cast<char>(0x81), packet.packet()[4]);
+    EXPECT_EQ(0x00, packet.packet()[13]);
+}
+
+TEST(TestDnsPacket, IdTooShort)
+{
+    DnsPacket packet(std::vector<char>{ 0x00, 0x01, 0x12 });
+    EXPECT_EQ(0u, packet.id());
+    packet.setId(0x5678);
+    EXPECT_EQ(3u, packet.packet().size());
+}
+
+namespace {
+
+/// \brief  Build a packet for a.IN A with one record in a section that is
+///         cut short part way through a compression pointer
+///
+/// \param section  The offset of the count of the section in the packet
+std::vector<char> truncatedPointer(std::size_t section)
+{
+    std::vector<char> packet = {
+        0x00, 0x14, 0x12, 0x34, 0x01, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x61,
+        0x00, 0x00, 0x01, 0x00, 0x01, static_cast<char>(0xc0)
+    };
+    packet[section] = 0x01;
+    return packet;
+}
+
+}  // anon namespace
+
+TEST(TestDnsPacket, TruncatedPointerInAnswers)
+{
+    DnsPacket packet(truncatedPointer(9u));
+    uint32_t ttl = 0u;
+    EXPECT_TRUE(packet.valid());
+    EXPECT_FALSE(packet.minimumTtl(ttl));
+    EXPECT_FALSE(packet.dnssecOk());
+    packet.reduceTtls(10u);
+    EXPECT_EQ(truncatedPointer(9u), packet.packet());
+    EXPECT_FALSE(packet.removeEdnsPadding());
+}
+
+TEST(TestDnsPacket, TruncatedPointerInAuthorities)
+{
+    DnsPacket packet(truncatedPointer(11u));
+    uint32_t ttl = 0u;
+    EXPECT_FALSE(packet.minimumTtl(ttl));
+    EXPECT_FALSE(packet.dnssecOk());
+    packet.reduceTtls(10u);
+    EXPECT_EQ(truncatedPointer(11u), packet.packet());
+    EXPECT_FALSE(packet.removeEdnsPadding());
+}
+
+TEST(TestDnsPacket, TruncatedPointerInAdditional)
+{
+    DnsPacket packet(truncatedPointer(13u));
+    uint32_t ttl = 0u;
+    EXPECT_FALSE(packet.minimumTtl(ttl));
+    EXPECT_FALSE(packet.dnssecOk());
+    packet.reduceTtls(10u);
+    EXPECT_EQ(truncatedPointer(13u), packet.packet());
+    EXPECT_FALSE(packet.removeEdnsPadding());
+}
+
 }  // namespace dote
@@ -8,15 +8,15 @@ namespace dote {
 
 TEST(TestForwarderConfig, Empty)
 {
-    ForwarderConfig config;
+    ForwarderConfig config(std::make_shared<Metrics>());
     EXPECT_EQ(config.get(), config.end());
 }
 
 TEST(TestForwarderConfig, NotEmpty)
 {
-    ForwarderConfig config;
+    ForwarderConfig config(std::make_shared<Metrics>());
     ConfigParser::Forwarder forwarder{
-        parse4("127.0.0.1", 53), false, "host", {}
+        parse4("127.0.0.1", 53), false, "host", {}, false
     };
     config.addForwarder(forwarder);
     EXPECT_NE(config.get(), config.end());
@@ -24,13 +24,13 @@ TEST(TestForwarderConfig, NotEmpty)
 
 TEST(TestForwarderConfig, GetFirst)
 {
-    ForwarderConfig config;
+    ForwarderConfig config(std::make_shared<Metrics>());
     ConfigParser::Forwarder forwarder{
-        parse4("127.0.0.1", 53), false, "host", {0x1}
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
     };
     config.addForwarder(forwarder);
     ConfigParser::Forwarder forwarder2{
-        parse4("127.0.0.2", 54), false, "host2", {0x2}
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
     };
     config.addForwarder(forwarder2);
     auto first = config.get();
@@ -41,13 +41,13 @@ TEST(TestForwarderConfig, GetFirst)
 
 TEST(TestForwarderConfig, SetFirstBad)
 {
-    ForwarderConfig config;
+    ForwarderConfig config(std::make_shared<Metrics>());
     ConfigParser::Forwarder forwarder{
-        parse4("127.0.0.1", 53), false, "host", {0x1}
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
     };
     config.addForwarder(forwarder);
     ConfigParser::Forwarder forwarder2{
-        parse4("127.0.0.2", 54), false, "host2", {0x2}
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
     };
     config.addForwarder(forwarder2);
     config.setBad(forwarder);
@@ -59,13 +59,13 @@ TEST(TestForwarderConfig, SetFirstBad)
 
 TEST(TestForwarderConfig, SetLastBad)
 {
-    ForwarderConfig config;
+    ForwarderConfig config(std::make_shared<Metrics>());
     ConfigParser::Forwarder forwarder{
-        parse4("127.0.0.1", 53), false, "host", {0x1}
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
     };
     config.addForwarder(forwarder);
     ConfigParser::Forwarder forwarder2{
-        parse4("127.0.0.2", 54), false, "host2", {0x2}
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
     };
     config.addForwarder(forwarder2);
     config.setBad(forwarder2);
@@ -75,4 +75,102 @@ TEST(TestForwarderConfig, SetLastBad)
     EXPECT_EQ(first->pin, std::vector<unsigned char>{0x1});
 }
 
+TEST(TestForwarderConfig, PrefersFastest)
+{
+    ForwarderConfig config(std::make_shared<Metrics>());
+    ConfigParser::Forwarder forwarder{
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
+    };
+    config.addForwarder(forwarder);
+    ConfigParser::Forwarder forwarder2{
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
+    };
+    config.addForwarder(forwarder2);
+    config.setResponseTime(forwarder, std::chrono::microseconds(9000));
+    config.setHandshakeTime(forwarder2, std::chrono::microseconds(5000));
+    EXPECT_EQ(config.get()->host, "host2");
+    config.setResponseTime(forwarder2, std::chrono::microseconds(20000));
+    EXPECT_EQ(config.get()->host, "host");
+    config.setBad(forwarder);
+    EXPECT_EQ(config.get()->host, "host2");
+}
+
+TEST(TestForwarderConfig, AlternativeExcludes)
+{
+    ForwarderConfig config(std::make_shared<Metrics>());
+    ConfigParser::Forwarder forwarder{
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
+    };
+    config.addForwarder(forwarder);
+    EXPECT_EQ(config.end(), config.getAlternative(forwarder));
+    ConfigParser::Forwarder forwarder2{
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
+    };
+    config.addForwarder(forwarder2);
+    config.setResponseTime(forwarder, std::chrono::microseconds(1000));
+    config.setResponseTime(forwarder2, std::chrono::microseconds(9000));
+    EXPECT_EQ(config.getAlternative(forwarder)->host, "host2");
+    EXPECT_EQ(config.getAlternative(forwarder2)->host, "host");
+}
+
+TEST(TestForwarderConfig, ExploresOldest)
+{
+    ForwarderConfig config(std::make_shared<Metrics>());
+    ConfigParser::Forwarder forwarder{
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
+    };
+    config.addForwarder(forwarder);
+    ConfigParser::Forwarder forwarder2{
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
+    };
+    config.addForwarder(forwarder2);
+    config.setResponseTime(forwarder, std::chrono::microseconds(1000));
+    int host2 = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        if (config.get()->host == "host2")
+        {
+            ++host2;
+        }
+    }
+    EXPECT_EQ(2, host2);
+}
+
+TEST(TestForwarderConfig, MarkedDownUntilProbed)
+{
+    ForwarderConfig config(std::make_shared<Metrics>());
+    config.setFailureThreshold(2u);
+    ConfigParser::Forwarder forwarder{
+        parse4("127.0.0.1", 53), false, "host", {0x1}, false
+    };
+    config.addForwarder(forwarder);
+    ConfigParser::Forwarder forwarder2{
+        parse4("127.0.0.2", 54), false, "host2", {0x2}, false
+    };
+    config.addForwarder(forwarder2);
+    config.setBad(forwarder);
+    EXPECT_TRUE(config.healthy(forwarder));
+    config.setBad(forwarder);
+    EXPECT_FALSE(config.healthy(forwarder));
+    EXPECT_TRUE(config.healthy(forwarder2));
+    // Not even chosen to be measured again
+    config.setResponseTime(forwarder, std::chrono::microseconds(1000));
+    for (int i = 0; i < 64; ++i)
+    {
+        EXPECT_EQ(config.get()->host, "host2");
+    }
+    EXPECT_TRUE(config.dueForProbe().empty());
+    config.setProbeResult(forwarder, false);
+    EXPECT_FALSE(config.healthy(forwarder));
+    config.setProbeResult(forwarder, true);
+    EXPECT_TRUE(config.healthy(forwarder));
+}
+
+TEST(TestForwarderConfig, IdleTimeout)
+{
+    ForwarderConfig config(std::make_shared<Metrics>());
+    config.setIdleTimeout(30);
+    EXPECT_EQ(30u, config.idleTimeout());
+}
+
 }  // namespace dote
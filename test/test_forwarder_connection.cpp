@@ -1,5 +1,6 @@
 
 #include "forwarder_connection.h"
+#include "packet_pool.h"
 #include "mock_loop.h"
 #include "mock_forwarder_config.h"
 #include "openssl/mock_ssl_factory.h"
@@ -38,7 +39,9 @@ TEST_F(TestForwarderConnection, CreateNoForwarders)
         .WillOnce(Return(connections.begin()));
     EXPECT_CALL(*m_config, end())
         .WillOnce(Return(connections.end()));
-    ForwarderConnection connection(m_loop, m_config, m_ssl);
+    ForwarderConnection connection(
+        m_loop, m_config, m_ssl, std::make_shared<PacketPool>()
+    );
 }
 
 }  // namespace dote
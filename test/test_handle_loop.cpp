@@ -0,0 +1,161 @@
+#include "epoll_loop.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace dote {
+
+template<typename T>
+class TestHandleLoop : public ::testing::Test
+{
+  public:
+    TestHandleLoop() :
+        m_loop(),
+        m_sockets{-1, -1}
+    {
+        EXPECT_TRUE(m_loop.valid());
+        EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, m_sockets));
+    }
+
+    ~TestHandleLoop()
+    {
+        for (int socket : m_sockets)
+        {
+            if (socket >= 0)
+            {
+                close(socket);
+            }
+        }
+    }
+
+  protected:
+    T m_loop;
+    int m_sockets[2];
+};
+
+using LoopTypes = ::testing::Types<EpollLoop>;
+TYPED_TEST_CASE(TestHandleLoop, LoopTypes);
+
+TYPED_TEST(TestHandleLoop, NoRegistrationsReturns)
+{
+    this->m_loop.run();
+}
+
+TYPED_TEST(TestHandleLoop, TimerKeepsLoopRunning)
+{
+    bool fired = false;
+    auto timer = this->m_loop.registerTimer(
+        std::chrono::milliseconds(5), [&](int) { fired = true; }
+    );
+    EXPECT_TRUE(timer);
+    this->m_loop.run();
+    EXPECT_TRUE(fired);
+}
+
+TYPED_TEST(TestHandleLoop, DeferredAfterRead)
+{
+    ASSERT_EQ(1, write(this->m_sockets[1], "a", 1));
+    std::vector<int> order;
+    ILoop::Registration deferred;
+    ILoop::Registration read;
+    read = this->m_loop.registerRead(this->m_sockets[0], [&](int handle) {
+        char buffer;
+        EXPECT_EQ(1, ::read(handle, &buffer, 1));
+        order.push_back(1);
+        deferred = this->m_loop.registerDeferred([&](int) {
+            order.push_back(2);
+            read.reset();
+        });
+    }, 0);
+    this->m_loop.run();
+    EXPECT_EQ(std::vector<int>({ 1, 2 }), order);
+}
+
+TYPED_TEST(TestHandleLoop, DuplicateRegistration)
+{
+    auto first = this->m_loop.registerRead(this->m_sockets[0], [](int) {}, 0);
+    auto second = this->m_loop.registerRead(this->m_sockets[0], [](int) {}, 0);
+    EXPECT_TRUE(first);
+    EXPECT_FALSE(second);
+}
+
+TYPED_TEST(TestHandleLoop, ReadCallback)
+{
+    ASSERT_EQ(1, write(this->m_sockets[1], "a", 1));
+    int calls = 0;
+    ILoop::Registration read;
+    read = this->m_loop.registerRead(this->m_sockets[0], [&](int handle) {
+        EXPECT_EQ(this->m_sockets[0], handle);
+        ++calls;
+        read.reset();
+    }, 0);
+    this->m_loop.run();
+    EXPECT_EQ(1, calls);
+}
+
+TYPED_TEST(TestHandleLoop, ReadRepeatsUntilDrained)
+{
+    ASSERT_EQ(1, write(this->m_sockets[1], "a", 1));
+    int calls = 0;
+    ILoop::Registration read;
+    read = this->m_loop.registerRead(this->m_sockets[0], [&](int handle) {
+        if (++calls == 2)
+        {
+            char buffer;
+            EXPECT_EQ(1, ::read(handle, &buffer, 1));
+            read.reset();
+        }
+    }, 0);
+    this->m_loop.run();
+    EXPECT_EQ(2, calls);
+}
+
+TYPED_TEST(TestHandleLoop, WriteAfterRead)
+{
+    ASSERT_EQ(1, write(this->m_sockets[1], "a", 1));
+    bool written = false;
+    ILoop::Registration read;
+    ILoop::Registration write;
+    read = this->m_loop.registerRead(this->m_sockets[0], [&](int) {
+        write = this->m_loop.registerWrite(this->m_sockets[0], [&](int) {
+            written = true;
+            write.reset();
+        }, 0);
+        read.reset();
+    }, 0);
+    this->m_loop.run();
+    EXPECT_TRUE(written);
+}
+
+TYPED_TEST(TestHandleLoop, TimeoutRaisesException)
+{
+    bool raised = false;
+    ILoop::Registration read;
+    ILoop::Registration except;
+    read = this->m_loop.registerRead(this->m_sockets[0], [](int) {}, time(nullptr));
+    except = this->m_loop.registerException(this->m_sockets[0], [&](int) {
+        raised = true;
+        read.reset();
+        except.reset();
+    });
+    this->m_loop.run();
+    EXPECT_TRUE(raised);
+}
+
+TYPED_TEST(TestHandleLoop, HangupRaisesException)
+{
+    close(this->m_sockets[1]);
+    this->m_sockets[1] = -1;
+    bool raised = false;
+    ILoop::Registration except;
+    except = this->m_loop.registerException(this->m_sockets[0], [&](int) {
+        raised = true;
+        except.reset();
+    });
+    this->m_loop.run();
+    EXPECT_TRUE(raised);
+}
+
+}  // namespace dote
@@ -0,0 +1,209 @@
+
+#include "health_checker.h"
+#include "packet_pool.h"
+#include "socket.h"
+#include "parse_inet.h"
+#include "mock_loop.h"
+#include "mock_forwarder_config.h"
+#include "openssl/mock_ssl_factory.h"
+#include "openssl/mock_ssl_connection.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+
+namespace dote {
+
+using ::testing::Return;
+using ::testing::NiceMock;
+using ::testing::Invoke;
+using ::testing::_;
+
+/// \brief  Probes a forwarder with a fake loop and mocked TLS so that the
+///         probe can be answered and the result checked
+class TestHealthChecker : public ::testing::Test
+{
+  public:
+    TestHealthChecker() :
+        m_loop(std::make_shared<NiceMock<MockLoop>>()),
+        m_config(std::make_shared<NiceMock<MockForwarderConfig>>()),
+        m_ssl(std::make_shared<openssl::MockSslFactory>()),
+        m_tls(std::make_shared<NiceMock<openssl::MockSslConnection>>()),
+        m_listener(Socket::listen(parse4("127.0.0.1", 0))),
+        m_forwarder(),
+        m_handle(-1),
+        m_written(),
+        m_pending(),
+        m_closed(false),
+        m_reads(),
+        m_writes(),
+        m_timers(),
+        m_nextTimer(0)
+    {
+        // Somewhere for the probe connection to go
+        sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        getsockname(
+            m_listener->get(), reinterpret_cast<sockaddr*>(&address), &length
+        );
+        m_forwarder = ConfigParser::Forwarder { address, false, "", {}, false };
+
+        ON_CALL(*m_loop, registerRead(_, _, _))
+            .WillByDefault(Invoke([this](int handle, ILoop::Callback callback, time_t)
+            {
+                m_reads[handle] = std::move(callback);
+                return ILoop::Registration(m_loop.get(), handle, ILoop::Read);
+            }));
+        ON_CALL(*m_loop, registerWrite(_, _, _))
+            .WillByDefault(Invoke([this](int handle, ILoop::Callback callback, time_t)
+            {
+                m_writes[handle] = std::move(callback);
+                return ILoop::Registration(m_loop.get(), handle, ILoop::Write);
+            }));
+        ON_CALL(*m_loop, registerTimer(_, _))
+            .WillByDefault(Invoke([this](std::chrono::milliseconds,
+                                         ILoop::Callback callback)
+            {
+                int id = m_nextTimer++;
+                m_timers[id] = std::move(callback);
+                return ILoop::Registration(m_loop.get(), id, ILoop::Timer);
+            }));
+        ON_CALL(*m_loop, removeRead(_))
+            .WillByDefault(Invoke([this](int handle) { m_reads.erase(handle); }));
+        ON_CALL(*m_loop, removeWrite(_))
+            .WillByDefault(Invoke([this](int handle) { m_writes.erase(handle); }));
+        ON_CALL(*m_loop, removeTimer(_))
+            .WillByDefault(Invoke([this](int id) { m_timers.erase(id); }));
+
+        ON_CALL(*m_config, timeout())
+            .WillByDefault(Return(5u));
+        ON_CALL(*m_config, idleTimeout())
+            .WillByDefault(Return(10u));
+
+        EXPECT_CALL(*m_ssl, create())
+            .WillRepeatedly(Return(m_tls));
+        ON_CALL(*m_tls, setSocket(_))
+            .WillByDefault(Invoke([this](int handle) { m_handle = handle; }));
+        ON_CALL(*m_tls, connect())
+            .WillByDefault(Return(openssl::ISslConnection::Result::SUCCESS));
+        ON_CALL(*m_tls, shutdown())
+            .WillByDefault(Return(openssl::ISslConnection::Result::SUCCESS));
+        ON_CALL(*m_tls, write(_))
+            .WillByDefault(Invoke([this](const std::vector<char>& buffer)
+            {
+                m_written.insert(m_written.end(), buffer.begin(), buffer.end());
+                return openssl::ISslConnection::Result::SUCCESS;
+            }));
+        ON_CALL(*m_tls, read(_, _, _))
+            .WillByDefault(Invoke([this](char* buffer,
+                                         std::size_t size,
+                                         std::size_t& length)
+            {
+                length = std::min(size, m_pending.size());
+                if (length == 0u)
+                {
+                    return m_closed ?
+                        openssl::ISslConnection::Result::CLOSED :
+                        openssl::ISslConnection::Result::NEED_READ;
+                }
+                std::copy(m_pending.begin(), m_pending.begin() + length, buffer);
+                m_pending.erase(m_pending.begin(), m_pending.begin() + length);
+                return openssl::ISslConnection::Result::SUCCESS;
+            }));
+    }
+
+  protected:
+    /// \brief  Start the probe of the forwarder and write it
+    void probe()
+    {
+        EXPECT_CALL(*m_config, dueForProbe())
+            .WillOnce(Return(std::vector<ConfigParser::Forwarder>{ m_forwarder }));
+        auto timers = m_timers;
+        for (auto& timer : timers)
+        {
+            timer.second(timer.first);
+        }
+        auto writes = m_writes;
+        for (auto& write : writes)
+        {
+            write.second(write.first);
+        }
+    }
+
+    /// \brief  Answer the probe with a response code
+    void answer(unsigned char responseCode)
+    {
+        ASSERT_GE(m_written.size(), 6u);
+        std::vector<char> response(m_written);
+        response[4] |= 0x80;
+        response[5] = (response[5] & 0xf0) | responseCode;
+        m_pending.insert(m_pending.end(), response.begin(), response.end());
+        read();
+    }
+
+    /// \brief  Let the connection read what the forwarder has sent
+    void read()
+    {
+        auto it = m_reads.find(m_handle);
+        ASSERT_NE(m_reads.end(), it);
+        auto callback = it->second;
+        callback(m_handle);
+    }
+
+    std::shared_ptr<NiceMock<MockLoop>> m_loop;
+    std::shared_ptr<NiceMock<MockForwarderConfig>> m_config;
+    std::shared_ptr<openssl::MockSslFactory> m_ssl;
+    std::shared_ptr<NiceMock<openssl::MockSslConnection>> m_tls;
+    std::shared_ptr<Socket> m_listener;
+    ConfigParser::Forwarder m_forwarder;
+    int m_handle;
+    std::vector<char> m_written;
+    std::vector<char> m_pending;
+    bool m_closed;
+    std::map<int, ILoop::Callback> m_reads;
+    std::map<int, ILoop::Callback> m_writes;
+    std::map<int, ILoop::Callback> m_timers;
+    int m_nextTimer;
+};
+
+TEST_F(TestHealthChecker, AnsweredProbeRestoresForwarder)
+{
+    long references = m_tls.use_count();
+    HealthChecker checker(m_loop, m_config, m_ssl, std::make_shared<PacketPool>());
+    probe();
+    ASSERT_LT(references, m_tls.use_count());
+    EXPECT_CALL(*m_config, setProbeResult(_, true)).Times(1);
+    EXPECT_CALL(*m_config, setProbeResult(_, false)).Times(0);
+    answer(0u);
+    // The finished probe has been removed along with its connection
+    EXPECT_EQ(references, m_tls.use_count());
+    EXPECT_EQ(0u, m_reads.count(m_handle));
+}
+
+TEST_F(TestHealthChecker, ServerFailureKeepsForwarderDown)
+{
+    long references = m_tls.use_count();
+    HealthChecker checker(m_loop, m_config, m_ssl, std::make_shared<PacketPool>());
+    probe();
+    ASSERT_LT(references, m_tls.use_count());
+    EXPECT_CALL(*m_config, setProbeResult(_, false)).Times(1);
+    EXPECT_CALL(*m_config, setProbeResult(_, true)).Times(0);
+    answer(2u);
+    EXPECT_EQ(references, m_tls.use_count());
+}
+
+TEST_F(TestHealthChecker, ClosedBeforeAnswerFailsProbe)
+{
+    long references = m_tls.use_count();
+    HealthChecker checker(m_loop, m_config, m_ssl, std::make_shared<PacketPool>());
+    probe();
+    ASSERT_LT(references, m_tls.use_count());
+    EXPECT_CALL(*m_config, setProbeResult(_, false)).Times(1);
+    EXPECT_CALL(*m_config, setProbeResult(_, true)).Times(0);
+    m_closed = true;
+    read();
+    EXPECT_EQ(references, m_tls.use_count());
+}
+
+}  // namespace dote
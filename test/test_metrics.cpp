@@ -0,0 +1,105 @@
+#include "metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+
+namespace dote {
+
+TEST(TestMetrics, BucketsHoldTheirBounds)
+{
+    for (std::size_t bucket = 0u; bucket < Metrics::Histogram::BUCKETS - 1u; ++bucket)
+    {
+        std::uint64_t bound = Metrics::Histogram::upperBound(bucket);
+        EXPECT_EQ(bucket, Metrics::Histogram::bucket(bound));
+        EXPECT_EQ(bucket + 1u, Metrics::Histogram::bucket(bound + 1u));
+    }
+    EXPECT_EQ(
+        Metrics::Histogram::BUCKETS - 1u,
+        Metrics::Histogram::bucket(std::numeric_limits<std::uint64_t>::max())
+    );
+}
+
+TEST(TestMetrics, HistogramRecordsTimes)
+{
+    Metrics metrics;
+    auto& histogram = metrics.histogram("test", "Test");
+    histogram.record(std::chrono::microseconds(5));
+    histogram.record(std::chrono::microseconds(1000));
+    EXPECT_EQ(2u, histogram.total());
+    EXPECT_EQ(1005u, histogram.sum());
+    EXPECT_EQ(1u, histogram.count(Metrics::Histogram::bucket(5u)));
+    EXPECT_EQ(1u, histogram.count(Metrics::Histogram::bucket(1000u)));
+}
+
+TEST(TestMetrics, FindsByNameAndLabels)
+{
+    Metrics metrics;
+    auto& first = metrics.counter("test", "Test", "a=\"1\"");
+    auto& second = metrics.counter("test", "Test", "a=\"2\"");
+    EXPECT_NE(&first, &second);
+    EXPECT_EQ(&first, &metrics.counter("test", "Test", "a=\"1\""));
+    first.add(2u);
+    EXPECT_EQ(2u, first.value());
+    EXPECT_EQ(0u, second.value());
+}
+
+TEST(TestMetrics, ShardsAreSummed)
+{
+    Metrics metrics;
+    auto first = metrics.shard();
+    auto second = metrics.shard();
+    first->counter("requests", "Requests").add(2u);
+    second->counter("requests", "Requests").add(3u);
+    second->counter("errors", "Errors").add(1u);
+    first->gauge("queue", "Queue").add(4);
+    second->gauge("queue", "Queue").add(-1);
+    first->histogram("time", "Time").record(std::chrono::microseconds(5));
+    second->histogram("time", "Time").record(std::chrono::microseconds(1000));
+
+    std::vector<std::pair<std::string, std::uint64_t>> counters;
+    std::int64_t queue = 0;
+    std::uint64_t total = 0u;
+    std::uint64_t sum = 0u;
+    metrics.visit(
+        [&counters](const Metrics::Info& info, const Metrics::Counter& counter)
+        {
+            counters.emplace_back(info.name, counter.value());
+        },
+        [&queue](const Metrics::Info&, const Metrics::Gauge& gauge)
+        {
+            queue = gauge.value();
+        },
+        [&total, &sum](const Metrics::Info&, const Metrics::Histogram& histogram)
+        {
+            total = histogram.total();
+            sum = histogram.sum();
+        }
+    );
+    ASSERT_EQ(2u, counters.size());
+    EXPECT_EQ("requests", counters[0].first);
+    EXPECT_EQ(5u, counters[0].second);
+    EXPECT_EQ("errors", counters[1].first);
+    EXPECT_EQ(1u, counters[1].second);
+    EXPECT_EQ(3, queue);
+    EXPECT_EQ(2u, total);
+    EXPECT_EQ(1005u, sum);
+}
+
+TEST(TestMetrics, MetricsHaveCacheLinesOfTheirOwn)
+{
+    Metrics metrics;
+    auto shard = metrics.shard();
+    for (int i = 0; i < 10; ++i)
+    {
+        auto& counter = shard->counter("test", "Test", std::to_string(i));
+        EXPECT_EQ(0u,
+            reinterpret_cast<std::uintptr_t>(&counter) % Metrics::CACHE_LINE);
+    }
+    auto& histogram = shard->histogram("test", "Test");
+    EXPECT_EQ(0u,
+        reinterpret_cast<std::uintptr_t>(&histogram) % Metrics::CACHE_LINE);
+}
+
+}  // namespace dote
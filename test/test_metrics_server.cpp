@@ -0,0 +1,45 @@
+#include "metrics_server.h"
+#include "metrics.h"
+
+#include <gtest/gtest.h>
+
+namespace dote {
+
+TEST(TestMetricsServer, FormatsFamiliesTogether)
+{
+    Metrics metrics;
+    metrics.counter("errors_total", "Errors", "forwarder=\"a\"").add(2u);
+    metrics.gauge("down", "Down", "forwarder=\"a\"").add(1);
+    metrics.counter("errors_total", "Errors", "forwarder=\"b\"").add(3u);
+    EXPECT_EQ(
+        "# HELP errors_total Errors\n"
+        "# TYPE errors_total counter\n"
+        "errors_total{forwarder=\"a\"} 2\n"
+        "errors_total{forwarder=\"b\"} 3\n"
+        "# HELP down Down\n"
+        "# TYPE down gauge\n"
+        "down{forwarder=\"a\"} 1\n",
+        MetricsServer::format(metrics)
+    );
+}
+
+TEST(TestMetricsServer, FormatsCumulativeBuckets)
+{
+    Metrics metrics;
+    auto& histogram = metrics.histogram("time", "Time");
+    histogram.record(std::chrono::microseconds(3));
+    histogram.record(std::chrono::microseconds(3));
+    histogram.record(std::chrono::microseconds(100));
+    EXPECT_EQ(
+        "# HELP time Time\n"
+        "# TYPE time histogram\n"
+        "time_bucket{le=\"3\"} 2\n"
+        "time_bucket{le=\"103\"} 3\n"
+        "time_bucket{le=\"+Inf\"} 3\n"
+        "time_sum 106\n"
+        "time_count 3\n",
+        MetricsServer::format(metrics)
+    );
+}
+
+}  // namespace dote
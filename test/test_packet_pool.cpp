@@ -0,0 +1,35 @@
+#include "packet_pool.h"
+
+#include <gtest/gtest.h>
+
+namespace dote {
+
+TEST(TestPacketPool, ReusesReleasedBuffer)
+{
+    PacketPool pool(1u);
+    auto buffer = pool.acquire();
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_GE(buffer.capacity(), PacketPool::BUFFER_SIZE);
+    buffer.assign(100u, 'a');
+    const char* data = buffer.data();
+    pool.release(std::move(buffer));
+    EXPECT_EQ(1u, pool.size());
+    auto reused = pool.acquire();
+    EXPECT_TRUE(reused.empty());
+    EXPECT_EQ(data, reused.data());
+    EXPECT_EQ(0u, pool.size());
+}
+
+TEST(TestPacketPool, KeepsLimitedBuffers)
+{
+    PacketPool pool(1u);
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    pool.release(std::move(first));
+    pool.release(std::move(second));
+    EXPECT_EQ(1u, pool.size());
+    pool.release(std::vector<char>());
+    EXPECT_EQ(1u, pool.size());
+}
+
+}  // namespace dote
@@ -21,7 +21,7 @@ class TestServer : public ::testing::Test
     TestServer() :
         m_loop(std::make_shared<MockLoop>()),
         m_forwarders(std::make_shared<MockForwarders>()),
-        m_server(m_loop, m_forwarders),
+        m_server(m_loop, m_forwarders, std::make_shared<Metrics>()),
         m_callback(),
         m_handle(-1),
         m_config()
@@ -79,4 +79,26 @@ TEST_F(TestServer, ReadFromUnknown)
     m_callback(m_handle - 1);
 }
 
+TEST_F(TestServer, ReadBatch)
+{
+    configureCallback();
+    auto client = Socket::connect(m_config.address, Socket::UDP);
+    ASSERT_NE(nullptr, client);
+    for (char i = 1; i <= 3; ++i)
+    {
+        char request[2] = { i, 0 };
+        ASSERT_EQ(2, send(client->get(), request, sizeof(request), 0));
+    }
+    std::vector<IForwarders::Request> requests;
+    EXPECT_CALL(*m_forwarders, handleRequests(_, _))
+        .WillOnce(SaveArg<1>(&requests));
+    m_callback(m_handle);
+    ASSERT_EQ(3u, requests.size());
+    for (char i = 1; i <= 3; ++i)
+    {
+        std::vector<char> expected { 0, 2, i, 0 };
+        EXPECT_EQ(expected, requests[i - 1].request);
+    }
+}
+
 }  // namespace dote
@@ -0,0 +1,49 @@
+#include "stats_segment.h"
+#include "metrics.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace dote {
+
+TEST(TestStatsSegment, ReaderSeesPublishedMetrics)
+{
+    std::string name = "/dote_test_" + std::to_string(getpid());
+    auto metrics = std::make_shared<Metrics>();
+    metrics->counter("requests", "Requests").add(3u);
+    metrics->gauge("down", "Down", "forwarder=\"a\"").add(-1);
+    StatsSegment segment(metrics);
+    ASSERT_TRUE(segment.open(name));
+    segment.publish();
+
+    StatsReader reader;
+    ASSERT_TRUE(reader.open(name));
+    std::vector<StatsReader::Metric> read;
+    std::uint64_t updated = 0u;
+    ASSERT_TRUE(reader.read(read, updated));
+    EXPECT_NE(0u, updated);
+    ASSERT_EQ(2u, read.size());
+    EXPECT_EQ(StatsEntry::COUNTER, read[0].type);
+    EXPECT_EQ("requests", read[0].name);
+    EXPECT_EQ(std::vector<std::uint64_t>{ 3u }, read[0].values);
+    EXPECT_EQ(StatsEntry::GAUGE, read[1].type);
+    EXPECT_EQ("forwarder=\"a\"", read[1].labels);
+    EXPECT_EQ(-1, static_cast<std::int64_t>(read[1].values[0]));
+
+    // Growing past the first mapping is picked up by the reader
+    for (int i = 0; i < 100; ++i)
+    {
+        metrics->histogram("time", "Time", "n=\"" + std::to_string(i) + "\"")
+            .record(std::chrono::microseconds(i));
+    }
+    segment.publish();
+    ASSERT_TRUE(reader.read(read, updated));
+    ASSERT_EQ(102u, read.size());
+    EXPECT_EQ(StatsEntry::HISTOGRAM, read[101].type);
+    EXPECT_EQ(Metrics::Histogram::BUCKETS + 1u, read[101].values.size());
+    EXPECT_EQ(99u, read[101].values[0]);
+}
+
+}  // namespace dote
@@ -0,0 +1,97 @@
+#include "timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace dote {
+
+TEST(TestTimerWheel, EmptyHasNoTimeout)
+{
+    TimerWheel wheel;
+    EXPECT_FALSE(wheel.pending());
+    EXPECT_EQ(-1, wheel.timeout());
+}
+
+TEST(TestTimerWheel, TimeoutWithinDelay)
+{
+    TimerWheel wheel;
+    (void) wheel.add(std::chrono::milliseconds(300), [](int) {});
+    EXPECT_TRUE(wheel.pending());
+    int timeout = wheel.timeout();
+    EXPECT_GE(timeout, 0);
+    EXPECT_LE(timeout, 300);
+}
+
+TEST(TestTimerWheel, Fires)
+{
+    TimerWheel wheel;
+    int fired = 0;
+    int id = wheel.add(std::chrono::milliseconds(5), [&](int timer) {
+        ++fired;
+        EXPECT_EQ(id, timer);
+    });
+    while (wheel.pending())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(wheel.timeout()));
+        wheel.expire();
+    }
+    EXPECT_EQ(1, fired);
+}
+
+TEST(TestTimerWheel, FiresInOrderAcrossLevels)
+{
+    TimerWheel wheel;
+    std::vector<int> order;
+    (void) wheel.add(std::chrono::milliseconds(130), [&](int) { order.push_back(3); });
+    (void) wheel.add(std::chrono::milliseconds(1), [&](int) { order.push_back(1); });
+    (void) wheel.add(std::chrono::milliseconds(70), [&](int) { order.push_back(2); });
+    while (wheel.pending())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(wheel.timeout()));
+        wheel.expire();
+    }
+    EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), order);
+}
+
+TEST(TestTimerWheel, RemoveCancels)
+{
+    TimerWheel wheel;
+    bool fired = false;
+    int id = wheel.add(std::chrono::milliseconds(0), [&](int) { fired = true; });
+    wheel.remove(id);
+    EXPECT_FALSE(wheel.pending());
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    wheel.expire();
+    EXPECT_FALSE(fired);
+}
+
+TEST(TestTimerWheel, IdReservedUntilRemoved)
+{
+    TimerWheel wheel;
+    int first = wheel.add(std::chrono::milliseconds(0), [](int) {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    wheel.expire();
+    EXPECT_FALSE(wheel.pending());
+    int second = wheel.add(std::chrono::milliseconds(0), [](int) {});
+    EXPECT_NE(first, second);
+}
+
+TEST(TestTimerWheel, DeferredRunOnExpire)
+{
+    TimerWheel wheel;
+    std::vector<int> order;
+    (void) wheel.defer([&](int) {
+        order.push_back(1);
+        (void) wheel.defer([&](int) { order.push_back(2); });
+    });
+    int removed = wheel.defer([&](int) { order.push_back(3); });
+    wheel.remove(removed);
+    EXPECT_FALSE(wheel.pending());
+    EXPECT_EQ(0, wheel.timeout());
+    wheel.expire();
+    EXPECT_EQ(std::vector<int>({ 1, 2 }), order);
+    EXPECT_EQ(-1, wheel.timeout());
+}
+
+}  // namespace dote